@@ -290,6 +290,8 @@ namespace polyfem
 		rhs.resize(0, 0);
 		sol.resize(0, 0);
 		pressure.resize(0, 0);
+		vis_mesh_ = VisMesh();
+		vis_interpolation_.clear();
 
 		n_bases = 0;
 		n_pressure_bases = 0;
@@ -517,17 +519,22 @@ namespace polyfem
 		const int n_samples = 10;
 		compute_mesh_size(*mesh, curret_bases, n_samples);
 
-		if (args["has_collision"])
+		// the arguments can be edited between init and here (eg by the FEBio reader)
+		settings_.init(args);
+		settings_.iso_parametric = iso_parametric();
+
+		if (settings_.has_collision)
 		{
-			if (!has_dhat && args["dhat"] > min_edge_length)
+			if (!has_dhat && settings_.dhat > min_edge_length)
 			{
 				args["dhat"] = double(args["dhat_percentage"]) * min_edge_length;
-				logger().debug("dhat set to {}", double(args["dhat"]));
+				settings_.dhat = args["dhat"];
+				logger().debug("dhat set to {}", settings_.dhat);
 			}
 			else
 			{
-				if (args["dhat"] > min_edge_length)
-					logger().warn("dhat larger than min edge, {} > {}", double(args["dhat"]), min_edge_length);
+				if (settings_.dhat > min_edge_length)
+					logger().warn("dhat larger than min edge, {} > {}", settings_.dhat, min_edge_length);
 			}
 		}
 
@@ -795,7 +802,7 @@ namespace polyfem
 		}
 		else
 		{
-			if (!args["has_collision"]) //collisions are non-linear
+			if (!settings_.has_collision) //collisions are non-linear
 				assembler.assemble_problem(formulation(), mesh->is_volume(), n_bases, bases, iso_parametric() ? bases : geom_bases, ass_vals_cache, stiffness);
 			if (problem->is_time_dependent())
 			{
@@ -968,7 +975,7 @@ namespace polyfem
 			return;
 		}
 
-		if (assembler.is_linear(formulation()) && !args["has_collision"] && stiffness.rows() <= 0)
+		if (assembler.is_linear(formulation()) && !settings_.has_collision && stiffness.rows() <= 0)
 		{
 			logger().error("Assemble the stiffness matrix first!");
 			return;
@@ -1066,8 +1073,7 @@ namespace polyfem
 
 				if (!solve_export_to_file)
 					solution_frames.emplace_back();
-				save_vtu(resolve_output_path("step_0.vtu"), 0);
-				save_wire(resolve_output_path("step_0.obj"));
+				save_timestep(0, 0);
 
 				td_timer.stop();
 				logger().trace("done, took {}s", td_timer.getElapsedTime());
@@ -1081,17 +1087,31 @@ namespace polyfem
 			}
 			else if (problem->is_scalar() || assembler.is_mixed(formulation()))
 				solve_transient_scalar(time_steps, t0, dt, rhs_assembler, c_sol);
-			else if (assembler.is_linear(formulation()) && !args["has_collision"])
+			else if (args["time_integrator"] == "CentralDifference" && !settings().has_collision)
+				solve_transient_tensor_explicit(time_steps, t0, dt, rhs_assembler);
+			else if (assembler.is_linear(formulation()) && !settings().has_collision)
 				solve_transient_tensor_linear(time_steps, t0, dt, rhs_assembler);
 			else
+			{
+				//the explicit integrator has no barrier, the contact is solved implicitly
+				if (args["time_integrator"] == "CentralDifference")
+					logger().warn("CentralDifference does not support contact, using ImplicitEuler instead");
 				solve_transient_tensor_non_linear(time_steps, t0, dt, rhs_assembler);
+			}
+
+			flush_timesteps();
 		}
 		else //if(!problem->is_time_dependent())
 		{
 			if (formulation() == "NavierStokes")
 				solve_navier_stokes();
-			else if (assembler.is_linear(formulation()) && !args["has_collision"])
-				solve_linear();
+			else if (assembler.is_linear(formulation()) && !settings_.has_collision)
+			{
+				if (args["load_cases"].empty())
+					solve_linear();
+				else
+					solve_load_cases();
+			}
 			else
 				solve_non_linear();
 		}
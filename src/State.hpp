@@ -15,6 +15,8 @@
 #include <polyfem/ElasticityUtils.hpp>
 #include <polyfem/Common.hpp>
 #include <polyfem/Logger.hpp>
+#include <polyfem/SimulationSettings.hpp>
+#include <polyfem/AsyncExporter.hpp>
 
 #include <polyfem/Mesh2D.hpp>
 #include <polyfem/Mesh3D.hpp>
@@ -22,11 +24,6 @@
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
 
-// #ifdef POLYFEM_WITH_TBB
-// #include <thread>
-// #include <tbb/task_scheduler_init.h>
-// #endif
-
 #include <memory>
 #include <string>
 
@@ -51,7 +48,8 @@ namespace polyfem
 	class State
 	{
 	public:
-		~State() = default;
+		//waits for the pending exports
+		~State();
 
 		State();
 
@@ -91,6 +89,8 @@ namespace polyfem
 
 		//solver settings
 		json args;
+		//typed settings parsed from args, used in the solver loops
+		inline const SimulationSettings &settings() const { return settings_; }
 
 		// Directory for output files
 		std::string output_dir;
@@ -127,7 +127,8 @@ namespace polyfem
 		std::map<int, InterfaceData> poly_edge_to_data;
 
 		//current mesh, it can be a Mesh2D or Mesh3D
-		std::unique_ptr<Mesh> mesh;
+		//shared with the worker copies of solve_ensemble, which only read it
+		std::shared_ptr<Mesh> mesh;
 		//used to sample the solution
 		RefElementSampler ref_element_sampler;
 
@@ -153,6 +154,8 @@ namespace polyfem
 		//solution and pressure solution
 		//if the problem is not mixed, pressure is empty
 		Eigen::MatrixXd sol, pressure;
+		//solutions of the load cases, one column per case, empty if there are no load cases
+		Eigen::MatrixXd load_case_sols;
 
 		//boundary mesh used for collision
 		//boundary_nodes_pos contains the total number of nodes, the internal ones are zero
@@ -343,10 +346,21 @@ namespace polyfem
 		void solve_transient_scalar(const int time_steps, const double t0, const double dt, const RhsAssembler &rhs_assembler, Eigen::VectorXd &x);
 		void solve_transient_tensor_linear(const int time_steps, const double t0, const double dt, const RhsAssembler &rhs_assembler);
 		void solve_transient_tensor_non_linear(const int time_steps, const double t0, const double dt, const RhsAssembler &rhs_assembler);
+		void solve_transient_tensor_explicit(const int time_steps, const double t0, const double dt, const RhsAssembler &rhs_assembler);
 		void solve_linear();
+		//solves the linear static problem for every entry of load_cases, each is a patch of problem_params
+		//the cases must share the dirichlet and neumann boundary ids, only the values and the body forces can change
+		void solve_load_cases();
+		//solves every column of rhs_block (with the dirichlet values already set) using a single factorization of the stiffness
+		void solve_linear_multi_rhs(const Eigen::MatrixXd &rhs_block, Eigen::MatrixXd &sols);
 		void solve_navier_stokes();
 		void solve_non_linear();
 
+		//runs a parameter sweep on the current mesh and bases (call after build_basis)
+		//every variant is a json with optional "name", "params" (patch of the material params), "problem" and "problem_params" (patch)
+		//the variants must share the boundary ids of the base problem, results gets one entry of save_json per variant
+		void solve_ensemble(const json &variants, json &results);
+
 		//compute the errors, not part of solve
 		void compute_errors();
 		//saves all data on the disk according to the input params
@@ -413,11 +427,20 @@ namespace polyfem
 		void build_vis_mesh(Eigen::MatrixXd &points, Eigen::MatrixXi &tets, Eigen::MatrixXi &el_id, Eigen::MatrixXd &discr);
 
 		//saves the vtu file for time t
-		void save_vtu(const std::string &name, const double t);
+		void save_vtu(const std::string &name, const double t) { save_vtu(name, t, sol, pressure); }
+		//saves the vtu file for time t of the given solution and pressure instead of the current ones
+		void save_vtu(const std::string &name, const double t, const Eigen::MatrixXd &solution, const Eigen::MatrixXd &pressure_solution);
 		//saves the surface vtu file for for surface quantites, eg traction forces
-		void save_surface(const std::string &name);
+		void save_surface(const std::string &name) { save_surface(name, sol, pressure); }
+		void save_surface(const std::string &name, const Eigen::MatrixXd &solution, const Eigen::MatrixXd &pressure_solution);
 		//saves an obj of the wireframe
-		void save_wire(const std::string &name, bool isolines = false);
+		void save_wire(const std::string &name, bool isolines = false) { save_wire(name, sol, isolines); }
+		void save_wire(const std::string &name, const Eigen::MatrixXd &solution, bool isolines = false);
+		//saves the vtu and obj of the time step t (at time time) of a time dependent simulation
+		//with args["export"]["async"] the current solution is copied and written on the export thread while the solve continues
+		void save_timestep(const double time, const int t);
+		//waits for the time steps being exported
+		void flush_timesteps();
 		// save a PVD of a time dependent simulation
 		void save_pvd(const std::string &name, const std::function<std::string(int)> &vtu_names, int time_steps, double t0, double dt);
 
@@ -544,14 +567,66 @@ namespace polyfem
 		void p_refinement(const Mesh3D &mesh3d);
 
 	private:
+		//copy used by the workers of solve_ensemble, it shares the mesh and the exporter (use reset_output_caches)
+		State(const State &other) = default;
+		//drops the exporter and the visualization caches of a copy
+		void reset_output_caches();
+		//solves one variant of solve_ensemble with the base parameters of the sweep and fills j
+		void solve_variant(const json &variant, const std::string &name, const json &base_params, const json &base_problem, const json &base_problem_params, json &j);
+
+		SimulationSettings settings_;
+
+		//background writer of the time steps, created by the first save_timestep
+		std::shared_ptr<AsyncExporter> exporter_;
+
+		//visualization mesh of save_vtu, built once per basis and vis_boundary_only
+		struct VisMesh
+		{
+			bool built = false;
+			bool boundary_only = false;
+			Eigen::MatrixXd points;
+			Eigen::MatrixXi tets;
+			Eigen::MatrixXi el_id;
+			Eigen::MatrixXd discr;
+		} vis_mesh_;
+		const VisMesh &vis_mesh(const bool boundary_only);
+
+		//export arguments read by save_vtu and save_surface, save_timestep copies them into the export job
+		//so that the export thread never reads args
+		struct ExportOptions
+		{
+			bool vis_boundary_only;
+			bool material_params;
+			bool body_ids;
+			bool sol_on_grid;
+			bool surface;
+			bool contact_forces;
+			bool use_spline;
+			std::string vtu_format;
+			double dhat;
+		};
+		ExportOptions export_options() const;
+		void save_vtu(const std::string &path, const double t, const Eigen::MatrixXd &solution, const Eigen::MatrixXd &pressure_solution, const ExportOptions &options);
+		void save_surface(const std::string &name, const Eigen::MatrixXd &solution, const Eigen::MatrixXd &pressure_solution, const ExportOptions &options);
+
+		//sparse operators from the nodal values of a basis (bases or pressure_bases) to the samples of the visualization,
+		//the output interpolates every frame with a product instead of evaluating the bases again
+		//keyed by the basis and boundary_only, built on first use and cleared by build_basis
+		typedef Eigen::SparseMatrix<double, Eigen::RowMajor> VisOperator;
+		std::map<std::pair<const std::vector<ElementBases> *, bool>, VisOperator> vis_interpolation_;
+		const VisOperator &vis_interpolation(const std::vector<ElementBases> &basis, const int n_nodes, const bool boundary_only);
+		//builds the caches above, so the export thread only reads them
+		void build_vis_cache(const bool boundary_only);
+
+		//reference points sampled in element i for the visualization
+		void vis_local_points(const int i, Eigen::MatrixXd &local_pts) const;
+		//calls func(i, local_pts, offset) in parallel for every visualized element, offset is the index of its first sample
+		void for_each_vis_element(const bool boundary_only, const std::function<void(const int, const Eigen::MatrixXd &, const int)> &func) const;
+
 		//splits the solution in solution and pressure for mixed problems
 		void sol_to_pressure();
 		//builds bases for polygons, called inside build_basis
 		void build_polygonal_basis();
-
-		// #ifdef USE_TBB
-		// 		tbb::task_scheduler_init scheduler;
-		// #endif
 	};
 
 } // namespace polyfem
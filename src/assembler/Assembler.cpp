@@ -38,6 +38,8 @@ namespace polyfem
 			SpareMatrixCache cache;
 			ElementAssemblyValues vals;
 			QuadratureVector da;
+			// id of the last call of a persistent storage
+			long call = -1;
 
 			LocalThreadMatStorage()
 			{
@@ -73,6 +75,11 @@ namespace polyfem
 			Eigen::MatrixXd vec;
 			ElementAssemblyValues vals;
 			QuadratureVector da;
+			long call = -1;
+
+			LocalThreadVecStorage()
+			{
+			}
 
 			LocalThreadVecStorage(const int size)
 			{
@@ -87,6 +94,7 @@ namespace polyfem
 			double val;
 			ElementAssemblyValues vals;
 			QuadratureVector da;
+			long call = -1;
 
 			LocalThreadScalarStorage()
 			{
@@ -132,6 +140,38 @@ namespace polyfem
 #endif
 	} // namespace
 
+	struct AssemblerStorages::Data
+	{
+		// every call stamps the storages it uses, the others hold data of previous calls
+		long n_calls = 0;
+#if defined(POLYFEM_WITH_TBB)
+		tbb::enumerable_thread_specific<LocalThreadVecStorage> vec;
+		tbb::enumerable_thread_specific<LocalThreadMatStorage> mat;
+		tbb::enumerable_thread_specific<LocalThreadScalarStorage> scalar;
+#else
+		std::vector<LocalThreadVecStorage> vec;
+		std::vector<LocalThreadMatStorage> mat;
+		std::vector<LocalThreadScalarStorage> scalar;
+#endif
+	};
+
+	AssemblerStorages::AssemblerStorages()
+		: data_(std::make_unique<Data>())
+	{
+	}
+
+	AssemblerStorages::AssemblerStorages(const AssemblerStorages &)
+		: data_(std::make_unique<Data>())
+	{
+	}
+
+	AssemblerStorages &AssemblerStorages::operator=(const AssemblerStorages &)
+	{
+		return *this;
+	}
+
+	AssemblerStorages::~AssemblerStorages() = default;
+
 	template <class LocalAssembler>
 	void Assembler<LocalAssembler>::assemble(
 		const bool is_volume,
@@ -153,6 +193,8 @@ namespace polyfem
 
 #if defined(POLYFEM_WITH_CPP_THREADS)
 			std::vector<LocalThreadMatStorage> storages(polyfem::get_n_threads());
+			for (auto &loc_storage : storages)
+				loc_storage.init(buffer_size, stiffness.rows(), stiffness.cols());
 #elif defined(POLYFEM_WITH_TBB)
 			typedef tbb::enumerable_thread_specific<LocalThreadMatStorage> LocalStorage;
 			LocalStorage storages(LocalThreadMatStorage(buffer_size, stiffness.rows(), stiffness.cols()));
@@ -167,7 +209,6 @@ namespace polyfem
 			polyfem::par_for(n_bases, [&](int start, int end, int t)
 							 {
 								 auto &loc_storage = storages[t];
-								 loc_storage.init(buffer_size, stiffness.rows(), stiffness.cols());
 								 for (int e = start; e < end; ++e)
 								 {
 #elif defined(POLYFEM_WITH_TBB)
@@ -252,9 +293,6 @@ namespace polyfem
 					// if (!vals.has_parameterization) { std::cout << "-- Timer: " << timer.getElapsedTime() << std::endl; }
 #if defined(POLYFEM_WITH_CPP_THREADS) || defined(POLYFEM_WITH_TBB)
 								 }
-#if defined(POLYFEM_WITH_CPP_THREADS)
-								 loc_storage.cache.prune();
-#endif
 							 });
 #else
 				}
@@ -316,6 +354,8 @@ namespace polyfem
 
 #if defined(POLYFEM_WITH_CPP_THREADS)
 		std::vector<LocalThreadMatStorage> storages(polyfem::get_n_threads());
+		for (auto &loc_storage : storages)
+			loc_storage.init(buffer_size, stiffness.rows(), stiffness.cols());
 #elif defined(POLYFEM_WITH_TBB)
 			typedef tbb::enumerable_thread_specific<LocalThreadMatStorage> LocalStorage;
 			LocalStorage storages(LocalThreadMatStorage(buffer_size, stiffness.rows(), stiffness.cols()));
@@ -331,7 +371,6 @@ namespace polyfem
 		polyfem::par_for(n_bases, [&](int start, int end, int t)
 						 {
 							 auto &loc_storage = storages[t];
-							 loc_storage.init(buffer_size, stiffness.rows(), stiffness.cols());
 							 ElementAssemblyValues psi_vals, phi_vals;
 							 for (int e = start; e < end; ++e)
 							 {
@@ -404,9 +443,6 @@ namespace polyfem
 								 }
 #if defined(POLYFEM_WITH_CPP_THREADS) || defined(POLYFEM_WITH_TBB)
 							 }
-#if defined(POLYFEM_WITH_CPP_THREADS)
-							 loc_storage.cache.prune();
-#endif
 						 });
 #else
 				}
@@ -454,13 +490,25 @@ namespace polyfem
 		rhs.resize(n_basis * local_assembler_.size(), 1);
 		rhs.setZero();
 
-#if defined(POLYFEM_WITH_CPP_THREADS)
-		std::vector<LocalThreadVecStorage> storages(polyfem::get_n_threads(), rhs.size());
-#elif defined(POLYFEM_WITH_TBB)
-				typedef tbb::enumerable_thread_specific<LocalThreadVecStorage> LocalStorage;
-				LocalStorage storages(LocalThreadVecStorage(rhs.size()));
+		AssemblerStorages::Data &data = storages_.data();
+		const long call = ++data.n_calls;
+		const auto prepare = [&](LocalThreadVecStorage &s) {
+			if (s.call == call)
+				return;
+			s.call = call;
+			s.vec.setZero(rhs.size(), 1);
+		};
+
+#if defined(POLYFEM_WITH_TBB)
+		typedef tbb::enumerable_thread_specific<LocalThreadVecStorage> LocalStorage;
+		LocalStorage &storages = data.vec;
 #else
-				LocalThreadVecStorage loc_storage(rhs.size());
+		std::vector<LocalThreadVecStorage> &storages = data.vec;
+		storages.resize(polyfem::get_n_threads());
+#if !defined(POLYFEM_WITH_CPP_THREADS)
+		LocalThreadVecStorage &loc_storage = storages[0];
+		prepare(loc_storage);
+#endif
 #endif
 
 		const int n_bases = int(bases.size());
@@ -469,12 +517,13 @@ namespace polyfem
 		polyfem::par_for(n_bases, [&](int start, int end, int t)
 						 {
 							 auto &loc_storage = storages[t];
-							 assert(loc_storage.vec.size() == rhs.size());
+							 prepare(loc_storage);
 							 for (int e = start; e < end; ++e)
 							 {
 #elif defined(POLYFEM_WITH_TBB)
 		tbb::parallel_for(tbb::blocked_range<int>(0, n_bases), [&](const tbb::blocked_range<int> &r) {
 					LocalStorage::reference loc_storage = storages.local();
+					prepare(loc_storage);
 					for (int e = r.begin(); e != r.end(); ++e)
 					{
 #else
@@ -532,19 +581,11 @@ namespace polyfem
 					}
 #endif
 
-#if defined(POLYFEM_WITH_CPP_THREADS)
 		for (const auto &t : storages)
 		{
-			rhs += t.vec;
+			if (t.call == call)
+				rhs += t.vec;
 		}
-#elif defined(POLYFEM_WITH_TBB)
-					for (LocalStorage::iterator i = storages.begin(); i != storages.end(); ++i)
-					{
-						rhs += i->vec;
-					}
-#else
-					rhs = loc_storage.vec;
-#endif
 	}
 
 	template <class LocalAssembler>
@@ -557,7 +598,8 @@ namespace polyfem
 		const AssemblyValsCache &cache,
 		const Eigen::MatrixXd &displacement,
 		SpareMatrixCache &mat_cache,
-		StiffnessMatrix &grad) const
+		StiffnessMatrix &grad,
+		const std::vector<int> *elements) const
 	{
 		const int buffer_size = std::min(long(1e8), long(n_basis) * local_assembler_.size());
 		// std::cout<<"buffer_size "<<buffer_size<<std::endl;
@@ -568,16 +610,28 @@ namespace polyfem
 		mat_cache.init(n_basis * local_assembler_.size());
 		mat_cache.set_zero();
 
-#if defined(POLYFEM_WITH_CPP_THREADS)
-		std::vector<LocalThreadMatStorage> storages(polyfem::get_n_threads());
-#elif defined(POLYFEM_WITH_TBB)
-					typedef tbb::enumerable_thread_specific<LocalThreadMatStorage> LocalStorage;
-					LocalStorage storages(LocalThreadMatStorage(buffer_size, mat_cache));
+		AssemblerStorages::Data &data = storages_.data();
+		const long call = ++data.n_calls;
+		const auto prepare = [&](LocalThreadMatStorage &s) {
+			if (s.call == call)
+				return;
+			s.call = call;
+			s.init(buffer_size, mat_cache);
+		};
+
+#if defined(POLYFEM_WITH_TBB)
+		typedef tbb::enumerable_thread_specific<LocalThreadMatStorage> LocalStorage;
+		LocalStorage &storages = data.mat;
 #else
-					LocalThreadMatStorage loc_storage(buffer_size, mat_cache);
+		std::vector<LocalThreadMatStorage> &storages = data.mat;
+		storages.resize(polyfem::get_n_threads());
+#if !defined(POLYFEM_WITH_CPP_THREADS)
+		LocalThreadMatStorage &loc_storage = storages[0];
+		prepare(loc_storage);
+#endif
 #endif
 
-		const int n_bases = int(bases.size());
+		const int n_bases = elements ? int(elements->size()) : int(bases.size());
 		igl::Timer timerg;
 		timerg.start();
 
@@ -585,18 +639,20 @@ namespace polyfem
 		polyfem::par_for(n_bases, [&](int start, int end, int t)
 						 {
 							 auto &loc_storage = storages[t];
-							 loc_storage.init(buffer_size, mat_cache);
-							 for (int e = start; e < end; ++e)
+							 prepare(loc_storage);
+							 for (int k = start; k < end; ++k)
 							 {
 #elif defined(POLYFEM_WITH_TBB)
 		tbb::parallel_for(tbb::blocked_range<int>(0, n_bases), [&](const tbb::blocked_range<int> &r) {
 						LocalStorage::reference loc_storage = storages.local();
-						for (int e = r.begin(); e != r.end(); ++e)
+						prepare(loc_storage);
+						for (int k = r.begin(); k != r.end(); ++k)
 						{
 #else
-					for (int e = 0; e < n_bases; ++e)
+					for (int k = 0; k < n_bases; ++k)
 					{
 #endif
+								 const int e = elements ? (*elements)[k] : k;
 								 ElementAssemblyValues &vals = loc_storage.vals;
 								 cache.compute(e, is_volume, bases[e], gbases[e], vals);
 
@@ -676,9 +732,6 @@ namespace polyfem
 								 }
 #if defined(POLYFEM_WITH_CPP_THREADS) || defined(POLYFEM_WITH_TBB)
 							 }
-#if defined(POLYFEM_WITH_CPP_THREADS)
-							 loc_storage.cache.prune();
-#endif
 						 });
 #else
 						}
@@ -689,19 +742,14 @@ namespace polyfem
 
 		timerg.start();
 
-#if defined(POLYFEM_WITH_CPP_THREADS)
-		for (const auto &t : storages)
+		for (auto &t : storages)
 		{
+			if (t.call != call)
+				continue;
+			t.cache.prune();
 			mat_cache += t.cache;
 		}
 
-#elif defined(POLYFEM_WITH_TBB)
-						merge_matrices(storages, mat_cache);
-#else
-						loc_storage.cache.prune();
-						mat_cache += loc_storage.cache;
-#endif
-
 		grad = mat_cache.get_matrix();
 
 		timerg.stop();
@@ -716,13 +764,25 @@ namespace polyfem
 		const AssemblyValsCache &cache,
 		const Eigen::MatrixXd &displacement) const
 	{
-#if defined(POLYFEM_WITH_CPP_THREADS)
-		std::vector<LocalThreadScalarStorage> storages(polyfem::get_n_threads());
-#elif defined(POLYFEM_WITH_TBB)
-						typedef tbb::enumerable_thread_specific<LocalThreadScalarStorage> LocalStorage;
-						LocalStorage storages((LocalThreadScalarStorage()));
+		AssemblerStorages::Data &data = storages_.data();
+		const long call = ++data.n_calls;
+		const auto prepare = [&](LocalThreadScalarStorage &s) {
+			if (s.call == call)
+				return;
+			s.call = call;
+			s.val = 0;
+		};
+
+#if defined(POLYFEM_WITH_TBB)
+		typedef tbb::enumerable_thread_specific<LocalThreadScalarStorage> LocalStorage;
+		LocalStorage &storages = data.scalar;
 #else
-						LocalThreadScalarStorage loc_storage;
+		std::vector<LocalThreadScalarStorage> &storages = data.scalar;
+		storages.resize(polyfem::get_n_threads());
+#if !defined(POLYFEM_WITH_CPP_THREADS)
+		LocalThreadScalarStorage &loc_storage = storages[0];
+		prepare(loc_storage);
+#endif
 #endif
 		const int n_bases = int(bases.size());
 
@@ -730,11 +790,13 @@ namespace polyfem
 		polyfem::par_for(n_bases, [&](int start, int end, int t)
 						 {
 							 auto &loc_storage = storages[t];
+							 prepare(loc_storage);
 							 for (int e = start; e < end; ++e)
 							 {
 #elif defined(POLYFEM_WITH_TBB)
 		tbb::parallel_for(tbb::blocked_range<int>(0, n_bases), [&](const tbb::blocked_range<int> &r) {
 							LocalStorage::reference loc_storage = storages.local();
+							prepare(loc_storage);
 							for (int e = r.begin(); e != r.end(); ++e)
 							{
 #else
@@ -760,25 +822,99 @@ namespace polyfem
 							}
 #endif
 
-#if defined(POLYFEM_WITH_CPP_THREADS)
 		double res = 0;
 		for (const auto &t : storages)
 		{
-			res += t.val;
+			if (t.call == call)
+				res += t.val;
 		}
 
 		return res;
+	}
+
+	template <class LocalAssembler>
+	void NLAssembler<LocalAssembler>::assemble_line_polynomial(
+		const bool is_volume,
+		const std::vector<ElementBases> &bases,
+		const std::vector<ElementBases> &gbases,
+		const AssemblyValsCache &cache,
+		const Eigen::MatrixXd &displacement,
+		const Eigen::MatrixXd &direction,
+		const int degree,
+		Eigen::VectorXd &coeffs) const
+	{
+		assert(degree >= 1);
+		assert(displacement.size() == direction.size());
+
+		const int n_samples = degree + 1;
+		std::vector<Eigen::MatrixXd> samples(n_samples);
+		Eigen::VectorXd alphas(n_samples);
+		for (int k = 0; k < n_samples; ++k)
+		{
+			alphas(k) = double(k) / degree;
+			samples[k] = displacement + alphas(k) * direction;
+		}
+
+#if defined(POLYFEM_WITH_CPP_THREADS)
+		std::vector<LocalThreadVecStorage> storages(polyfem::get_n_threads(), LocalThreadVecStorage(n_samples));
 #elif defined(POLYFEM_WITH_TBB)
-							double res = 0;
-							for (LocalStorage::const_iterator i = storages.begin(); i != storages.end(); ++i)
-							{
-								res += i->val;
-							}
+		typedef tbb::enumerable_thread_specific<LocalThreadVecStorage> LocalStorage;
+		LocalStorage storages((LocalThreadVecStorage(n_samples)));
+#else
+		LocalThreadVecStorage loc_storage(n_samples);
+#endif
+		const int n_bases = int(bases.size());
+
+#if defined(POLYFEM_WITH_CPP_THREADS)
+		polyfem::par_for(n_bases, [&](int start, int end, int t) {
+			auto &loc_storage = storages[t];
+			for (int e = start; e < end; ++e)
+			{
+#elif defined(POLYFEM_WITH_TBB)
+		tbb::parallel_for(tbb::blocked_range<int>(0, n_bases), [&](const tbb::blocked_range<int> &r) {
+			LocalStorage::reference loc_storage = storages.local();
+			for (int e = r.begin(); e != r.end(); ++e)
+			{
+#else
+		for (int e = 0; e < n_bases; ++e)
+		{
+#endif
+				//the geometric quantities are computed once and shared by all the samples
+				ElementAssemblyValues &vals = loc_storage.vals;
+				cache.compute(e, is_volume, bases[e], gbases[e], vals);
+
+				const Quadrature &quadrature = vals.quadrature;
+				loc_storage.da = vals.det.array() * quadrature.weights.array();
 
-							return res;
+				for (int k = 0; k < n_samples; ++k)
+					loc_storage.vec(k) += local_assembler_.compute_energy(vals, samples[k], loc_storage.da);
+#if defined(POLYFEM_WITH_CPP_THREADS) || defined(POLYFEM_WITH_TBB)
+			}
+		});
+#else
+		}
+#endif
+
+		Eigen::VectorXd energies = Eigen::VectorXd::Zero(n_samples);
+#if defined(POLYFEM_WITH_CPP_THREADS)
+		for (const auto &t : storages)
+			energies += t.vec;
+#elif defined(POLYFEM_WITH_TBB)
+		for (LocalStorage::const_iterator i = storages.begin(); i != storages.end(); ++i)
+			energies += i->vec;
 #else
-							return loc_storage.val;
+		energies = loc_storage.vec;
 #endif
+
+		//interpolate the samples, the vandermonde system is tiny and well conditioned on [0, 1]
+		Eigen::MatrixXd vandermonde(n_samples, n_samples);
+		for (int k = 0; k < n_samples; ++k)
+		{
+			vandermonde(k, 0) = 1;
+			for (int j = 1; j < n_samples; ++j)
+				vandermonde(k, j) = vandermonde(k, j - 1) * alphas(k);
+		}
+		coeffs = vandermonde.partialPivLu().solve(energies);
 	}
 
 	//template instantiation
@@ -64,6 +64,25 @@ namespace polyfem
 		LocalAssembler local_assembler_;
 	};
 
+	//per-thread element storages of the non-linear assembly loops (defined in the cpp), they are kept across calls
+	//so that the buffers of the size of the problem are allocated once
+	//a copy starts with its own empty storages, an assembler cannot be used by two threads at the same time
+	class AssemblerStorages
+	{
+	public:
+		struct Data;
+
+		AssemblerStorages();
+		AssemblerStorages(const AssemblerStorages &);
+		AssemblerStorages &operator=(const AssemblerStorages &);
+		~AssemblerStorages();
+
+		inline Data &data() const { return *data_; }
+
+	private:
+		std::unique_ptr<Data> data_;
+	};
+
 	//non-linear assembler (eg neohookean elasticity)
 	template <class LocalAssembler>
 	class NLAssembler
@@ -79,6 +98,7 @@ namespace polyfem
 			const Eigen::MatrixXd &displacement,
 			Eigen::MatrixXd &rhs) const;
 		//assemble hessian of energy (grad)
+		//if elements is given only those elements are assembled, the other entries are zero
 		void assemble_hessian(
 			const bool is_volume,
 			const int n_basis,
@@ -88,7 +108,8 @@ namespace polyfem
 			const AssemblyValsCache &cache,
 			const Eigen::MatrixXd &displacement,
 			SpareMatrixCache &mat_cache,
-			StiffnessMatrix &grad) const;
+			StiffnessMatrix &grad,
+			const std::vector<int> *elements = nullptr) const;
 
 		//assemble energy
 		double assemble(
@@ -98,11 +119,25 @@ namespace polyfem
 			const AssemblyValsCache &cache,
 			const Eigen::MatrixXd &displacement) const;
 
+		//coefficients of the energy along a line, E(displacement + alpha * direction) = sum_k coeffs(k) alpha^k
+		//exact for energies polynomial of the given degree in the displacement, the energy is sampled
+		//at degree + 1 steps in a single sweep over the elements and interpolated
+		void assemble_line_polynomial(
+			const bool is_volume,
+			const std::vector<ElementBases> &bases,
+			const std::vector<ElementBases> &gbases,
+			const AssemblyValsCache &cache,
+			const Eigen::MatrixXd &displacement,
+			const Eigen::MatrixXd &direction,
+			const int degree,
+			Eigen::VectorXd &coeffs) const;
+
 		inline LocalAssembler &local_assembler() { return local_assembler_; }
 		inline const LocalAssembler &local_assembler() const { return local_assembler_; }
 
 	private:
 		LocalAssembler local_assembler_;
+		AssemblerStorages storages_;
 	};
 } // namespace polyfem
 
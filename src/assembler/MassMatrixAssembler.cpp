@@ -57,6 +57,8 @@ namespace polyfem
 
 #if defined(POLYFEM_WITH_CPP_THREADS)
 		std::vector<LocalThreadMatStorage> storages(polyfem::get_n_threads());
+		for (auto &loc_storage : storages)
+			loc_storage.init(buffer_size, mass.rows());
 #elif defined(POLYFEM_WITH_TBB)
 		typedef tbb::enumerable_thread_specific<LocalThreadMatStorage> LocalStorage;
 		LocalStorage storages(LocalThreadMatStorage(buffer_size, mass.rows()));
@@ -70,7 +72,6 @@ namespace polyfem
 		polyfem::par_for(n_bases, [&](int start, int end, int t)
 						 {
 							 auto &loc_storage = storages[t];
-							 loc_storage.init(buffer_size, mass.rows());
 							 for (int e = start; e < end; ++e)
 							 {
 #elif defined(POLYFEM_WITH_TBB)
@@ -166,20 +167,17 @@ namespace polyfem
 				// if (!vals.has_parameterization) { std::cout << "-- Timer: " << timer.getElapsedTime() << std::endl; }
 #if defined(POLYFEM_WITH_CPP_THREADS) || defined(POLYFEM_WITH_TBB)
 							 }
-#if defined(POLYFEM_WITH_CPP_THREADS)
-							 loc_storage.tmp_mat.setFromTriplets(loc_storage.entries.begin(), loc_storage.entries.end());
-							 loc_storage.mass_mat += loc_storage.tmp_mat;
-							 loc_storage.mass_mat.makeCompressed();
-#endif
 						 });
 #else
 			}
 #endif
 
 #if defined(POLYFEM_WITH_CPP_THREADS)
-		for (const auto &t : storages)
+		for (auto &t : storages)
 		{
 			mass += t.mass_mat;
+			t.tmp_mat.setFromTriplets(t.entries.begin(), t.entries.end());
+			mass += t.tmp_mat;
 		}
 #elif defined(POLYFEM_WITH_TBB)
 			for (LocalStorage::iterator i = storages.begin(); i != storages.end(); ++i)
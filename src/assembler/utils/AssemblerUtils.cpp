@@ -54,6 +54,16 @@ namespace polyfem
 		return assembler != "SaintVenant" && assembler != "NeoHookean" && assembler != "NavierStokes" && assembler != "MultiModels" /*&& assembler != "Ogden"*/;
 	}
 
+	int AssemblerUtils::energy_polynomial_degree(const std::string &assembler)
+	{
+		//linear elasticity is quadratic, Green strain is quadratic in the displacement and St.Venant-Kirchhoff quadratic in the strain
+		if (assembler == "LinearElasticity")
+			return 2;
+		if (assembler == "SaintVenant")
+			return 4;
+		return -1;
+	}
+
 	void AssemblerUtils::assemble_problem(const std::string &assembler,
 										  const bool is_volume,
 										  const int n_basis,
@@ -186,6 +196,27 @@ namespace polyfem
 			return 0;
 	}
 
+	bool AssemblerUtils::assemble_energy_line_polynomial(const std::string &assembler,
+														 const bool is_volume,
+														 const std::vector<ElementBases> &bases,
+														 const std::vector<ElementBases> &gbases,
+														 const AssemblyValsCache &cache,
+														 const Eigen::MatrixXd &displacement,
+														 const Eigen::MatrixXd &direction,
+														 Eigen::VectorXd &coeffs) const
+	{
+		const int degree = energy_polynomial_degree(assembler);
+
+		if (assembler == "SaintVenant")
+			saint_venant_elasticity_.assemble_line_polynomial(is_volume, bases, gbases, cache, displacement, direction, degree, coeffs);
+		else if (assembler == "LinearElasticity")
+			linear_elasticity_energy_.assemble_line_polynomial(is_volume, bases, gbases, cache, displacement, direction, degree, coeffs);
+		else
+			return false;
+
+		return true;
+	}
+
 	void AssemblerUtils::assemble_energy_gradient(const std::string &assembler,
 												  const bool is_volume,
 												  const int n_basis,
@@ -221,24 +252,25 @@ namespace polyfem
 												 const AssemblyValsCache &cache,
 												 const Eigen::MatrixXd &displacement,
 												 SpareMatrixCache &mat_cache,
-												 StiffnessMatrix &hessian) const
+												 StiffnessMatrix &hessian,
+												 const std::vector<int> *elements) const
 	{
 		if (assembler == "SaintVenant")
-			saint_venant_elasticity_.assemble_hessian(is_volume, n_basis, project_to_psd, bases, gbases, cache, displacement, mat_cache, hessian);
+			saint_venant_elasticity_.assemble_hessian(is_volume, n_basis, project_to_psd, bases, gbases, cache, displacement, mat_cache, hessian, elements);
 		else if (assembler == "NeoHookean")
-			neo_hookean_elasticity_.assemble_hessian(is_volume, n_basis, project_to_psd, bases, gbases, cache, displacement, mat_cache, hessian);
+			neo_hookean_elasticity_.assemble_hessian(is_volume, n_basis, project_to_psd, bases, gbases, cache, displacement, mat_cache, hessian, elements);
 		else if (assembler == "MultiModels")
-			multi_models_elasticity_.assemble_hessian(is_volume, n_basis, project_to_psd, bases, gbases, cache, displacement, mat_cache, hessian);
+			multi_models_elasticity_.assemble_hessian(is_volume, n_basis, project_to_psd, bases, gbases, cache, displacement, mat_cache, hessian, elements);
 
 		else if (assembler == "NavierStokesPicard")
-			navier_stokes_velocity_picard_.assemble_hessian(is_volume, n_basis, project_to_psd, bases, gbases, cache, displacement, mat_cache, hessian);
+			navier_stokes_velocity_picard_.assemble_hessian(is_volume, n_basis, project_to_psd, bases, gbases, cache, displacement, mat_cache, hessian, elements);
 		else if (assembler == "NavierStokes")
-			navier_stokes_velocity_.assemble_hessian(is_volume, n_basis, project_to_psd, bases, gbases, cache, displacement, mat_cache, hessian);
+			navier_stokes_velocity_.assemble_hessian(is_volume, n_basis, project_to_psd, bases, gbases, cache, displacement, mat_cache, hessian, elements);
 		else if (assembler == "LinearElasticity")
-			linear_elasticity_energy_.assemble_hessian(is_volume, n_basis, project_to_psd, bases, gbases, cache, displacement, mat_cache, hessian);
+			linear_elasticity_energy_.assemble_hessian(is_volume, n_basis, project_to_psd, bases, gbases, cache, displacement, mat_cache, hessian, elements);
 
 		//else if(assembler == "Ogden")
-		//	ogden_elasticity_.assemble_hessian(is_volume, n_basis, project_to_psd, bases, gbases, cache, displacement, mat_cache, hessian);
+		//	ogden_elasticity_.assemble_hessian(is_volume, n_basis, project_to_psd, bases, gbases, cache, displacement, mat_cache, hessian, elements);
 		else
 			return;
 	}
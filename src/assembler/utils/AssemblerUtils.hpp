@@ -79,6 +79,17 @@ namespace polyfem
 							   const AssemblyValsCache &cache,
 							   const Eigen::MatrixXd &displacement) const;
 
+		//coefficients of the energy along displacement + alpha * direction, in increasing powers of alpha
+		//returns false if the energy of the formulation is not polynomial (see energy_polynomial_degree)
+		bool assemble_energy_line_polynomial(const std::string &assembler,
+											 const bool is_volume,
+											 const std::vector<ElementBases> &bases,
+											 const std::vector<ElementBases> &gbases,
+											 const AssemblyValsCache &cache,
+											 const Eigen::MatrixXd &displacement,
+											 const Eigen::MatrixXd &direction,
+											 Eigen::VectorXd &coeffs) const;
+
 		//non linear gradient, assembler is the name of the formulation
 		void assemble_energy_gradient(const std::string &assembler,
 									  const bool is_volume,
@@ -89,6 +100,7 @@ namespace polyfem
 									  const Eigen::MatrixXd &displacement,
 									  Eigen::MatrixXd &grad) const;
 		//non-linear hessian, assembler is the name of the formulation
+		//if elements is given only those elements are assembled
 		void assemble_energy_hessian(const std::string &assembler,
 									 const bool is_volume,
 									 const int n_basis,
@@ -98,7 +110,8 @@ namespace polyfem
 									 const AssemblyValsCache &cache,
 									 const Eigen::MatrixXd &displacement,
 									 SpareMatrixCache &mat_cache,
-									 StiffnessMatrix &hessian) const;
+									 StiffnessMatrix &hessian,
+									 const std::vector<int> *elements = nullptr) const;
 
 		//plotting (eg von mises), assembler is the name of the formulation
 		void compute_scalar_value(const std::string &assembler,
@@ -140,6 +153,9 @@ namespace polyfem
 		//checks if assembler is linear
 		static bool is_linear(const std::string &assembler);
 
+		//degree of the energy as a polynomial of the displacement, -1 if it is not polynomial
+		static int energy_polynomial_degree(const std::string &assembler);
+
 		//checks if assembler solution is displacement (true for elasticty)
 		static bool is_solution_displacement(const std::string &assembler);
 
@@ -68,6 +68,8 @@ int main(int argc, char **argv)
 	int log_level = 1;
 	int nl_solver_rhs_steps = 1;
 	int cache_size = -1;
+	int max_threads = -1;
+	bool pin_threads = false;
 
 	double ccd_max_iterations = -1;
 	std::string ccd_method = "";
@@ -116,6 +118,8 @@ int main(int argc, char **argv)
 	command_line.add_set("--bc_method", bc_method, std::set<std::string>(bc_methods.begin(), bc_methods.end()), "Method used for boundary conditions");
 
 	command_line.add_option("--cache_size", cache_size, "Size of the cached assembly values");
+	command_line.add_option("--max_threads", max_threads, "Maximum number of threads, 0 uses all the cores");
+	command_line.add_flag("--pin_threads", pin_threads, "Pin every thread to a core");
 	command_line.add_option("--min_component", min_component, "Mimimum number of faces in connected compoment for contact");
 
 	// disable out
@@ -235,6 +239,10 @@ int main(int argc, char **argv)
 		in_args["solver_type"] = solver;
 	if (cache_size >= 0)
 		in_args["cache_size"] = cache_size;
+	if (max_threads >= 0)
+		in_args["max_threads"] = max_threads;
+	if (pin_threads)
+		in_args["pin_threads"] = pin_threads;
 	if (!output_vtu.empty())
 	{
 		in_args["export"]["vis_mesh"] = output_vtu;
@@ -290,6 +298,20 @@ int main(int argc, char **argv)
 		if (stop_after_build_basis)
 			return EXIT_SUCCESS;
 
+		if (!state.args["ensemble"].empty())
+		{
+			json results;
+			state.solve_ensemble(state.args["ensemble"], results);
+
+			const std::string out_path = state.args["output"];
+			if (!out_path.empty())
+			{
+				std::ofstream out(out_path);
+				out << results.dump(4) << std::endl;
+			}
+			return EXIT_SUCCESS;
+		}
+
 		state.assemble_rhs();
 		state.assemble_stiffness_mat();
 
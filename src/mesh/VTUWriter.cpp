@@ -1,9 +1,25 @@
 #include <polyfem/VTUWriter.hpp>
 #include <polyfem/Logger.hpp>
+#include <polyfem/par_for.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef POLYFEM_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef POLYFEM_WITH_TBB
+#include <tbb/parallel_for.h>
+#endif
+
 namespace polyfem
 {
     namespace
     {
+        // uncompressed size of the compressed blocks, the default of vtk
+        static const size_t COMPRESSION_BLOCK_SIZE = 1 << 15;
+
         // https://vtk.org/doc/nightly/html/vtkCellType_8h_source.html#l00069
         static const int VTK_LINE = 3;
         static const int VTK_TETRA = 10;
@@ -53,6 +69,92 @@ namespace polyfem
         : binary_(binary)
     {
     }
+
+    void VTUWriter::set_appended(const bool appended, const bool compress)
+    {
+        appended_ = appended;
+#ifdef POLYFEM_WITH_ZLIB
+        compress_ = appended && compress;
+#else
+        if (appended && compress)
+            logger().warn("Polyfem is built without zlib, the vtu output is not compressed");
+        compress_ = false;
+#endif
+    }
+
+    void VTUWriter::write_binary_array(const std::string &attributes, const char *data, const size_t size, std::ostream &os)
+    {
+        if (appended_)
+        {
+            os << "<DataArray " << attributes << " format=\"appended\" offset=\"" << appended_data_.size() << "\"/>\n";
+            append_block(data, size);
+            return;
+        }
+
+        os << "<DataArray " << attributes << " format=\"binary\">\n";
+        base64Layer base64(os);
+        base64.write(uint64_t(size));
+        base64.write(data, size);
+        base64.close();
+        os << "\n";
+        os << "</DataArray>\n";
+    }
+
+    void VTUWriter::append_block(const char *data, const size_t size)
+    {
+#ifdef POLYFEM_WITH_ZLIB
+        if (compress_)
+        {
+            // header: number of blocks, block size, size of the last partial block (0 if full), compressed size of every block
+            const size_t n_blocks = (size + COMPRESSION_BLOCK_SIZE - 1) / COMPRESSION_BLOCK_SIZE;
+            std::vector<uint64_t> header(3 + n_blocks);
+            header[0] = n_blocks;
+            header[1] = COMPRESSION_BLOCK_SIZE;
+            header[2] = size % COMPRESSION_BLOCK_SIZE;
+
+            std::vector<std::string> blocks(n_blocks);
+            std::vector<int> status(n_blocks, Z_OK);
+            const auto compress_blocks = [&](const int start, const int end) {
+                for (int b = start; b < end; ++b)
+                {
+                    const size_t offset = b * COMPRESSION_BLOCK_SIZE;
+                    const uLong block_size = std::min(COMPRESSION_BLOCK_SIZE, size - offset);
+                    uLongf compressed_size = compressBound(block_size);
+                    blocks[b].resize(compressed_size);
+                    // fastest level, the output is written every time step
+                    status[b] = compress2(reinterpret_cast<Bytef *>(&blocks[b][0]), &compressed_size, reinterpret_cast<const Bytef *>(data + offset), block_size, Z_BEST_SPEED);
+                    blocks[b].resize(compressed_size);
+                    header[3 + b] = compressed_size;
+                }
+            };
+
+#ifdef POLYFEM_WITH_CPP_THREADS
+            polyfem::par_for(n_blocks, [&](int start, int end, int t) { compress_blocks(start, end); });
+#elif defined(POLYFEM_WITH_TBB)
+            tbb::parallel_for(tbb::blocked_range<int>(0, n_blocks), [&](const tbb::blocked_range<int> &r) { compress_blocks(r.begin(), r.end()); });
+#else
+            compress_blocks(0, n_blocks);
+#endif
+
+            for (const int st : status)
+            {
+                // compressBound leaves enough room, only a memory error is expected
+                if (st != Z_OK)
+                    throw std::runtime_error("zlib compression of the vtu data failed with error " + std::to_string(st));
+            }
+
+            appended_data_.append(reinterpret_cast<const char *>(header.data()), header.size() * sizeof(uint64_t));
+            for (const auto &block : blocks)
+                appended_data_.append(block);
+            return;
+        }
+#endif
+
+        const uint64_t header = size;
+        appended_data_.append(reinterpret_cast<const char *>(&header), sizeof(uint64_t));
+        appended_data_.append(data, size);
+    }
+
     void VTUWriter::write_point_data(std::ostream &os)
     {
         if (current_scalar_point_data_.empty() && current_vector_point_data_.empty())
@@ -67,7 +169,13 @@ namespace polyfem
 
         for (auto it = point_data_.begin(); it != point_data_.end(); ++it)
         {
-            it->write(os);
+            if (binary_ && appended_)
+            {
+                const std::string attributes = "type=\"" + it->numeric_type() + "\" Name=\"" + it->name() + "\" NumberOfComponents=\"" + std::to_string(it->n_components()) + "\"";
+                write_binary_array(attributes, reinterpret_cast<const char *>(it->data()), it->size() * sizeof(double), os);
+            }
+            else
+                it->write(os);
         }
 
         os << "</PointData>\n";
@@ -75,7 +183,10 @@ namespace polyfem
 
     void VTUWriter::write_header(const int n_vertices, const int n_elements, std::ostream &os)
     {
-        os << "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" header_type=\"UInt64\">\n";
+        os << "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" header_type=\"UInt64\"";
+        if (binary_ && compress_)
+            os << " compressor=\"vtkZLibDataCompressor\"";
+        os << ">\n";
         os << "<UnstructuredGrid>\n";
         os << "<Piece NumberOfPoints=\"" << n_vertices << "\" NumberOfCells=\"" << n_elements << "\">\n";
     }
@@ -84,6 +195,12 @@ namespace polyfem
     {
         os << "</Piece>\n";
         os << "</UnstructuredGrid>\n";
+        if (binary_ && appended_)
+        {
+            os << "<AppendedData encoding=\"raw\">\n_";
+            os.write(appended_data_.data(), appended_data_.size());
+            os << "\n</AppendedData>\n";
+        }
         os << "</VTKFile>\n";
     }
 
@@ -100,15 +217,7 @@ namespace polyfem
                 tmp.row(2).setZero();
             }
 
-            base64Layer base64(os);
-
-            os << "<DataArray type=\"Float64\" NumberOfComponents=\"3\" format=\"binary\">\n";
-            const uint64_t size = tmp.size() * sizeof(double);
-            base64.write(size);
-
-            base64.write(tmp.data(), tmp.size());
-            base64.close();
-            os << "\n";
+            write_binary_array("type=\"Float64\" NumberOfComponents=\"3\"", reinterpret_cast<const char *>(tmp.data()), tmp.size() * sizeof(double), os);
         }
         else
         {
@@ -131,9 +240,10 @@ namespace polyfem
 
                 os << "\n";
             }
+
+            os << "</DataArray>\n";
         }
 
-        os << "</DataArray>\n";
         os << "</Points>\n";
     }
 
@@ -142,19 +252,12 @@ namespace polyfem
         const int n_cells = cells.rows();
         const int n_cell_vertices = cells.cols();
         os << "<Cells>\n";
-        base64Layer base64(os);
 
         ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
         if (binary_)
         {
-            os << "<DataArray type=\"Int64\" Name=\"connectivity\" format=\"binary\" >\n";
-            const uint64_t size = cells.size() * sizeof(int64_t);
-            base64.write(size);
-
             Eigen::Matrix<int64_t, Eigen::Dynamic, Eigen::Dynamic> tmp = cells.transpose().template cast<int64_t>();
-            base64.write(tmp.data(), tmp.size());
-            base64.close();
-            os << "\n";
+            write_binary_array("type=\"Int64\" Name=\"connectivity\"", reinterpret_cast<const char *>(tmp.data()), tmp.size() * sizeof(int64_t), os);
         }
         else
         {
@@ -175,9 +278,9 @@ namespace polyfem
             }
 
             os << "\n";
+            os << "</DataArray>\n";
         }
 
-        os << "</DataArray>\n";
         /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
         int min_tag, max_tag;
         if (!is_volume_)
@@ -193,54 +296,45 @@ namespace polyfem
 
         if (binary_)
         {
-            os << "<DataArray type=\"Int8\" Name=\"types\" format=\"binary\" RangeMin=\"" << min_tag << "\" RangeMax=\"" << max_tag << "\">\n";
-            const uint64_t size = n_cells * sizeof(int8_t);
-            base64.write(size);
+            const std::vector<int8_t> tags(n_cells, min_tag);
+            write_binary_array("type=\"Int8\" Name=\"types\" RangeMin=\"" + std::to_string(min_tag) + "\" RangeMax=\"" + std::to_string(max_tag) + "\"",
+                               reinterpret_cast<const char *>(tags.data()), tags.size() * sizeof(int8_t), os);
         }
         else
+        {
             os << "<DataArray type=\"Int8\" Name=\"types\" format=\"ascii\" RangeMin=\"" << min_tag << "\" RangeMax=\"" << max_tag << "\">\n";
 
-        for (int i = 0; i < n_cells; ++i)
-        {
-            const int8_t tag = min_tag;
-            if (binary_)
-                base64.write(tag);
-            else
+            for (int i = 0; i < n_cells; ++i)
+            {
+                const int8_t tag = min_tag;
                 os << tag << "\n";
+            }
+            os << "</DataArray>\n";
         }
-        if (binary_)
-        {
-            base64.close();
-            os << "\n";
-        }
-        os << "</DataArray>\n";
 
         ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
         if (binary_)
         {
-            os << "<DataArray type=\"Int64\" Name=\"offsets\" format=\"binary\" RangeMin=\"" << n_cell_vertices << "\" RangeMax=\"" << n_cells * n_cell_vertices << "\">\n";
-            const uint64_t size = n_cells * sizeof(int64_t);
-            base64.write(size);
+            std::vector<int64_t> offsets(n_cells);
+            for (int i = 0; i < n_cells; ++i)
+                offsets[i] = int64_t(i + 1) * n_cell_vertices;
+
+            write_binary_array("type=\"Int64\" Name=\"offsets\" RangeMin=\"" + std::to_string(n_cell_vertices) + "\" RangeMax=\"" + std::to_string(n_cells * n_cell_vertices) + "\"",
+                               reinterpret_cast<const char *>(offsets.data()), offsets.size() * sizeof(int64_t), os);
         }
         else
+        {
             os << "<DataArray type=\"Int64\" Name=\"offsets\" format=\"ascii\" RangeMin=\"" << n_cell_vertices << "\" RangeMax=\"" << n_cells * n_cell_vertices << "\">\n";
 
-        int64_t acc = n_cell_vertices;
-        for (int i = 0; i < n_cells; ++i)
-        {
-            if (binary_)
-                base64.write(acc);
-            else
+            int64_t acc = n_cell_vertices;
+            for (int i = 0; i < n_cells; ++i)
+            {
                 os << acc << "\n";
-            acc += n_cell_vertices;
-        }
-        if (binary_)
-        {
-            base64.close();
-            os << "\n";
-        }
+                acc += n_cell_vertices;
+            }
 
-        os << "</DataArray>\n";
+            os << "</DataArray>\n";
+        }
         //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
         os << "</Cells>\n";
     }
@@ -249,6 +343,7 @@ namespace polyfem
     {
         point_data_.clear();
         cell_data_.clear();
+        appended_data_.clear();
     }
 
     void VTUWriter::add_field(const std::string &name, const Eigen::MatrixXd &data)
@@ -296,7 +391,7 @@ namespace polyfem
     bool VTUWriter::write_mesh(const std::string &path, const Eigen::MatrixXd &points, const Eigen::MatrixXi &cells)
     {
         std::ofstream os;
-        os.open(path.c_str());
+        os.open(path.c_str(), std::ios::binary);
         if (!os.good())
         {
             os.close();
@@ -65,6 +65,12 @@ namespace polyfem
 
             inline bool empty() const { return data_.size() <= 0; }
 
+            inline const std::string &name() const { return name_; }
+            inline const std::string &numeric_type() const { return numeric_type_; }
+            inline int n_components() const { return n_components_; }
+            inline const T *data() const { return data_.data(); }
+            inline size_t size() const { return data_.size(); }
+
         private:
             std::string name_;
             bool binary_;
@@ -80,6 +86,11 @@ namespace polyfem
     public:
         VTUWriter(bool binary = true);
 
+        // binary arrays are stored raw in the AppendedData section instead of base64 inside their DataArray,
+        // with compress they are split in blocks compressed with zlib (vtkZLibDataCompressor), compress is
+        // ignored without POLYFEM_WITH_ZLIB
+        void set_appended(const bool appended, const bool compress = false);
+
         bool write_mesh(const std::string &path, const Eigen::MatrixXd &points, const Eigen::MatrixXi &cells);
 
         void add_field(const std::string &name, const Eigen::MatrixXd &data);
@@ -91,6 +102,11 @@ namespace polyfem
     private:
         bool is_volume_;
         bool binary_;
+        bool appended_ = false;
+        bool compress_ = false;
+
+        // content of the AppendedData section, the DataArrays store their offset in it
+        std::string appended_data_;
 
         std::vector<VTKDataNode<double>> point_data_;
         std::vector<VTKDataNode<double>> cell_data_;
@@ -102,6 +118,9 @@ namespace polyfem
         void write_footer(std::ostream &os);
         void write_points(const Eigen::MatrixXd &points, std::ostream &os);
         void write_cells(const Eigen::MatrixXi &cells, std::ostream &os);
+        // binary DataArray with the given attributes (type, name, ...), inline or appended
+        void write_binary_array(const std::string &attributes, const char *data, const size_t size, std::ostream &os);
+        void append_block(const char *data, const size_t size);
     };
 } // namespace polyfem
 
@@ -8,6 +8,14 @@
 #include <geogram/mesh/mesh_AABB.h>
 #include <geogram/voronoi/CVT.h>
 #include <geogram/basic/logger.h>
+#include <polyfem/par_for.hpp>
+
+#include <numeric>
+
+#ifdef POLYFEM_WITH_TBB
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+#endif
 ////////////////////////////////////////////////////////////////////////////////
 
 GEO::vec3 polyfem::mesh_vertex(const GEO::Mesh &M, GEO::index_t v)
@@ -965,3 +973,132 @@ void polyfem::save_edges(const std::string &filename, const Eigen::MatrixXd &V,
 		<< V.cast<float>().format(IOFormat(FullPrecision, DontAlignCols, " ", "\n", "v ", "", "", "\n"))
 		<< (E.array() + 1).format(IOFormat(FullPrecision, DontAlignCols, " ", "\n", "l ", "", "", "\n"));
 }
+
+////////////////////////////////////////////////////////////////////////////////
+
+void polyfem::boundary_faces_and_edges(const int min_component, Eigen::MatrixXi &F, Eigen::MatrixXi &E, Eigen::MatrixXi &FE)
+{
+	struct FaceEdge
+	{
+		int64_t key;
+		int face;
+		int local;
+
+		bool operator<(const FaceEdge &other) const { return key < other.key || (key == other.key && face < other.face); }
+	};
+
+	const int n_faces = F.rows();
+	std::vector<FaceEdge> face_edges(3 * n_faces);
+	const auto fill = [&](const int f) {
+		for (int j = 0; j < 3; ++j)
+		{
+			const int64_t a = F(f, j), b = F(f, (j + 1) % 3);
+			face_edges[3 * f + j] = {(std::min(a, b) << 32) | std::max(a, b), f, j};
+		}
+	};
+
+#ifdef POLYFEM_WITH_CPP_THREADS
+	polyfem::par_for(n_faces, [&](int start, int end, int t) {
+		for (int f = start; f < end; ++f)
+			fill(f);
+	});
+#elif defined(POLYFEM_WITH_TBB)
+	tbb::parallel_for(tbb::blocked_range<int>(0, n_faces), [&](const tbb::blocked_range<int> &r) {
+		for (int f = r.begin(); f != r.end(); ++f)
+			fill(f);
+	});
+#else
+	for (int f = 0; f < n_faces; ++f)
+		fill(f);
+#endif
+
+#ifdef POLYFEM_WITH_TBB
+	tbb::parallel_sort(face_edges.begin(), face_edges.end());
+#else
+	std::sort(face_edges.begin(), face_edges.end());
+#endif
+
+	if (min_component > 0)
+	{
+		//union-find of the faces sharing an edge
+		std::vector<int> parent(n_faces);
+		std::iota(parent.begin(), parent.end(), 0);
+		const auto find = [&](int f) {
+			while (parent[f] != f)
+			{
+				parent[f] = parent[parent[f]];
+				f = parent[f];
+			}
+			return f;
+		};
+
+		for (size_t i = 1; i < face_edges.size(); ++i)
+		{
+			if (face_edges[i].key != face_edges[i - 1].key)
+				continue;
+			const int r0 = find(face_edges[i - 1].face), r1 = find(face_edges[i].face);
+			if (r0 != r1)
+				parent[std::max(r0, r1)] = std::min(r0, r1);
+		}
+
+		std::vector<int> counts(n_faces, 0);
+		for (int f = 0; f < n_faces; ++f)
+			++counts[find(f)];
+
+		std::vector<int> new_index(n_faces, -1);
+		int n_kept = 0;
+		for (int f = 0; f < n_faces; ++f)
+		{
+			if (counts[find(f)] >= min_component)
+				new_index[f] = n_kept++;
+		}
+
+		if (n_kept < n_faces)
+		{
+			Eigen::MatrixXi kept(n_kept, 3);
+			for (int f = 0; f < n_faces; ++f)
+			{
+				if (new_index[f] >= 0)
+					kept.row(new_index[f]) = F.row(f);
+			}
+			F = kept;
+
+			//remapping keeps the sorting, since it is monotonic
+			size_t n_face_edges = 0;
+			for (const auto &fe : face_edges)
+			{
+				if (new_index[fe.face] >= 0)
+					face_edges[n_face_edges++] = {fe.key, new_index[fe.face], fe.local};
+			}
+			face_edges.resize(n_face_edges);
+		}
+	}
+
+	if (F.rows() == 0)
+	{
+		E.resize(0, 2);
+		FE.resize(0, 3);
+		return;
+	}
+
+	int n_edges = 0;
+	for (size_t i = 0; i < face_edges.size(); ++i)
+	{
+		if (i == 0 || face_edges[i].key != face_edges[i - 1].key)
+			++n_edges;
+	}
+
+	E.resize(n_edges, 2);
+	FE.resize(F.rows(), 3);
+	int edge = -1;
+	for (size_t i = 0; i < face_edges.size(); ++i)
+	{
+		const FaceEdge &fe = face_edges[i];
+		if (i == 0 || fe.key != face_edges[i - 1].key)
+		{
+			++edge;
+			E.row(edge) << int(fe.key >> 32), int(fe.key & 0xffffffff);
+		}
+		FE(fe.face, fe.local) = edge;
+	}
+}
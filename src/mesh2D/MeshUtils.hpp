@@ -188,4 +188,16 @@ namespace polyfem
 	///
 	void save_edges(const std::string &filename, const Eigen::MatrixXd &V, const Eigen::MatrixXi &E);
 
+	///
+	/// @brief         Removes the triangles in connected components (through edges) with less than
+	///                min_component triangles, then builds the unique edges and the faces to edges map
+	///                of the remaining ones, both from a single sort of the triangle edges
+	///
+	/// @param[in]     min_component  { Minimum number of triangles of a kept component, <= 0 keeps all }
+	/// @param[in,out] F              { #F x 3 triangles, the kept ones in the input order }
+	/// @param[out]    E              { #E x 2 unique edges, sorted by vertex indices }
+	/// @param[out]    FE             { #F x 3 index in E of the edge F(f, j), F(f, (j + 1) % 3) }
+	///
+	void boundary_faces_and_edges(const int min_component, Eigen::MatrixXi &F, Eigen::MatrixXi &E, Eigen::MatrixXi &FE);
+
 } // namespace polyfem
@@ -9,10 +9,10 @@
 #include <ipc/barrier/barrier.hpp>
 #include <ipc/barrier/adaptive_stiffness.hpp>
 
-#include <igl/write_triangle_mesh.h>
-
 #include <unsupported/Eigen/SparseExtra>
 
+#include <algorithm>
+
 // #define USE_DIV_BARRIER_STIFFNESS
 
 namespace polyfem
@@ -22,23 +22,16 @@ namespace polyfem
 	ALNLProblem::ALNLProblem(State &state, const RhsAssembler &rhs_assembler, const double t, const double dhat, const bool project_to_psd, const double weight)
 		: super(state, rhs_assembler, t, dhat, project_to_psd, true), weight_(weight)
 	{
-		std::vector<Eigen::Triplet<double>> entries;
-
 		// stop_dist_ = 1e-2 * state.min_edge_length;
 
-		for (const auto bn : state.boundary_nodes)
-			entries.emplace_back(bn, bn, 2 * weight_);
-
-		hessian_.resize(state.n_bases * state.mesh->dimension(), state.n_bases * state.mesh->dimension());
-		hessian_.setFromTriplets(entries.begin(), entries.end());
-		hessian_.makeCompressed();
+		const int full_size = state.n_bases * state.mesh->dimension();
 
-		displaced_.resize(hessian_.rows(), 1);
+		displaced_.resize(full_size, 1);
 		displaced_.setZero();
 
-		rhs_assembler.set_bc(state.local_boundary, state.boundary_nodes, state.args["n_boundary_samples"], state.local_neumann_boundary, displaced_, t);
+		rhs_assembler.set_bc(state.local_boundary, state.boundary_nodes, state.settings().n_boundary_samples, state.local_neumann_boundary, displaced_, t);
 
-		std::vector<bool> mask(hessian_.rows(), true);
+		std::vector<bool> mask(full_size, true);
 
 		for (const auto bn : state.boundary_nodes)
 			mask[bn] = false;
@@ -53,16 +46,26 @@ namespace polyfem
 		super::update_quantities(t, x);
 		if (is_time_dependent)
 		{
-			displaced_.resize(hessian_.rows(), 1);
 			displaced_.setZero();
 
-			rhs_assembler.set_bc(state.local_boundary, state.boundary_nodes, state.args["n_boundary_samples"], state.local_neumann_boundary, displaced_, t);
+			rhs_assembler.set_bc(state.local_boundary, state.boundary_nodes, state.settings().n_boundary_samples, state.local_neumann_boundary, displaced_, t);
+		}
+	}
+
+	void ALNLProblem::substepping(const double t)
+	{
+		super::substepping(t);
+		if (is_time_dependent)
+		{
+			displaced_.setZero();
+			rhs_assembler.set_bc(state.local_boundary, state.boundary_nodes, state.settings().n_boundary_samples, state.local_neumann_boundary, displaced_, t);
 		}
 	}
 
 	void ALNLProblem::compute_distance(const TVector &x, TVector &res)
 	{
-		res = x - displaced_;
+		res.resize(x.size());
+		res.noalias() = x - displaced_;
 
 		for (const auto bn : not_boundary_)
 			res[bn] = 0;
@@ -71,21 +74,11 @@ namespace polyfem
 	double ALNLProblem::value(const TVector &x, const bool only_elastic)
 	{
 		const double val = super::value(x, only_elastic);
-		TVector distv;
-		compute_distance(x, distv);
-		const double dist = distv.squaredNorm();
+		compute_distance(x, dist_);
+		const double dist = dist_.squaredNorm();
 
 		logger().trace("dist {}", sqrt(dist));
 
-		Eigen::MatrixXd ddd;
-		compute_displaced_points(x, ddd);
-		if (ddd.cols() == 2)
-		{
-			ddd.conservativeResize(ddd.rows(), 3);
-			ddd.col(2).setZero();
-		}
-		igl::write_triangle_mesh("step.obj", ddd, state.boundary_triangles);
-
 #ifdef USE_DIV_BARRIER_STIFFNESS
 		return val + weight_ * dist / _barrier_stiffness;
 #else
@@ -93,19 +86,40 @@ namespace polyfem
 #endif
 	}
 
+	bool ALNLProblem::line_energy_polynomial(const TVector &x, const TVector &dir, Eigen::VectorXd &coeffs)
+	{
+		if (!super::line_energy_polynomial(x, dir, coeffs))
+			return false;
+
+		// the penalty is quadratic: weight * |x_b + alpha dir_b - displaced_b|^2
+		compute_distance(x, dist_);
+#ifdef USE_DIV_BARRIER_STIFFNESS
+		const double w = weight_ / _barrier_stiffness;
+#else
+		const double w = weight_;
+#endif
+		for (const auto bn : state.boundary_nodes)
+		{
+			coeffs(0) += w * dist_(bn) * dist_(bn);
+			coeffs(1) += 2 * w * dist_(bn) * dir(bn);
+			coeffs(2) += w * dir(bn) * dir(bn);
+		}
+
+		return true;
+	}
+
 	void ALNLProblem::gradient_no_rhs(const TVector &x, Eigen::MatrixXd &gradv, const bool only_elastic)
 	{
-		TVector tmp;
 		super::gradient_no_rhs(x, gradv, only_elastic);
-		compute_distance(x, tmp);
-		//logger().trace("dist grad {}", tmp.norm());
+		compute_distance(x, dist_);
+		//logger().trace("dist grad {}", dist_.norm());
 #ifdef USE_DIV_BARRIER_STIFFNESS
-		tmp *= 2 * weight_ / _barrier_stiffness;
+		dist_ *= 2 * weight_ / _barrier_stiffness;
 #else
-		tmp *= 2 * weight_;
+		dist_ *= 2 * weight_;
 #endif
 
-		gradv += tmp;
+		gradv += dist_;
 		// gradv = tmp;
 	}
 
@@ -113,13 +127,40 @@ namespace polyfem
 	{
 		super::hessian_full(x, hessian);
 #ifdef USE_DIV_BARRIER_STIFFNESS
-		hessian += hessian_ / _barrier_stiffness;
+		const double penalty = 2 * weight_ / _barrier_stiffness;
 #else
-		hessian += hessian_;
+		const double penalty = 2 * weight_;
 #endif
+		// the penalty is diagonal on the dirichlet dofs, add it in place so that
+		// the hessian keeps the elastic pattern and the solver can reuse its analysis
+		// the elastic blocks have a full diagonal, so no entry is inserted
+#ifndef NDEBUG
+		const auto nnz = hessian.nonZeros();
+#endif
+		for (const auto bn : state.boundary_nodes)
+			hessian.coeffRef(bn, bn) += penalty;
+		assert(hessian.nonZeros() == nnz);
+		// an inserted entry would leave the matrix uncompressed
 		hessian.makeCompressed();
 	}
 
+	void ALNLProblem::local_hessian(const TVector &x, const std::vector<int> &dofs, THessian &hessian)
+	{
+		super::local_hessian(x, dofs, hessian);
+#ifdef USE_DIV_BARRIER_STIFFNESS
+		const double penalty = 2 * weight_ / _barrier_stiffness;
+#else
+		const double penalty = 2 * weight_;
+#endif
+		// the dirichlet dofs are not removed, so the sorted dofs are full indices
+		for (const auto bn : state.boundary_nodes)
+		{
+			const auto it = std::lower_bound(dofs.begin(), dofs.end(), bn);
+			if (it != dofs.end() && *it == bn)
+				hessian.coeffRef(it - dofs.begin(), it - dofs.begin()) += penalty;
+		}
+	}
+
 	bool ALNLProblem::stop(const TVector &x)
 	{
 		// TVector distv;
@@ -19,25 +19,34 @@ namespace polyfem
 
 		ALNLProblem(State &state, const RhsAssembler &rhs_assembler, const double t, const double dhat, const bool project_to_psd, const double weight);
 		TVector initial_guess();
-		void set_weight(const double w) { weight_ = w; }
+		// the penalty hessian only depends on the dirichlet nodes, changing the weight rescales it
+		void set_weight(const double w)
+		{
+			weight_ = w;
+			energy_changed();
+		}
 
 		double value(const TVector &x) override { return super::value(x); }
 		double value(const TVector &x, const bool only_elastic) override;
+		bool line_energy_polynomial(const TVector &x, const TVector &dir, Eigen::VectorXd &coeffs) override;
 		void gradient_no_rhs(const TVector &x, Eigen::MatrixXd &gradv, const bool only_elastic = false) override;
 		void update_quantities(const double t, const TVector &x) override;
+		void substepping(const double t) override;
 
 		bool stop(const TVector &x) override;
 
 #include <polyfem/DisableWarnings.hpp>
 		void hessian_full(const TVector &x, THessian &gradv) override;
+		void local_hessian(const TVector &x, const std::vector<int> &dofs, THessian &hessian) override;
 #include <polyfem/EnableWarnings.hpp>
 
 	private:
 		double weight_;
 		double stop_dist_;
-		THessian hessian_;
 		std::vector<int> not_boundary_;
 		Eigen::MatrixXd displaced_;
+		// distance buffer reused across calls
+		TVector dist_;
 
 		void compute_distance(const TVector &x, TVector &res);
 	};
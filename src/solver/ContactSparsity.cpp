@@ -0,0 +1,177 @@
+#include "ContactSparsity.hpp"
+
+#include <polyfem/Logger.hpp>
+
+#include <igl/Timer.h>
+
+#include <algorithm>
+
+namespace polyfem
+{
+	void ContactSparsity::assemble(const StiffnessMatrix &base, const std::vector<const ContactHessian *> &contact,
+								   const std::function<void(std::vector<Stencil> &)> &get_stencils, StiffnessMatrix &out)
+	{
+		assert(base.rows() == base.cols());
+		assert(base.isCompressed());
+
+		bool fit = pattern_.rows() == base.rows() && same_base(base);
+		for (const auto *m : contact)
+			fit = fit && fits(*m);
+
+		if (!fit)
+		{
+			stencils_.clear();
+			get_stencils(stencils_);
+			grow(base, contact, stencils_);
+		}
+
+		out = pattern_;
+		double *values = out.valuePtr();
+		std::fill(values, values + out.nonZeros(), 0);
+
+		const double *base_values = base.valuePtr();
+		for (size_t k = 0; k < base_map_.size(); ++k)
+			values[base_map_[k]] = base_values[k];
+
+		for (const auto *m : contact)
+		{
+			for (int j = 0; j < m->outerSize(); ++j)
+			{
+				for (ContactHessian::InnerIterator it(*m, j); it; ++it)
+				{
+					const int k = find(it.row(), it.col());
+					assert(k >= 0);
+					values[k] += it.value();
+				}
+			}
+		}
+	}
+
+	bool ContactSparsity::same_base(const StiffnessMatrix &base) const
+	{
+		if (!base.isCompressed() || base_map_.size() != size_t(base.nonZeros()) || base_outer_.size() != size_t(base.outerSize()) + 1)
+			return false;
+
+		return std::equal(base_outer_.begin(), base_outer_.end(), base.outerIndexPtr())
+			   && std::equal(base_inner_.begin(), base_inner_.end(), base.innerIndexPtr());
+	}
+
+	bool ContactSparsity::fits(const ContactHessian &m) const
+	{
+		if (m.rows() != pattern_.rows() || m.cols() != pattern_.cols())
+			return false;
+
+		for (int j = 0; j < m.outerSize(); ++j)
+		{
+			for (ContactHessian::InnerIterator it(m, j); it; ++it)
+			{
+				if (find(it.row(), it.col()) < 0)
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+	int ContactSparsity::find(const int i, const int j) const
+	{
+		const auto *begin = pattern_.innerIndexPtr() + pattern_.outerIndexPtr()[j];
+		const auto *end = pattern_.innerIndexPtr() + pattern_.outerIndexPtr()[j + 1];
+		const auto *it = std::lower_bound(begin, end, i);
+		if (it == end || *it != i)
+			return -1;
+
+		return int(it - pattern_.innerIndexPtr());
+	}
+
+	void ContactSparsity::grow(const StiffnessMatrix &base, const std::vector<const ContactHessian *> &contact, const std::vector<Stencil> &stencils)
+	{
+		igl::Timer timer;
+		timer.start();
+
+		const int size = base.rows();
+		const bool keep_old = pattern_.rows() == size && pattern_.nonZeros() <= max_growth_ * built_nnz_;
+		if (pattern_.rows() == size && !keep_old)
+		{
+			++n_rebuilds_;
+			logger().trace("\tcontact sparsity of {} nonzeros outgrew {} times its initial {}, rebuilding it", pattern_.nonZeros(), max_growth_, built_nnz_);
+		}
+
+		std::vector<Eigen::Triplet<double>> entries;
+		entries.reserve((keep_old ? pattern_.nonZeros() : 0) + base.nonZeros() + stencils.size() * 16 * dim_ * dim_);
+
+		if (keep_old)
+		{
+			for (int j = 0; j < pattern_.outerSize(); ++j)
+			{
+				for (StiffnessMatrix::InnerIterator it(pattern_, j); it; ++it)
+					entries.emplace_back(it.row(), it.col(), 0);
+			}
+		}
+
+		for (int j = 0; j < base.outerSize(); ++j)
+		{
+			for (StiffnessMatrix::InnerIterator it(base, j); it; ++it)
+				entries.emplace_back(it.row(), it.col(), 0);
+		}
+
+		for (const auto *m : contact)
+		{
+			assert(m->rows() == size && m->cols() == size);
+			for (int j = 0; j < m->outerSize(); ++j)
+			{
+				for (ContactHessian::InnerIterator it(*m, j); it; ++it)
+					entries.emplace_back(it.row(), it.col(), 0);
+			}
+		}
+
+		for (const Stencil &stencil : stencils)
+		{
+			for (const int a : stencil)
+			{
+				if (a < 0)
+					continue;
+				for (const int b : stencil)
+				{
+					if (b < 0)
+						continue;
+					for (int di = 0; di < dim_; ++di)
+					{
+						for (int dj = 0; dj < dim_; ++dj)
+							entries.emplace_back(a * dim_ + di, b * dim_ + dj, 0);
+					}
+				}
+			}
+		}
+
+		pattern_.resize(size, size);
+		pattern_.setFromTriplets(entries.begin(), entries.end());
+		pattern_.makeCompressed();
+		if (!keep_old)
+			built_nnz_ = pattern_.nonZeros();
+
+		build_base_map(base);
+		++n_grows_;
+
+		timer.stop();
+		logger().trace("\tcontact sparsity grown to {} nonzeros ({} stencils) in {}s", pattern_.nonZeros(), stencils.size(), timer.getElapsedTimeInSec());
+	}
+
+	void ContactSparsity::build_base_map(const StiffnessMatrix &base)
+	{
+		base_outer_.clear();
+		base_inner_.clear();
+		base_map_.clear();
+		if (!base.isCompressed())
+			return;
+
+		base_outer_.assign(base.outerIndexPtr(), base.outerIndexPtr() + base.outerSize() + 1);
+		base_inner_.assign(base.innerIndexPtr(), base.innerIndexPtr() + base.nonZeros());
+		base_map_.resize(base.nonZeros());
+		for (int j = 0; j < base.outerSize(); ++j)
+		{
+			for (auto p = base.outerIndexPtr()[j]; p < base.outerIndexPtr()[j + 1]; ++p)
+				base_map_[p] = find(base.innerIndexPtr()[p], j);
+		}
+	}
+} // namespace polyfem
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <polyfem/Types.hpp>
+
+#include <Eigen/Sparse>
+
+#include <array>
+#include <functional>
+#include <vector>
+
+namespace polyfem
+{
+	//superset sparsity pattern of a hessian with contact
+	//the pattern is the one of the elastic (and inertia) hessian plus a dim x dim block for every pair of nodes
+	//of the primitive pairs that can come into contact, so the barrier and friction hessians are added to it in place
+	//and the pattern of the total hessian (and the symbolic factorization) changes only when new pairs come into range
+	//the pattern keeps the old pairs when it grows, unless it is more than max_growth times larger than when it was
+	//last built from scratch, then it is rebuilt with the current entries and stencils only, dropping the stale pairs
+	class ContactSparsity
+	{
+	public:
+		//nodes of a primitive pair (edge-vertex, edge-edge or face-vertex), unused entries are -1
+		typedef std::array<int, 4> Stencil;
+		//hessians computed by ipc
+		typedef Eigen::SparseMatrix<double> ContactHessian;
+
+		//out gets the superset pattern with the values of base plus the ones of the contact hessians
+		//if base or some contact entry does not fit, the pattern grows with their entries and with the blocks
+		//of the stencils returned by get_stencils, which is called only in that case
+		//no stencils is fine, the pattern then only covers the entries of the contact hessians seen so far
+		void assemble(const StiffnessMatrix &base, const std::vector<const ContactHessian *> &contact,
+					  const std::function<void(std::vector<Stencil> &)> &get_stencils, StiffnessMatrix &out);
+
+		inline void set_dim(const int dim) { dim_ = dim; }
+		inline void set_max_growth(const double max_growth) { max_growth_ = max_growth; }
+		inline int n_grows() const { return n_grows_; }
+		inline int n_rebuilds() const { return n_rebuilds_; }
+		inline void clear()
+		{
+			pattern_.resize(0, 0);
+			built_nnz_ = 0;
+			base_outer_.clear();
+			base_inner_.clear();
+			base_map_.clear();
+		}
+
+	private:
+		bool same_base(const StiffnessMatrix &base) const;
+		bool fits(const ContactHessian &m) const;
+		void grow(const StiffnessMatrix &base, const std::vector<const ContactHessian *> &contact, const std::vector<Stencil> &stencils);
+		void build_base_map(const StiffnessMatrix &base);
+		//position of the entry (i, j) in the values of the pattern, -1 if missing
+		int find(const int i, const int j) const;
+
+		int dim_ = 1;
+		int n_grows_ = 0;
+		int n_rebuilds_ = 0;
+		double max_growth_ = 2;
+		//nonzeros of the pattern when it was last built from scratch
+		long built_nnz_ = 0;
+
+		//compressed, column major, the values are not used
+		StiffnessMatrix pattern_;
+
+		//pattern of the last base and position of its entries in the values of pattern_
+		std::vector<StiffnessMatrix::StorageIndex> base_outer_, base_inner_;
+		std::vector<int> base_map_;
+
+		std::vector<Stencil> stencils_;
+	};
+} // namespace polyfem
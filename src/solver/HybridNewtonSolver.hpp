@@ -0,0 +1,284 @@
+#pragma once
+
+#include <polyfem/SparseNewtonDescentSolver.hpp>
+
+#include <polyfem/Logger.hpp>
+
+#include <igl/Timer.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace cppoptlib
+{
+	//quasi-Newton solver that keeps the last Hessian factorization and uses it
+	//as the initial inverse Hessian of L-BFGS updates
+	//the Hessian is refactorized only when the factorization goes stale, that is when
+	//the gradient norm stops decreasing fast enough, after hybrid_max_reuse iterations,
+	//or when the quasi-Newton direction is not a descent direction / the line search fails
+	template <typename ProblemType>
+	class HybridNewtonSolver : public SparseNewtonDescentSolver<ProblemType>
+	{
+	public:
+		using Superclass = SparseNewtonDescentSolver<ProblemType>;
+
+		using typename Superclass::Scalar;
+		using typename Superclass::TVector;
+
+		HybridNewtonSolver(const json &solver_param, const std::string &solver_type, const std::string &precond_type)
+			: Superclass(solver_param, solver_type, precond_type)
+		{
+			history_size_ = std::max(1, solver_param.count("hybrid_history") ? int(solver_param["hybrid_history"]) : 6);
+			max_reuse_ = solver_param.count("hybrid_max_reuse") ? int(solver_param["hybrid_max_reuse"]) : 10;
+			stale_rate_ = solver_param.count("hybrid_stale_rate") ? double(solver_param["hybrid_stale_rate"]) : 0.5;
+		}
+
+		void minimize(ProblemType &objFunc, TVector &x0) override
+		{
+			igl::Timer time;
+			using namespace polyfem;
+
+			polysolve::LinearSolver &solver = this->linear_solver();
+			this->internal_solver = json::array();
+
+			const int reduced_size = x0.rows();
+
+			TVector grad = TVector::Zero(reduced_size);
+			TVector grad_old(reduced_size);
+			TVector delta_x(reduced_size), q(reduced_size), s(reduced_size), y(reduced_size);
+
+			//circular buffer of the last (s, y) pairs, cleared at every factorization
+			Eigen::MatrixXd s_history(reduced_size, history_size_);
+			Eigen::MatrixXd y_history(reduced_size, history_size_);
+			Eigen::VectorXd rho(history_size_), alpha(history_size_);
+			int n_pairs = 0, first_pair = 0;
+
+			this->reset_times();
+
+			polyfem::StiffnessMatrix hessian;
+			this->m_current.reset();
+
+			double old_energy = std::nan("");
+			this->error_code_ = 0;
+			n_factorizations_ = 0;
+
+			time.start();
+			objFunc.solution_changed(x0);
+			time.stop();
+			this->constrain_set_update_time += time.getElapsedTimeInSec();
+
+			time.start();
+			objFunc.gradient(x0, grad);
+			this->m_current.gradNorm = grad.norm();
+			time.stop();
+			polyfem::logger().debug("\tgrad time {}s norm: {}", time.getElapsedTimeInSec(), this->m_current.gradNorm);
+			this->grad_time += time.getElapsedTimeInSec();
+
+			if (std::isnan(this->m_current.gradNorm))
+			{
+				this->m_status = Status::UserDefined;
+				polyfem::logger().debug("stopping because first grad is nan");
+				this->error_code_ = -10;
+				return;
+			}
+
+			bool refactorize = true;
+			bool gradient_descent = false;
+			int n_reuse = 0;
+			double prev_grad_norm = grad.norm();
+
+			do
+			{
+				if (refactorize)
+				{
+					time.start();
+					objFunc.hessian(x0, hessian);
+					time.stop();
+					polyfem::logger().debug("\tassembly time {}s", time.getElapsedTimeInSec());
+					this->assembly_time += time.getElapsedTimeInSec();
+
+					time.start();
+					this->factorize_hessian(hessian);
+					time.stop();
+					this->inverting_time += time.getElapsedTimeInSec();
+
+					json tmp;
+					solver.getInfo(tmp);
+					this->internal_solver.push_back(tmp);
+
+					++n_factorizations_;
+					n_pairs = 0;
+					first_pair = 0;
+					n_reuse = 0;
+					refactorize = false;
+				}
+				const bool fresh = n_reuse == 0;
+
+				time.start();
+				if (gradient_descent)
+				{
+					delta_x = -grad;
+				}
+				else
+				{
+					//L-BFGS two-loop recursion with H_0^-1 applied by the factorization
+					q = grad;
+					for (int i = n_pairs - 1; i >= 0; --i)
+					{
+						const int k = (first_pair + i) % history_size_;
+						alpha(i) = rho(k) * s_history.col(k).dot(q);
+						q -= alpha(i) * y_history.col(k);
+					}
+					solver.solve(q, delta_x);
+					for (int i = 0; i < n_pairs; ++i)
+					{
+						const int k = (first_pair + i) % history_size_;
+						const double beta = rho(k) * y_history.col(k).dot(delta_x);
+						delta_x += (alpha(i) - beta) * s_history.col(k);
+					}
+					delta_x *= -1;
+
+					if (!std::isfinite(delta_x.squaredNorm()) || delta_x.dot(grad) >= 0)
+					{
+						if (!fresh)
+						{
+							polyfem::logger().debug("\tnot a descent direction, recomputing the hessian");
+							refactorize = true;
+							this->m_status = Status::Continue;
+							continue;
+						}
+
+						polyfem::logger().debug("\treverting to gradient descent, since the newton direction is not a descent direction");
+						delta_x = -grad;
+					}
+				}
+				time.stop();
+				polyfem::logger().debug("\tinverting time {}s", time.getElapsedTimeInSec());
+				this->inverting_time += time.getElapsedTimeInSec();
+
+				const double rate = this->line_search_step(x0, delta_x, objFunc);
+
+				if (std::isnan(rate))
+				{
+					this->m_status = Status::Continue;
+					if (!fresh)
+					{
+						polyfem::logger().debug("\tline search failed, recomputing the hessian");
+						refactorize = true;
+						continue;
+					}
+					if (!gradient_descent)
+					{
+						polyfem::logger().debug("\tline search failed, reverting to gradient descent");
+						gradient_descent = true;
+						continue;
+					}
+
+					this->m_status = Status::UserDefined;
+					polyfem::logger().error("Line search failed, stopping");
+					this->error_code_ = -10;
+					break;
+				}
+				gradient_descent = false;
+
+				s = rate * delta_x;
+				x0 += s;
+
+				time.start();
+				objFunc.solution_changed(x0);
+				time.stop();
+				this->obj_fun_time += time.getElapsedTimeInSec();
+
+				time.start();
+				grad_old = grad;
+				objFunc.gradient(x0, grad);
+				time.stop();
+				polyfem::logger().debug("\tgrad time {}s norm: {}", time.getElapsedTimeInSec(), grad.norm());
+				this->grad_time += time.getElapsedTimeInSec();
+
+				++this->m_current.iterations;
+				++n_reuse;
+
+				//curvature condition, skip the pair otherwise
+				y = grad - grad_old;
+				const double sy = s.dot(y);
+				if (sy > 1e-10 * s.norm() * y.norm())
+				{
+					int k;
+					if (n_pairs < history_size_)
+						k = (first_pair + n_pairs++) % history_size_;
+					else
+					{
+						k = first_pair;
+						first_pair = (first_pair + 1) % history_size_;
+					}
+					s_history.col(k) = s;
+					y_history.col(k) = y;
+					rho(k) = 1. / sy;
+				}
+
+				//convergence-rate monitor
+				const double grad_ratio = grad.norm() / prev_grad_norm;
+				prev_grad_norm = grad.norm();
+				if (grad_ratio > stale_rate_ || n_reuse >= max_reuse_)
+				{
+					polyfem::logger().debug("\tfactorization is stale (||g|| ratio {}, reused {} times)", grad_ratio, n_reuse);
+					refactorize = true;
+				}
+
+				const double energy = objFunc.value(x0);
+				const double step = s.norm();
+
+				this->m_current.fDelta = 1;
+				this->m_current.gradNorm = grad.norm() < 1e-13 ? grad.norm() : (this->use_gradient_norm_ ? grad.norm() : delta_x.norm());
+				this->m_status = checkConvergence(this->m_stop, this->m_current);
+				old_energy = energy;
+
+				if (std::isnan(energy) || std::isinf(energy))
+				{
+					this->m_status = Status::UserDefined;
+					polyfem::logger().debug("stopping because obj func is nan or inf");
+					this->error_code_ = -10;
+				}
+
+				if (this->m_status == Status::Continue && step < 1e-10)
+				{
+					if (fresh)
+					{
+						this->m_status = Status::UserDefined;
+						polyfem::logger().debug("stopping because ||step||={} is too small", step);
+						this->error_code_ = -1;
+					}
+					else
+					{
+						refactorize = true;
+						polyfem::logger().debug("\tstep small force recompute hessian");
+					}
+				}
+
+				if (objFunc.stop(x0))
+				{
+					this->m_status = Status::UserDefined;
+					this->error_code_ = 0;
+					polyfem::logger().debug("\tObjective decided to stop");
+				}
+
+				objFunc.post_step(x0);
+
+				polyfem::logger().debug("\titer: {}, f = {}, ||g||_2 = {}, rate = {}, ||step|| = {}, lbfgs pairs = {}",
+										this->m_current.iterations, energy, this->m_current.gradNorm, rate, step, n_pairs);
+			} while (objFunc.callback(this->m_current, x0) && (this->m_status == Status::Continue));
+
+			polyfem::logger().info("Hybrid Newton finished niters = {}, factorizations = {}, f = {}, ||g||_2 = {}", this->m_current.iterations, n_factorizations_, old_energy, this->m_current.gradNorm);
+			this->update_solver_info();
+			this->solver_info["factorizations"] = n_factorizations_;
+		}
+
+	private:
+		int history_size_;
+		int max_reuse_;
+		double stale_rate_;
+
+		int n_factorizations_ = 0;
+	};
+} // namespace cppoptlib
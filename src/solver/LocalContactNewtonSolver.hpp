@@ -0,0 +1,319 @@
+#pragma once
+
+#include <polyfem/SparseNewtonDescentSolver.hpp>
+
+#include <polyfem/Logger.hpp>
+
+#include <igl/Timer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace cppoptlib
+{
+	//Newton solver for scenes where the contact touches a small part of the boundary
+	//after a global step, the next steps solve only for the dofs of the elements near the active constraints
+	//(local_contact_rings rings of neighbours around them) with the other dofs held fixed, block Gauss-Seidel style,
+	//so only the local block of the hessian is assembled and factorized
+	//a global step is taken when the local block is too large (local_contact_max_fraction of the dofs), when the
+	//residual is not concentrated in it (local_contact_residual_ratio of the squared gradient norm), when a
+	//local step diverges: not a descent direction, failed line search or increasing gradient norm, and before
+	//declaring convergence on the newton direction
+	template <typename ProblemType>
+	class LocalContactNewtonSolver : public SparseNewtonDescentSolver<ProblemType>
+	{
+	public:
+		using Superclass = SparseNewtonDescentSolver<ProblemType>;
+
+		using typename Superclass::Scalar;
+		using typename Superclass::TVector;
+
+		LocalContactNewtonSolver(const json &solver_param, const std::string &solver_type, const std::string &precond_type)
+			: Superclass(solver_param, solver_type, precond_type)
+		{
+			n_rings_ = solver_param.count("local_contact_rings") ? int(solver_param["local_contact_rings"]) : 1;
+			max_fraction_ = solver_param.count("local_contact_max_fraction") ? double(solver_param["local_contact_max_fraction"]) : 0.3;
+			residual_ratio_ = solver_param.count("local_contact_residual_ratio") ? double(solver_param["local_contact_residual_ratio"]) : 0.9;
+		}
+
+		void minimize(ProblemType &objFunc, TVector &x0) override
+		{
+			igl::Timer time;
+			using namespace polyfem;
+
+			polysolve::LinearSolver &solver = this->linear_solver();
+			this->internal_solver = json::array();
+
+			const int reduced_size = x0.rows();
+
+			TVector grad = TVector::Zero(reduced_size);
+			TVector delta_x(reduced_size);
+
+			this->reset_times();
+
+			polyfem::StiffnessMatrix hessian;
+			this->m_current.reset();
+
+			double old_energy = std::nan("");
+			this->error_code_ = 0;
+			n_global_steps_ = 0;
+			n_local_steps_ = 0;
+
+			time.start();
+			objFunc.solution_changed(x0);
+			time.stop();
+			this->constrain_set_update_time += time.getElapsedTimeInSec();
+
+			time.start();
+			objFunc.gradient(x0, grad);
+			this->m_current.gradNorm = grad.norm();
+			time.stop();
+			polyfem::logger().debug("\tgrad time {}s norm: {}", time.getElapsedTimeInSec(), this->m_current.gradNorm);
+			this->grad_time += time.getElapsedTimeInSec();
+
+			if (std::isnan(this->m_current.gradNorm))
+			{
+				this->m_status = Status::UserDefined;
+				polyfem::logger().debug("stopping because first grad is nan");
+				this->error_code_ = -10;
+				return;
+			}
+
+			bool global_step = true;
+			bool gradient_descent = false;
+
+			do
+			{
+				bool local = false;
+				if (!gradient_descent)
+				{
+					time.start();
+					//a local step only assembles the block of its dofs
+					local = !global_step && select_local_dofs(objFunc, x0, grad);
+					if (local)
+						objFunc.local_hessian(x0, local_dofs_, local_hessian_);
+					else
+						objFunc.hessian(x0, hessian);
+					time.stop();
+					polyfem::logger().debug("\t{} assembly time {}s", local ? "local" : "global", time.getElapsedTimeInSec());
+					this->assembly_time += time.getElapsedTimeInSec();
+				}
+
+				time.start();
+				if (gradient_descent)
+				{
+					delta_x = -grad;
+				}
+				else
+				{
+					if (local)
+					{
+						solve_local(grad, delta_x);
+					}
+					else
+					{
+						this->factorize_hessian(hessian);
+						json tmp;
+						solver.getInfo(tmp);
+						this->internal_solver.push_back(tmp);
+
+						solver.solve(grad, delta_x);
+						delta_x *= -1;
+					}
+
+					if (!std::isfinite(delta_x.squaredNorm()) || delta_x.dot(grad) >= 0)
+					{
+						if (local)
+						{
+							polyfem::logger().debug("\tlocal step is not a descent direction, taking a global step");
+							global_step = true;
+							this->m_status = Status::Continue;
+							continue;
+						}
+
+						polyfem::logger().debug("\treverting to gradient descent, since the newton direction is not a descent direction");
+						delta_x = -grad;
+					}
+				}
+				time.stop();
+				polyfem::logger().debug("\tinverting time {}s", time.getElapsedTimeInSec());
+				this->inverting_time += time.getElapsedTimeInSec();
+
+				const double rate = this->line_search_step(x0, delta_x, objFunc);
+
+				if (std::isnan(rate))
+				{
+					this->m_status = Status::Continue;
+					if (local)
+					{
+						polyfem::logger().debug("\tlocal line search failed, taking a global step");
+						global_step = true;
+						continue;
+					}
+					if (!gradient_descent)
+					{
+						polyfem::logger().debug("\tline search failed, reverting to gradient descent");
+						gradient_descent = true;
+						continue;
+					}
+
+					this->m_status = Status::UserDefined;
+					polyfem::logger().error("Line search failed, stopping");
+					this->error_code_ = -10;
+					break;
+				}
+				gradient_descent = false;
+
+				const double prev_grad_norm = grad.norm();
+				x0 += rate * delta_x;
+
+				time.start();
+				objFunc.solution_changed(x0);
+				time.stop();
+				this->obj_fun_time += time.getElapsedTimeInSec();
+
+				time.start();
+				objFunc.gradient(x0, grad);
+				time.stop();
+				polyfem::logger().debug("\tgrad time {}s norm: {}", time.getElapsedTimeInSec(), grad.norm());
+				this->grad_time += time.getElapsedTimeInSec();
+
+				++this->m_current.iterations;
+				if (local)
+					++n_local_steps_;
+				else
+					++n_global_steps_;
+
+				//the dofs held fixed are out of equilibrium, the local problem diverges from the global one
+				global_step = local && grad.norm() > prev_grad_norm;
+				if (global_step)
+					polyfem::logger().debug("\tgradient norm increased after a local step, taking a global step");
+
+				const double energy = objFunc.value(x0);
+				const double step = (rate * delta_x).norm();
+
+				this->m_current.fDelta = 1;
+				this->m_current.gradNorm = grad.norm() < 1e-13 ? grad.norm() : (this->use_gradient_norm_ ? grad.norm() : delta_x.norm());
+				this->m_status = checkConvergence(this->m_stop, this->m_current);
+				old_energy = energy;
+
+				//delta_x vanishes on the dofs held fixed, so a local step cannot show convergence of the newton direction
+				//it is confirmed by a global step, convergence on the full gradient is fine
+				if (local && this->m_status != Status::Continue && this->m_status != Status::IterationLimit && !this->use_gradient_norm_ && grad.norm() >= 1e-13)
+				{
+					polyfem::logger().debug("\tlocal step converged, taking a global step");
+					this->m_status = Status::Continue;
+					global_step = true;
+				}
+
+				if (std::isnan(energy) || std::isinf(energy))
+				{
+					this->m_status = Status::UserDefined;
+					polyfem::logger().debug("stopping because obj func is nan or inf");
+					this->error_code_ = -10;
+				}
+
+				if (this->m_status == Status::Continue && step < 1e-10)
+				{
+					if (!local)
+					{
+						this->m_status = Status::UserDefined;
+						polyfem::logger().debug("stopping because ||step||={} is too small", step);
+						this->error_code_ = -1;
+					}
+					else
+					{
+						global_step = true;
+						polyfem::logger().debug("\tlocal step small, taking a global step");
+					}
+				}
+
+				if (objFunc.stop(x0))
+				{
+					this->m_status = Status::UserDefined;
+					this->error_code_ = 0;
+					polyfem::logger().debug("\tObjective decided to stop");
+				}
+
+				objFunc.post_step(x0);
+
+				polyfem::logger().debug("\titer: {}, f = {}, ||g||_2 = {}, rate = {}, ||step|| = {}, {} step",
+										this->m_current.iterations, energy, this->m_current.gradNorm, rate, step, local ? "local" : "global");
+			} while (objFunc.callback(this->m_current, x0) && (this->m_status == Status::Continue));
+
+			polyfem::logger().info("Local contact Newton finished niters = {} ({} local), f = {}, ||g||_2 = {}", this->m_current.iterations, n_local_steps_, old_energy, this->m_current.gradNorm);
+			this->update_solver_info();
+			this->solver_info["global_steps"] = n_global_steps_;
+			this->solver_info["local_steps"] = n_local_steps_;
+		}
+
+	private:
+		int n_rings_;
+		double max_fraction_;
+		double residual_ratio_;
+
+		int n_global_steps_ = 0;
+		int n_local_steps_ = 0;
+
+		std::vector<int> local_dofs_;
+		polyfem::StiffnessMatrix local_hessian_;
+		Eigen::VectorXd local_grad_, local_delta_;
+		std::unique_ptr<polysolve::LinearSolver> local_solver_;
+		//pattern of the last analyzed local block
+		std::vector<polyfem::StiffnessMatrix::StorageIndex> local_outer_, local_inner_;
+
+		//true if a local step pays off: there is contact, its region is small and holds most of the residual
+		bool select_local_dofs(ProblemType &objFunc, const TVector &x, const TVector &grad)
+		{
+			objFunc.local_contact_dofs(x, n_rings_, local_dofs_);
+			if (local_dofs_.empty() || local_dofs_.size() > max_fraction_ * x.size())
+				return false;
+
+			double local_residual = 0;
+			for (int i : local_dofs_)
+				local_residual += grad(i) * grad(i);
+
+			polyfem::logger().trace("\tlocal contact block of {} dofs, residual ratio {}", local_dofs_.size(), local_residual / grad.squaredNorm());
+			return local_residual >= residual_ratio_ * grad.squaredNorm();
+		}
+
+		//newton step on the local block in local_hessian_, the other dofs do not move
+		void solve_local(const TVector &grad, TVector &delta_x)
+		{
+			const int n_local = local_dofs_.size();
+			assert(local_hessian_.rows() == n_local && local_hessian_.isCompressed());
+
+			local_grad_.resize(n_local);
+			for (int i = 0; i < n_local; ++i)
+				local_grad_(i) = grad(local_dofs_[i]);
+
+			if (!local_solver_)
+			{
+				local_solver_ = polysolve::LinearSolver::create(this->solver_type, this->precond_type);
+				local_solver_->setParameters(this->solver_param);
+			}
+			//the analysis is kept while the contact region, and so the block pattern, does not change
+			const bool same_pattern = size_t(n_local + 1) == local_outer_.size()
+									  && size_t(local_hessian_.nonZeros()) == local_inner_.size()
+									  && std::equal(local_outer_.begin(), local_outer_.end(), local_hessian_.outerIndexPtr())
+									  && std::equal(local_inner_.begin(), local_inner_.end(), local_hessian_.innerIndexPtr());
+			if (!same_pattern)
+			{
+				local_solver_->analyzePattern(local_hessian_, n_local);
+				local_outer_.assign(local_hessian_.outerIndexPtr(), local_hessian_.outerIndexPtr() + n_local + 1);
+				local_inner_.assign(local_hessian_.innerIndexPtr(), local_hessian_.innerIndexPtr() + local_hessian_.nonZeros());
+			}
+			else
+				polyfem::logger().trace("\tsame local block pattern, skipping analyzePattern");
+			local_solver_->factorize(local_hessian_);
+			local_delta_.setZero(n_local);
+			local_solver_->solve(local_grad_, local_delta_);
+
+			delta_x.setZero(grad.size());
+			for (int i = 0; i < n_local; ++i)
+				delta_x(local_dofs_[i]) = -local_delta_(i);
+		}
+	};
+} // namespace cppoptlib
@@ -49,6 +49,34 @@ namespace polyfem
 			for (int i = 0; i < f.rows(); ++i)
 				os << "f " << f(i, 0) + 1 << " " << f(i, 1) + 1 << " " << f(i, 2) + 1 << "\n";
 		}
+
+		std::string broad_phase_method_name(const ipc::BroadPhaseMethod method)
+		{
+			switch (method)
+			{
+			case ipc::BroadPhaseMethod::BRUTE_FORCE:
+				return "brute_force";
+			case ipc::BroadPhaseMethod::SPATIAL_HASH:
+				return "spatial_hash";
+			default:
+				return "hash_grid";
+			}
+		}
+
+		// adds scale * m(full_dofs[i], full_dofs[j]) at (j, i) for the columns of the block, full_to_local is -1 outside of it
+		template <typename Matrix>
+		void add_block(const Matrix &m, const double scale, const std::vector<int> &full_dofs, const std::vector<int> &full_to_local, std::vector<Eigen::Triplet<double>> &entries)
+		{
+			for (size_t i = 0; i < full_dofs.size(); ++i)
+			{
+				for (typename Matrix::InnerIterator it(m, full_dofs[i]); it; ++it)
+				{
+					const int j = full_to_local[it.row()];
+					if (j >= 0)
+						entries.emplace_back(j, i, scale * it.value());
+				}
+			}
+		}
 	} // namespace
 
 	using namespace polysolve;
@@ -62,43 +90,85 @@ namespace polyfem
 		assert(!assembler.is_mixed(state.formulation()));
 
 		_dhat = dhat;
-		_epsv = state.args["epsv"];
-		_mu = state.args["mu"];
+		const SimulationSettings &settings = state.settings();
+		_epsv = settings.epsv;
+		_mu = settings.mu;
 		_barrier_stiffness = 1;
 		_prev_distance = -1;
 		time_integrator = ImplicitTimeIntegrator::construct_time_integrator(state.args["time_integrator"]);
 		time_integrator->set_parameters(state.args["time_integrator_params"]);
+		time_integrator->set_predictor(state.args["predictor"], state.args["predictor_history"]);
 
-		if (state.args["solver_params"].contains("ccd_method"))
-		{
-			const std::string ccd_method = state.args["solver_params"]["ccd_method"];
-
-			if (ccd_method == "brute_force")
-				_broad_phase_method = ipc::BroadPhaseMethod::BRUTE_FORCE;
-			else if (ccd_method == "spatial_hash")
-				_broad_phase_method = ipc::BroadPhaseMethod::SPATIAL_HASH;
-			else
-				_broad_phase_method = ipc::BroadPhaseMethod::HASH_GRID;
-		}
-
+		if (settings.ccd_method == "brute_force")
+			_broad_phase_method = ipc::BroadPhaseMethod::BRUTE_FORCE;
+		else if (settings.ccd_method == "spatial_hash")
+			_broad_phase_method = ipc::BroadPhaseMethod::SPATIAL_HASH;
 		else
 			_broad_phase_method = ipc::BroadPhaseMethod::HASH_GRID;
 
-		if (state.args["solver_params"].contains("ccd_tolerance"))
-			_ccd_tolerance = state.args["solver_params"]["ccd_tolerance"];
-		else
-			_ccd_tolerance = 1e-6;
-		if (state.args["solver_params"].contains("ccd_max_iterations"))
-			_max_ccd_max_iterations = state.args["solver_params"]["ccd_max_iterations"];
-		else
-			_max_ccd_max_iterations = 1e6;
+		_auto_broad_phase = settings.ccd_method == "auto";
+		_broad_phase_recheck = settings.broad_phase_recheck;
+		if (_auto_broad_phase)
+		{
+			_broad_phase_trials = {ipc::BroadPhaseMethod::HASH_GRID, ipc::BroadPhaseMethod::SPATIAL_HASH};
+			// brute force is quadratic in the boundary size, not worth timing on large meshes
+			if (state.boundary_nodes_pos.rows() <= 1000)
+				_broad_phase_trials.push_back(ipc::BroadPhaseMethod::BRUTE_FORCE);
+			_broad_phase_trial_times.resize(_broad_phase_trials.size());
+			_broad_phase_trial = 0;
+			_broad_phase_method = _broad_phase_trials[0];
+		}
+
+		_ccd_tolerance = settings.ccd_tolerance;
+		_max_ccd_max_iterations = settings.ccd_max_iterations;
 
 		_ccd_max_iterations = _max_ccd_max_iterations;
+		_adaptive_ccd = settings.adaptive_ccd;
+		_loose_ccd_tolerance = settings.loose_ccd_tolerance;
+		_loose_ccd_max_iterations = settings.loose_ccd_max_iterations;
+		_line_search_ccd_tolerance = _ccd_tolerance;
+		_line_search_ccd_max_iterations = _ccd_max_iterations;
+		_broad_phase_slack = settings.broad_phase_slack * _dhat;
+
+		contact_sparsity_.set_dim(state.mesh->dimension());
+		init_reduction_maps();
+	}
+
+	void NLProblem::init_reduction_maps()
+	{
+		reduced_to_full_map_.clear();
+		full_to_reduced_map_.clear();
+
+		if (full_size == reduced_size)
+			return;
+
+		reduced_to_full_map_.reserve(reduced_size);
+		full_to_reduced_map_.resize(full_size);
+
+		size_t k = 0;
+		for (int i = 0; i < full_size; ++i)
+		{
+			if (k < state.boundary_nodes.size() && state.boundary_nodes[k] == i)
+			{
+				++k;
+				full_to_reduced_map_[i] = -1;
+				continue;
+			}
+
+			full_to_reduced_map_[i] = int(reduced_to_full_map_.size());
+			reduced_to_full_map_.push_back(i);
+		}
+		assert(reduced_to_full_map_.size() == size_t(reduced_size));
 	}
 
 	void NLProblem::init(const TVector &full)
 	{
-		if (disable_collision || !state.args["has_collision"])
+		// new solve, the ccd accuracy follows the gradient norm relative to its first gradient
+		_first_grad_norm = -1;
+		_grad_norm_ratio = 1;
+		energy_changed();
+
+		if (disable_collision || !state.settings().has_collision)
 			return;
 
 		assert(full.size() == full_size);
@@ -109,12 +179,20 @@ namespace polyfem
 	void NLProblem::update_barrier_stiffness(const TVector &full)
 	{
 		assert(full.size() == full_size);
+		const double prev_barrier_stiffness = _barrier_stiffness;
+		update_barrier_stiffness_aux(full);
+		if (_barrier_stiffness != prev_barrier_stiffness)
+			energy_changed();
+	}
+
+	void NLProblem::update_barrier_stiffness_aux(const TVector &full)
+	{
 		_barrier_stiffness = 1;
-		if (disable_collision || !state.args["has_collision"])
+		if (disable_collision || !state.settings().has_collision)
 			return;
 
 		Eigen::MatrixXd grad_energy;
-		const auto &gbases = state.iso_parametric() ? state.bases : state.geom_bases;
+		const auto &gbases = state.settings().iso_parametric ? state.bases : state.geom_bases;
 		assembler.assemble_energy_gradient(rhs_assembler.formulation(), state.mesh->is_volume(), state.n_bases, state.bases, gbases, state.ass_vals_cache, full, grad_energy);
 
 		if (is_time_dependent)
@@ -125,13 +203,10 @@ namespace polyfem
 
 		grad_energy -= current_rhs();
 
-		Eigen::MatrixXd displaced;
+		Eigen::MatrixXd &displaced = workspace.displaced;
 		compute_displaced_points(full, displaced);
 
-		ipc::construct_constraint_set(
-			state.boundary_nodes_pos, displaced, state.boundary_edges,
-			state.boundary_triangles, _dhat, _constraint_set, state.boundary_faces_to_edges,
-			/*dmin=*/0, _broad_phase_method, _ignore_codimensional_vertices);
+		update_constraint_set(displaced);
 		Eigen::VectorXd grad_barrier = ipc::compute_barrier_potential_gradient(
 			displaced, state.boundary_edges, state.boundary_triangles, _constraint_set, _dhat);
 
@@ -148,28 +223,64 @@ namespace polyfem
 	void NLProblem::init_time_integrator(const TVector &x_prev, const TVector &v_prev, const TVector &a_prev, const double dt)
 	{
 		time_integrator->init(x_prev, v_prev, a_prev, dt);
+		energy_changed();
+	}
+
+	void NLProblem::predict(TVector &x)
+	{
+		if (!is_time_dependent || time_integrator->predictor() == "previous")
+			return;
+
+		TVector predicted;
+		time_integrator->predict(workspace.tmp);
+		full_to_reduced(workspace.tmp, predicted);
+
+		if (!disable_collision && state.settings().has_collision)
+		{
+			// the motion checked is the one applied to the guess, from x with the new dirichlet values
+			line_search_begin(x, predicted);
+			const double alpha = max_step_size(x, predicted);
+			line_search_end();
+
+			// move only part of the way towards the first contact, the step is validated again before the solve
+			if (alpha < 1)
+			{
+				logger().debug("Predictor clamped by CCD, step {}", alpha);
+				predicted = x + 0.5 * alpha * (predicted - x);
+			}
+		}
+
+		x = predicted;
 	}
 
 	void NLProblem::update_lagging(const TVector &x, bool start_of_timestep)
 	{
-		Eigen::MatrixXd displaced;
+		Eigen::MatrixXd &displaced = workspace.displaced;
 		reduced_to_full_displaced_points(x, displaced);
 
 		if (_mu != 0)
 		{
-			ipc::construct_constraint_set(
-				state.boundary_nodes_pos, displaced, state.boundary_edges,
-				state.boundary_triangles, _dhat, _constraint_set, state.boundary_faces_to_edges,
-				/*dmin=*/0, _broad_phase_method, _ignore_codimensional_vertices);
-			ipc::construct_friction_constraint_set(
-				displaced, state.boundary_edges, state.boundary_triangles,
-				_constraint_set, _dhat, _barrier_stiffness, _mu,
-				_friction_constraint_set);
+			update_constraint_set(displaced);
+			if (same_positions(_friction_set_positions, displaced) && _friction_set_barrier_stiffness == _barrier_stiffness)
+			{
+				++total_stats_.friction_set_reuses;
+			}
+			else
+			{
+				ipc::construct_friction_constraint_set(
+					displaced, state.boundary_edges, state.boundary_triangles,
+					_constraint_set, _dhat, _barrier_stiffness, _mu,
+					_friction_constraint_set);
+				_friction_set_positions = displaced;
+				_friction_set_barrier_stiffness = _barrier_stiffness;
+				energy_changed();
+			}
 		}
 
 		if (start_of_timestep)
 		{
 			displaced_prev = displaced;
+			energy_changed();
 		}
 	}
 
@@ -183,9 +294,16 @@ namespace polyfem
 
 		// Check || ∇B(xᵗ⁺¹) - h² Σ F(xᵗ⁺¹, λᵗ⁺¹, Tᵗ⁺¹)|| ≦ ϵ_d
 		//     ≡ || ∇B(xᵗ⁺¹) + ∇D(xᵗ⁺¹, λᵗ⁺¹, Tᵗ⁺¹)|| ≤ ϵ_d
+		// the solver usually ends with the gradient at x, reuse it if nothing changed since
 		TVector grad;
-		gradient(x, grad);
-		double tol = state.args.value("friction_convergence_tol", 1e-2);
+		if (_gradient_generation == _energy_generation && _gradient_x.size() == x.size() && _gradient_x == x)
+		{
+			grad = _last_gradient;
+			++total_stats_.gradient_reuses;
+		}
+		else
+			gradient(x, grad);
+		double tol = state.settings().friction_convergence_tol;
 		double grad_norm = grad.norm();
 		logger().debug("Lagging convergece grad_norm={:g} tol={:g}", grad_norm, tol);
 		return grad.norm() <= tol;
@@ -202,6 +320,7 @@ namespace polyfem
 
 			rhs_computed = false;
 			this->t = t;
+			energy_changed();
 
 			update_barrier_stiffness(x);
 		}
@@ -213,17 +332,33 @@ namespace polyfem
 		{
 			rhs_computed = false;
 			this->t = t;
+			energy_changed();
 
 			// rhs_assembler.set_velocity_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, velocity, t);
 			// rhs_assembler.set_acceleration_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, acceleration, t);
 		}
 	}
 
+	void NLProblem::set_dt(const double dt)
+	{
+		if (is_time_dependent)
+		{
+			time_integrator->set_dt(dt);
+			energy_changed();
+		}
+	}
+
+	double NLProblem::estimate_local_error(const Eigen::MatrixXd &x) const
+	{
+		assert(x.size() == full_size);
+		return is_time_dependent ? time_integrator->estimate_local_error(x) : 0;
+	}
+
 	const Eigen::MatrixXd &NLProblem::current_rhs()
 	{
 		if (!rhs_computed)
 		{
-			rhs_assembler.compute_energy_grad(state.local_boundary, state.boundary_nodes, state.density, state.args["n_boundary_samples"], state.local_neumann_boundary, state.rhs, t, _current_rhs);
+			rhs_assembler.compute_energy_grad(state.local_boundary, state.boundary_nodes, state.density, state.settings().n_boundary_samples, state.local_neumann_boundary, state.rhs, t, _current_rhs);
 			rhs_computed = true;
 
 			if (assembler.is_mixed(state.formulation()))
@@ -236,18 +371,18 @@ namespace polyfem
 				}
 			}
 			assert(_current_rhs.size() == full_size);
-			rhs_assembler.set_bc(std::vector<LocalBoundary>(), std::vector<int>(), state.args["n_boundary_samples"], state.local_neumann_boundary, _current_rhs, t);
+			rhs_assembler.set_bc(std::vector<LocalBoundary>(), std::vector<int>(), state.settings().n_boundary_samples, state.local_neumann_boundary, _current_rhs, t);
 
 			if (is_time_dependent)
 			{
 				_current_rhs *= time_integrator->acceleration_scaling();
-				_current_rhs += state.mass * time_integrator->x_tilde();
+				_current_rhs.noalias() += state.mass * time_integrator->x_tilde();
 			}
 
 			if (reduced_size != full_size)
 			{
 				// rhs_assembler.set_bc(state.local_boundary, state.boundary_nodes, state.args["n_boundary_samples"], state.local_neumann_boundary, _current_rhs, t);
-				rhs_assembler.set_bc(state.local_boundary, state.boundary_nodes, state.args["n_boundary_samples"], std::vector<LocalBoundary>(), _current_rhs, t);
+				rhs_assembler.set_bc(state.local_boundary, state.boundary_nodes, state.settings().n_boundary_samples, std::vector<LocalBoundary>(), _current_rhs, t);
 			}
 		}
 
@@ -277,46 +412,224 @@ namespace polyfem
 
 	void NLProblem::reduced_to_full_displaced_points(const TVector &reduced, Eigen::MatrixXd &displaced)
 	{
-		Eigen::MatrixXd full;
-		if (reduced.size() == reduced_size)
-			reduced_to_full(reduced, full);
+		compute_displaced_points(full_from(reduced), displaced);
+	}
+
+	const Eigen::MatrixXd &NLProblem::full_from(const TVector &x)
+	{
+		if (x.size() == reduced_size)
+			reduced_to_full(x, workspace.full);
 		else
-			full = reduced;
-		assert(full.size() == full_size);
+			workspace.full = x;
+		assert(workspace.full.size() == full_size);
 
-		compute_displaced_points(full, displaced);
+		return workspace.full;
 	}
 
 	void NLProblem::line_search_begin(const TVector &x0, const TVector &x1)
 	{
 		if (disable_collision)
 			return;
-		if (!state.args["has_collision"])
+		if (!state.settings().has_collision)
 			return;
 
-		Eigen::MatrixXd displaced0, displaced1;
+		update_ccd_accuracy();
+
+		Eigen::MatrixXd &displaced0 = workspace.displaced;
+		Eigen::MatrixXd &displaced1 = workspace.displaced1;
 		reduced_to_full_displaced_points(x0, displaced0);
 		reduced_to_full_displaced_points(x1, displaced1);
 
+		// the motion is linear, if both ends are covered so is the whole step
+		_line_search_broad_phase = broad_phase_covers(displaced0) && broad_phase_covers(displaced1);
+		if (_line_search_broad_phase)
+		{
+			++iteration_stats_.broad_phase_reuses;
+			return;
+		}
+
+		igl::Timer timer;
+		timer.start();
 		ipc::construct_collision_candidates(
 			displaced0, displaced1, state.boundary_edges,
 			state.boundary_triangles, _candidates, /*inflation_radius=*/0,
 			_broad_phase_method, _ignore_codimensional_vertices);
+		timer.stop();
+		iteration_stats_.broad_phase_time += timer.getElapsedTime();
+		++iteration_stats_.broad_phase_builds;
 	}
 
 	void NLProblem::line_search_end()
 	{
 		_candidates.clear();
+		_line_search_broad_phase = false;
+	}
+
+	void NLProblem::update_ccd_accuracy()
+	{
+		_line_search_ccd_tolerance = _ccd_tolerance;
+		_line_search_ccd_max_iterations = _ccd_max_iterations;
+		if (!_adaptive_ccd)
+			return;
+
+		// ratio is 1 at the first newton iteration and goes to 0 at convergence
+		// the tolerance is linear in the ratio: max(ccd_tolerance, loose_ccd_tolerance * ratio)
+		// the iteration budget is inversely proportional to it: loose_ccd_max_iterations / ratio, clamped
+		// to [loose_ccd_max_iterations, ccd_max_iterations], so it reaches the full budget at ratio loose / full
+		const double ratio = std::min(1., _grad_norm_ratio);
+		_line_search_ccd_tolerance = std::max(_ccd_tolerance, _loose_ccd_tolerance * ratio);
+		const double max_iterations = ratio > 0 ? _loose_ccd_max_iterations / ratio : _ccd_max_iterations;
+		_line_search_ccd_max_iterations = int(std::min<double>(_ccd_max_iterations, std::max<double>(_loose_ccd_max_iterations, max_iterations)));
+
+		logger().trace("\tccd tolerance {}, max iterations {}", _line_search_ccd_tolerance, _line_search_ccd_max_iterations);
+	}
+
+	bool NLProblem::broad_phase_covers(const Eigen::MatrixXd &displaced) const
+	{
+		if (_broad_phase_slack <= 0 || _broad_phase_positions.rows() != displaced.rows() || _broad_phase_positions.cols() != displaced.cols())
+			return false;
+
+		const double max_motion_sqr = _broad_phase_slack * _broad_phase_slack / 4;
+		for (int i = 0; i < displaced.rows(); ++i)
+		{
+			if ((displaced.row(i) - _broad_phase_positions.row(i)).squaredNorm() > max_motion_sqr)
+				return false;
+		}
+
+		return true;
+	}
+
+	bool NLProblem::update_broad_phase(const Eigen::MatrixXd &displaced)
+	{
+		if (broad_phase_covers(displaced))
+		{
+			++iteration_stats_.broad_phase_reuses;
+			return false;
+		}
+
+		igl::Timer timer;
+		timer.start();
+		// conservative inflation radius, as in ipc::construct_constraint_set
+		ipc::construct_collision_candidates(
+			displaced, state.boundary_edges, state.boundary_triangles,
+			_broad_phase_candidates, /*inflation_radius=*/(_dhat + _broad_phase_slack) / 1.99,
+			_broad_phase_method, _ignore_codimensional_vertices);
+		_broad_phase_positions = displaced;
+		timer.stop();
+
+		iteration_stats_.broad_phase_time += timer.getElapsedTime();
+		++iteration_stats_.broad_phase_builds;
+		return true;
+	}
+
+	void NLProblem::update_constraint_set(const Eigen::MatrixXd &displaced)
+	{
+		// a set built from the line search candidates may miss constraints outside of the swept region
+		if (!_constraint_set_from_line_search && same_positions(_constraint_set_positions, displaced))
+		{
+			++total_stats_.constraint_set_reuses;
+			return;
+		}
+
+		// the whole build is timed for the automatic selection, the candidates of brute force are cheap to find but expensive to narrow down
+		igl::Timer build_timer;
+		build_timer.start();
+		bool rebuilt = true;
+
+		if (_broad_phase_slack > 0)
+		{
+			rebuilt = update_broad_phase(displaced);
+			ipc::construct_constraint_set(_broad_phase_candidates, state.boundary_nodes_pos, displaced, state.boundary_edges, state.boundary_triangles,
+										  _dhat, _constraint_set, state.boundary_faces_to_edges);
+		}
+		else
+		{
+			igl::Timer timer;
+			timer.start();
+			ipc::construct_constraint_set(
+				state.boundary_nodes_pos, displaced, state.boundary_edges,
+				state.boundary_triangles, _dhat, _constraint_set, state.boundary_faces_to_edges,
+				/*dmin=*/0, _broad_phase_method, _ignore_codimensional_vertices);
+			timer.stop();
+			iteration_stats_.broad_phase_time += timer.getElapsedTime();
+			++iteration_stats_.broad_phase_builds;
+		}
+
+		build_timer.stop();
+		if (_auto_broad_phase && rebuilt)
+			select_broad_phase(build_timer.getElapsedTime());
+
+		_constraint_set_positions = displaced;
+		_constraint_set_from_line_search = false;
+		energy_changed();
+	}
+
+	void NLProblem::select_broad_phase(const double build_time)
+	{
+		if (_broad_phase_trial < 0)
+		{
+			if (++_broad_phase_builds_since_selection < _broad_phase_recheck)
+				return;
+
+			// the configuration changed since the last selection, time all the methods again
+			_broad_phase_trial = 0;
+			_broad_phase_method = _broad_phase_trials[0];
+			return;
+		}
+
+		_broad_phase_trial_times[_broad_phase_trial] = build_time;
+		if (++_broad_phase_trial < int(_broad_phase_trials.size()))
+		{
+			_broad_phase_method = _broad_phase_trials[_broad_phase_trial];
+			return;
+		}
+
+		const int best = std::min_element(_broad_phase_trial_times.begin(), _broad_phase_trial_times.end()) - _broad_phase_trial_times.begin();
+		_broad_phase_method = _broad_phase_trials[best];
+		_broad_phase_trial = -1;
+		_broad_phase_builds_since_selection = 0;
+
+		json times = json::object();
+		for (size_t i = 0; i < _broad_phase_trials.size(); ++i)
+			times[broad_phase_method_name(_broad_phase_trials[i])] = _broad_phase_trial_times[i];
+		logger().debug("selected broad phase {}, build times {}", broad_phase_method_name(_broad_phase_method), times.dump());
+		_broad_phase_selections.push_back({{"method", broad_phase_method_name(_broad_phase_method)}, {"times", times}});
+	}
+
+	json NLProblem::collision_stats(const bool reset)
+	{
+		json res = {
+			{"broad_phase_time", total_stats_.broad_phase_time},
+			{"broad_phase_builds", total_stats_.broad_phase_builds},
+			{"broad_phase_reuses", total_stats_.broad_phase_reuses},
+			{"ccd_time", total_stats_.ccd_time},
+			{"ccd_retries", total_stats_.ccd_retries},
+			{"constraint_set_reuses", total_stats_.constraint_set_reuses},
+			{"friction_set_reuses", total_stats_.friction_set_reuses},
+			{"gradient_reuses", total_stats_.gradient_reuses},
+			{"broad_phase_method", broad_phase_method_name(_broad_phase_method)},
+		};
+		if (_auto_broad_phase)
+			res["broad_phase_selections"] = _broad_phase_selections;
+
+		if (reset)
+		{
+			total_stats_ = CollisionStats();
+			_broad_phase_selections = json::array();
+		}
+
+		return res;
 	}
 
 	double NLProblem::max_step_size(const TVector &x0, const TVector &x1)
 	{
 		if (disable_collision)
 			return 1;
-		if (!state.args["has_collision"])
+		if (!state.settings().has_collision)
 			return 1;
 
-		Eigen::MatrixXd displaced0, displaced1;
+		Eigen::MatrixXd &displaced0 = workspace.displaced;
+		Eigen::MatrixXd &displaced1 = workspace.displaced1;
 		reduced_to_full_displaced_points(x0, displaced0);
 		reduced_to_full_displaced_points(x1, displaced1);
 
@@ -326,11 +639,25 @@ namespace polyfem
 		// 	igl::write_triangle_mesh("s1.obj", displaced1, state.boundary_triangles);
 		// }
 
+		igl::Timer timer;
+		timer.start();
 		double max_step = ipc::compute_collision_free_stepsize(
-			_candidates,
+			line_search_candidates(),
 			displaced0, displaced1,
 			state.boundary_edges, state.boundary_triangles,
-			_ccd_tolerance, _ccd_max_iterations);
+			_line_search_ccd_tolerance, _line_search_ccd_max_iterations);
+		// a loose query can underestimate the step enough to stall the line search, repeat it at full accuracy
+		if (max_step < 1e-3 && loose_ccd())
+		{
+			max_step = ipc::compute_collision_free_stepsize(
+				line_search_candidates(),
+				displaced0, displaced1,
+				state.boundary_edges, state.boundary_triangles,
+				_ccd_tolerance, _ccd_max_iterations);
+			++iteration_stats_.ccd_retries;
+		}
+		timer.stop();
+		iteration_stats_.ccd_time += timer.getElapsedTime();
 		// polyfem::logger().trace("best step {}", max_step);
 
 		// This will check for static intersections as a failsafe. Not needed if we use our conservative CCD.
@@ -354,13 +681,14 @@ namespace polyfem
 	{
 		if (disable_collision)
 			return true;
-		if (!state.args["has_collision"])
+		if (!state.settings().has_collision)
 			return true;
 
 		// if (!state.problem->is_time_dependent())
 		// return false;
 
-		Eigen::MatrixXd displaced0, displaced1;
+		Eigen::MatrixXd &displaced0 = workspace.displaced;
+		Eigen::MatrixXd &displaced1 = workspace.displaced1;
 		reduced_to_full_displaced_points(x0, displaced0);
 		reduced_to_full_displaced_points(x1, displaced1);
 
@@ -370,10 +698,23 @@ namespace polyfem
 		// 	igl::write_triangle_mesh("1.obj", displaced1, state.boundary_triangles);
 		// }
 
-		const bool is_valid = ipc::is_step_collision_free(_candidates,
-														  displaced0, displaced1,
-														  state.boundary_edges, state.boundary_triangles,
-														  _ccd_tolerance, _ccd_max_iterations);
+		igl::Timer timer;
+		timer.start();
+		bool is_valid = ipc::is_step_collision_free(line_search_candidates(),
+													displaced0, displaced1,
+													state.boundary_edges, state.boundary_triangles,
+													_line_search_ccd_tolerance, _line_search_ccd_max_iterations);
+		// a loose query reports a collision when it runs out of iterations, check again at full accuracy
+		if (!is_valid && loose_ccd())
+		{
+			is_valid = ipc::is_step_collision_free(line_search_candidates(),
+												   displaced0, displaced1,
+												   state.boundary_edges, state.boundary_triangles,
+												   _ccd_tolerance, _ccd_max_iterations);
+			++iteration_stats_.ccd_retries;
+		}
+		timer.stop();
+		iteration_stats_.ccd_time += timer.getElapsedTime();
 
 		return is_valid;
 	}
@@ -396,25 +737,21 @@ namespace polyfem
 
 	double NLProblem::value(const TVector &x, const bool only_elastic)
 	{
-		Eigen::MatrixXd full;
-		if (x.size() == reduced_size)
-			reduced_to_full(x, full);
-		else
-			full = x;
-		assert(full.size() == full_size);
+		const Eigen::MatrixXd &full = full_from(x);
 
-		const auto &gbases = state.iso_parametric() ? state.bases : state.geom_bases;
+		const auto &gbases = state.settings().iso_parametric ? state.bases : state.geom_bases;
 
 		const double elastic_energy = assembler.assemble_energy(rhs_assembler.formulation(), state.mesh->is_volume(), state.bases, gbases, state.ass_vals_cache, full);
-		const double body_energy = rhs_assembler.compute_energy(full, state.local_neumann_boundary, state.density, state.args["n_boundary_samples"], t);
+		const double body_energy = rhs_assembler.compute_energy(full, state.local_neumann_boundary, state.density, state.settings().n_boundary_samples, t);
 
 		double intertia_energy = 0;
 		double scaling = 1;
 		if (is_time_dependent)
 		{
 			scaling = time_integrator->acceleration_scaling();
-			const TVector tmp = full - time_integrator->x_tilde();
-			intertia_energy = 0.5 * tmp.transpose() * state.mass * tmp;
+			workspace.tmp.noalias() = full - time_integrator->x_tilde();
+			workspace.mass_tmp.noalias() = state.mass * workspace.tmp;
+			intertia_energy = 0.5 * workspace.tmp.dot(workspace.mass_tmp);
 		}
 
 		/*
@@ -429,9 +766,9 @@ namespace polyfem
 
 		double collision_energy = 0;
 		double friction_energy = 0;
-		if (!only_elastic && !disable_collision && state.args["has_collision"])
+		if (!only_elastic && !disable_collision && state.settings().has_collision)
 		{
-			Eigen::MatrixXd displaced;
+			Eigen::MatrixXd &displaced = workspace.displaced;
 			compute_displaced_points(full, displaced);
 
 			collision_energy = ipc::compute_barrier_potential(displaced, state.boundary_edges, state.boundary_triangles, _constraint_set, _dhat);
@@ -447,11 +784,105 @@ namespace polyfem
 #endif
 	}
 
+	bool NLProblem::line_energy_polynomial(const TVector &x, const TVector &dir, Eigen::VectorXd &coeffs)
+	{
+		const int degree = AssemblerUtils::energy_polynomial_degree(rhs_assembler.formulation());
+		if (degree < 0)
+			return false;
+
+		const Eigen::MatrixXd &full = full_from(x);
+
+		// the direction does not move the dirichlet dofs
+		Eigen::MatrixXd &full_dir = workspace.full_dir;
+		if (full_size == reduced_size)
+			full_dir = dir;
+		else
+		{
+			full_dir.setZero(full_size, 1);
+			for (int i = 0; i < reduced_size; ++i)
+				full_dir(reduced_to_full_map_[i]) = dir(i);
+		}
+
+		const auto &gbases = state.settings().iso_parametric ? state.bases : state.geom_bases;
+
+		Eigen::VectorXd elastic;
+		assembler.assemble_energy_line_polynomial(rhs_assembler.formulation(), state.mesh->is_volume(), state.bases, gbases, state.ass_vals_cache, full, full_dir, elastic);
+
+		coeffs.setZero(std::max(int(elastic.size()), 3));
+		coeffs.head(elastic.size()) = elastic;
+
+		// the body and neumann energy is linear in the displacement
+		coeffs(0) += rhs_assembler.compute_energy(full, state.local_neumann_boundary, state.density, state.settings().n_boundary_samples, t);
+		coeffs(1) += rhs_assembler.compute_energy(full_dir, state.local_neumann_boundary, state.density, state.settings().n_boundary_samples, t);
+
+		if (is_time_dependent)
+		{
+			coeffs *= time_integrator->acceleration_scaling();
+
+			workspace.tmp.noalias() = full - time_integrator->x_tilde();
+			workspace.mass_tmp.noalias() = state.mass * full_dir;
+			coeffs(0) += 0.5 * workspace.tmp.dot(state.mass * workspace.tmp);
+			coeffs(1) += workspace.tmp.dot(workspace.mass_tmp);
+			coeffs(2) += 0.5 * full_dir.col(0).dot(workspace.mass_tmp);
+		}
+
+#ifdef USE_DIV_BARRIER_STIFFNESS
+		coeffs /= _barrier_stiffness;
+#endif
+
+		return true;
+	}
+
+	bool NLProblem::has_contact_terms() const
+	{
+		return !disable_collision && state.settings().has_collision;
+	}
+
+	double NLProblem::contact_energy(const TVector &x)
+	{
+		if (!has_contact_terms())
+			return 0;
+
+		Eigen::MatrixXd &displaced = workspace.displaced;
+		compute_displaced_points(full_from(x), displaced);
+
+		const double collision_energy = ipc::compute_barrier_potential(displaced, state.boundary_edges, state.boundary_triangles, _constraint_set, _dhat);
+		const double friction_energy = ipc::compute_friction_potential(displaced_prev, displaced, state.boundary_edges, state.boundary_triangles, _friction_constraint_set, _epsv * dt());
+
+#ifdef USE_DIV_BARRIER_STIFFNESS
+		return friction_energy / _barrier_stiffness + collision_energy;
+#else
+		return _barrier_stiffness * collision_energy + friction_energy;
+#endif
+	}
+
+	double NLProblem::contact_energy_slope(const TVector &x, const TVector &dir)
+	{
+		if (!has_contact_terms())
+			return 0;
+
+		Eigen::MatrixXd &displaced = workspace.displaced;
+		compute_displaced_points(full_from(x), displaced);
+
+		const Eigen::VectorXd barrier_grad = ipc::compute_barrier_potential_gradient(displaced, state.boundary_edges, state.boundary_triangles, _constraint_set, _dhat);
+		const Eigen::VectorXd friction_grad = ipc::compute_friction_potential_gradient(displaced_prev, displaced, state.boundary_edges, state.boundary_triangles, _friction_constraint_set, _epsv * dt());
+
+#ifdef USE_DIV_BARRIER_STIFFNESS
+		const Eigen::MatrixXd grad = barrier_grad + friction_grad / _barrier_stiffness;
+#else
+		const Eigen::MatrixXd grad = _barrier_stiffness * barrier_grad + friction_grad;
+#endif
+
+		TVector reduced;
+		full_to_reduced(grad, reduced);
+		return reduced.dot(dir);
+	}
+
 	void NLProblem::compute_cached_stiffness()
 	{
 		if (cached_stiffness.size() == 0)
 		{
-			const auto &gbases = state.iso_parametric() ? state.bases : state.geom_bases;
+			const auto &gbases = state.settings().iso_parametric ? state.bases : state.geom_bases;
 			if (assembler.is_linear(state.formulation()))
 			{
 				assembler.assemble_problem(state.formulation(), state.mesh->is_volume(), state.n_bases, state.bases, gbases, state.ass_vals_cache, cached_stiffness);
@@ -462,11 +893,20 @@ namespace polyfem
 	void NLProblem::gradient(const TVector &x, TVector &gradv)
 	{
 		gradient(x, gradv, false);
+
+		const double grad_norm = gradv.norm();
+		if (_first_grad_norm < 0 && std::isfinite(grad_norm))
+			_first_grad_norm = grad_norm;
+		_grad_norm_ratio = _first_grad_norm > 0 ? grad_norm / _first_grad_norm : 0;
+
+		_gradient_x = x;
+		_last_gradient = gradv;
+		_gradient_generation = _energy_generation;
 	}
 
 	void NLProblem::gradient(const TVector &x, TVector &gradv, const bool only_elastic)
 	{
-		Eigen::MatrixXd grad;
+		Eigen::MatrixXd &grad = workspace.grad;
 		gradient_no_rhs(x, grad, only_elastic);
 
 #ifdef USE_DIV_BARRIER_STIFFNESS
@@ -484,20 +924,15 @@ namespace polyfem
 	{
 		//scaling * (elastic_energy + body_energy) + intertia_energy + _barrier_stiffness * collision_energy;
 
-		Eigen::MatrixXd full;
-		if (x.size() == reduced_size)
-			reduced_to_full(x, full);
-		else
-			full = x;
-		assert(full.size() == full_size);
+		const Eigen::MatrixXd &full = full_from(x);
 
-		const auto &gbases = state.iso_parametric() ? state.bases : state.geom_bases;
+		const auto &gbases = state.settings().iso_parametric ? state.bases : state.geom_bases;
 		assembler.assemble_energy_gradient(rhs_assembler.formulation(), state.mesh->is_volume(), state.n_bases, state.bases, gbases, state.ass_vals_cache, full, grad);
 
 		if (is_time_dependent)
 		{
 			grad *= time_integrator->acceleration_scaling();
-			grad += state.mass * full;
+			grad.noalias() += state.mass * full;
 		}
 
 		// logger().trace("grad norm {}", grad.norm());
@@ -506,9 +941,9 @@ namespace polyfem
 		grad /= _barrier_stiffness;
 #endif
 
-		if (!only_elastic && !disable_collision && state.args["has_collision"])
+		if (!only_elastic && !disable_collision && state.settings().has_collision)
 		{
-			Eigen::MatrixXd displaced;
+			Eigen::MatrixXd &displaced = workspace.displaced;
 			compute_displaced_points(full, displaced);
 
 #ifdef USE_DIV_BARRIER_STIFFNESS
@@ -529,7 +964,7 @@ namespace polyfem
 
 	void NLProblem::hessian(const TVector &x, THessian &hessian)
 	{
-		THessian tmp;
+		THessian &tmp = workspace.hessian;
 		hessian_full(x, tmp);
 
 		if (reduced_size == full_size)
@@ -541,54 +976,277 @@ namespace polyfem
 		igl::Timer timer;
 		timer.start();
 
-		std::vector<Eigen::Triplet<double>> entries;
+		tmp.makeCompressed();
+		if (!same_hessian_pattern(tmp))
+			build_hessian_slice(tmp);
 
-		Eigen::VectorXi indices(full_size);
+		hessian = reduced_hessian_pattern_;
+		const double *full_values = tmp.valuePtr();
+		double *reduced_values = hessian.valuePtr();
+		for (size_t k = 0; k < hessian_slice_map_.size(); ++k)
+		{
+			const int rk = hessian_slice_map_[k];
+			if (rk >= 0)
+				reduced_values[rk] = full_values[k];
+		}
 
-		int index = 0;
-		size_t kk = 0;
-		for (int i = 0; i < full_size; ++i)
+		timer.stop();
+		polyfem::logger().trace("\tremoving costraint time {}s", timer.getElapsedTimeInSec());
+	}
+
+	void NLProblem::contact_stencils(std::vector<ContactSparsity::Stencil> &stencils) const
+	{
+		// the persistent broad phase contains every pair that can enter the constraint set until it is rebuilt
+		// without slack there is no persistent broad phase and the line search candidates are cleared by now,
+		// the pattern then grows with the entries of the contact hessians only, and is rebuilt once stale pairs pile up
+		const ipc::Candidates &candidates = _broad_phase_slack > 0 ? _broad_phase_candidates : _candidates;
+		const Eigen::MatrixXi &E = state.boundary_edges;
+		const Eigen::MatrixXi &F = state.boundary_triangles;
+
+		stencils.reserve(candidates.size());
+		for (const auto &c : candidates.ev_candidates)
+			stencils.push_back({{E(c.edge_index, 0), E(c.edge_index, 1), int(c.vertex_index), -1}});
+		for (const auto &c : candidates.ee_candidates)
+			stencils.push_back({{E(c.edge0_index, 0), E(c.edge0_index, 1), E(c.edge1_index, 0), E(c.edge1_index, 1)}});
+		for (const auto &c : candidates.fv_candidates)
+			stencils.push_back({{F(c.face_index, 0), F(c.face_index, 1), F(c.face_index, 2), int(c.vertex_index)}});
+	}
+
+	void NLProblem::local_contact_dofs(const TVector &x, const int n_rings, std::vector<int> &dofs)
+	{
+		dofs.clear();
+		if (disable_collision || !state.settings().has_collision || _constraint_set.empty())
+			return;
+
+		const int dim = state.mesh->dimension();
+		build_element_adjacency();
+
+		Eigen::MatrixXd &displaced = workspace.displaced;
+		reduced_to_full_displaced_points(x, displaced);
+		const Eigen::VectorXd grad_barrier = ipc::compute_barrier_potential_gradient(
+			displaced, state.boundary_edges, state.boundary_triangles, _constraint_set, _dhat);
+
+		std::vector<bool> in_region(element_nodes_.size(), false);
+		std::vector<int> front;
+		for (int n = 0; n < state.n_bases; ++n)
+		{
+			if (grad_barrier.segment(n * dim, dim).squaredNorm() == 0)
+				continue;
+			for (int e : node_elements_[n])
+			{
+				if (!in_region[e])
+				{
+					in_region[e] = true;
+					front.push_back(e);
+				}
+			}
+		}
+
+		std::vector<int> next_front;
+		for (int r = 0; r < n_rings && !front.empty(); ++r)
 		{
-			if (kk < state.boundary_nodes.size() && state.boundary_nodes[kk] == i)
+			next_front.clear();
+			for (int e : front)
 			{
-				++kk;
-				indices(i) = -1;
+				for (int n : element_nodes_[e])
+				{
+					for (int f : node_elements_[n])
+					{
+						if (!in_region[f])
+						{
+							in_region[f] = true;
+							next_front.push_back(f);
+						}
+					}
+				}
+			}
+			std::swap(front, next_front);
+		}
+
+		std::vector<bool> is_dof(reduced_size, false);
+		for (size_t e = 0; e < element_nodes_.size(); ++e)
+		{
+			if (!in_region[e])
 				continue;
+			for (int n : element_nodes_[e])
+			{
+				for (int d = 0; d < dim; ++d)
+				{
+					const int rd = full_to_reduced_map_.empty() ? n * dim + d : full_to_reduced_map_[n * dim + d];
+					if (rd >= 0)
+						is_dof[rd] = true;
+				}
 			}
+		}
 
-			indices(i) = index++;
+		for (int i = 0; i < reduced_size; ++i)
+		{
+			if (is_dof[i])
+				dofs.push_back(i);
 		}
-		assert(index == reduced_size);
+	}
 
-		for (int k = 0; k < tmp.outerSize(); ++k)
+	void NLProblem::build_element_adjacency()
+	{
+		if (!element_nodes_.empty())
+			return;
+
+		element_nodes_.resize(state.bases.size());
+		node_elements_.assign(state.n_bases, std::vector<int>());
+		for (size_t e = 0; e < state.bases.size(); ++e)
 		{
-			if (indices(k) < 0)
+			auto &nodes = element_nodes_[e];
+			for (const auto &b : state.bases[e].bases)
 			{
-				continue;
+				for (const auto &g : b.global())
+					nodes.push_back(g.index);
 			}
+			std::sort(nodes.begin(), nodes.end());
+			nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
 
-			for (THessian::InnerIterator it(tmp, k); it; ++it)
+			for (int n : nodes)
+				node_elements_[n].push_back(e);
+		}
+	}
+
+	void NLProblem::local_hessian(const TVector &x, const std::vector<int> &dofs, THessian &hessian)
+	{
+		igl::Timer timer;
+		timer.start();
+
+		const int dim = state.mesh->dimension();
+		build_element_adjacency();
+
+		local_full_dofs_.resize(dofs.size());
+		for (size_t i = 0; i < dofs.size(); ++i)
+			local_full_dofs_[i] = reduced_to_full_map_.empty() ? dofs[i] : reduced_to_full_map_[dofs[i]];
+
+		// the entries between two dofs of the block only come from the elements touching their nodes
+		std::vector<bool> touched(element_nodes_.size(), false);
+		local_elements_.clear();
+		for (int fd : local_full_dofs_)
+		{
+			for (int e : node_elements_[fd / dim])
 			{
-				// std::cout<<it.row()<<" "<<it.col()<<" "<<k<<std::endl;
-				assert(it.col() == k);
-				if (indices(it.row()) < 0 || indices(it.col()) < 0)
+				if (!touched[e])
 				{
-					continue;
+					touched[e] = true;
+					local_elements_.push_back(e);
 				}
+			}
+		}
+		std::sort(local_elements_.begin(), local_elements_.end());
 
-				assert(indices(it.row()) >= 0);
-				assert(indices(it.col()) >= 0);
+		const Eigen::MatrixXd &full = full_from(x);
 
-				entries.emplace_back(indices(it.row()), indices(it.col()), it.value());
-			}
+		// full size, only the rows and columns of the block are correct
+		const THessian *elastic = &cached_stiffness;
+		if (assembler.is_linear(rhs_assembler.formulation()))
+			compute_cached_stiffness();
+		else
+		{
+			// the cache maps into the full pattern once it has been built, the block entries are a subset of it
+			const std::vector<int> *elements = mat_cache.mapping_size() > 0 ? &local_elements_ : nullptr;
+			const auto &gbases = state.settings().iso_parametric ? state.bases : state.geom_bases;
+			assembler.assemble_energy_hessian(rhs_assembler.formulation(), state.mesh->is_volume(), state.n_bases, project_to_psd, state.bases, gbases, state.ass_vals_cache, full, mat_cache, workspace.hessian, elements);
+			elastic = &workspace.hessian;
+		}
+
+		double elastic_scale = is_time_dependent ? time_integrator->acceleration_scaling() : 1;
+		double mass_scale = 1;
+#ifdef USE_DIV_BARRIER_STIFFNESS
+		elastic_scale /= _barrier_stiffness;
+		mass_scale /= _barrier_stiffness;
+#endif
+
+		if (full_to_local_.size() != size_t(full_size))
+			full_to_local_.assign(full_size, -1);
+		for (size_t i = 0; i < local_full_dofs_.size(); ++i)
+			full_to_local_[local_full_dofs_[i]] = i;
+
+		local_entries_.clear();
+		add_block(*elastic, elastic_scale, local_full_dofs_, full_to_local_, local_entries_);
+		if (is_time_dependent)
+			add_block(state.mass, mass_scale, local_full_dofs_, full_to_local_, local_entries_);
+
+		if (!disable_collision && state.settings().has_collision)
+		{
+			Eigen::MatrixXd &displaced = workspace.displaced;
+			compute_displaced_points(full, displaced);
+
+			const ContactSparsity::ContactHessian barrier_hessian = ipc::compute_barrier_potential_hessian(displaced, state.boundary_edges, state.boundary_triangles, _constraint_set, _dhat, project_to_psd);
+			const ContactSparsity::ContactHessian friction_hessian = ipc::compute_friction_potential_hessian(
+				displaced_prev, displaced, state.boundary_edges, state.boundary_triangles, _friction_constraint_set, _epsv * dt(), project_to_psd);
+#ifdef USE_DIV_BARRIER_STIFFNESS
+			add_block(barrier_hessian, 1, local_full_dofs_, full_to_local_, local_entries_);
+			add_block(friction_hessian, 1 / _barrier_stiffness, local_full_dofs_, full_to_local_, local_entries_);
+#else
+			add_block(barrier_hessian, _barrier_stiffness, local_full_dofs_, full_to_local_, local_entries_);
+			add_block(friction_hessian, 1, local_full_dofs_, full_to_local_, local_entries_);
+#endif
 		}
 
-		hessian.resize(reduced_size, reduced_size);
-		hessian.setFromTriplets(entries.begin(), entries.end());
+		for (int fd : local_full_dofs_)
+			full_to_local_[fd] = -1;
+
+		hessian.resize(dofs.size(), dofs.size());
+		hessian.setFromTriplets(local_entries_.begin(), local_entries_.end());
 		hessian.makeCompressed();
 
 		timer.stop();
-		polyfem::logger().trace("\tremoving costraint time {}s", timer.getElapsedTimeInSec());
+		polyfem::logger().trace("	local hessian of {} elements time {}s", local_elements_.size(), timer.getElapsedTimeInSec());
+	}
+
+	bool NLProblem::same_hessian_pattern(const THessian &full) const
+	{
+		if (hessian_slice_map_.size() != size_t(full.nonZeros()) || hessian_outer_.size() != size_t(full.outerSize()) + 1)
+			return false;
+
+		return std::equal(hessian_outer_.begin(), hessian_outer_.end(), full.outerIndexPtr())
+			   && std::equal(hessian_inner_.begin(), hessian_inner_.end(), full.innerIndexPtr());
+	}
+
+	void NLProblem::build_hessian_slice(const THessian &full)
+	{
+		assert(full.isCompressed());
+
+		igl::Timer timer;
+		timer.start();
+
+		const int nnz = full.nonZeros();
+		hessian_outer_.assign(full.outerIndexPtr(), full.outerIndexPtr() + full.outerSize() + 1);
+		hessian_inner_.assign(full.innerIndexPtr(), full.innerIndexPtr() + nnz);
+		hessian_slice_map_.resize(nnz);
+
+		// entries are visited in column-major order with sorted rows, and the index map is monotonic,
+		// so the kept entries appear in the same order as in the compressed reduced matrix
+		std::vector<Eigen::Triplet<double>> entries;
+		entries.reserve(nnz);
+		int index = 0;
+		for (int k = 0; k < full.outerSize(); ++k)
+		{
+			const int rk = full_to_reduced_map_[k];
+			for (int p = full.outerIndexPtr()[k]; p < full.outerIndexPtr()[k + 1]; ++p)
+			{
+				const int ri = full_to_reduced_map_[full.innerIndexPtr()[p]];
+				if (rk < 0 || ri < 0)
+				{
+					hessian_slice_map_[p] = -1;
+					continue;
+				}
+
+				hessian_slice_map_[p] = index++;
+				entries.emplace_back(ri, rk, 0);
+			}
+		}
+
+		reduced_hessian_pattern_.resize(reduced_size, reduced_size);
+		reduced_hessian_pattern_.setFromTriplets(entries.begin(), entries.end());
+		reduced_hessian_pattern_.makeCompressed();
+		assert(reduced_hessian_pattern_.nonZeros() == index);
+
+		timer.stop();
+		polyfem::logger().trace("\tbuilding hessian slice map time {}s", timer.getElapsedTimeInSec());
 	}
 
 	void NLProblem::hessian_full(const TVector &x, THessian &hessian)
@@ -598,19 +1256,13 @@ namespace polyfem
 		igl::Timer timer;
 		timer.start();
 
-		Eigen::MatrixXd full;
-		if (x.size() == reduced_size)
-			reduced_to_full(x, full);
-		else
-			full = x;
+		const Eigen::MatrixXd &full = full_from(x);
 
 		timer.stop();
 		polyfem::logger().trace("\treduced to full time {}s", timer.getElapsedTimeInSec());
 		timer.start();
 
-		assert(full.size() == full_size);
-
-		const auto &gbases = state.iso_parametric() ? state.bases : state.geom_bases;
+		const auto &gbases = state.settings().iso_parametric ? state.bases : state.geom_bases;
 		if (assembler.is_linear(rhs_assembler.formulation()))
 		{
 			compute_cached_stiffness();
@@ -635,14 +1287,14 @@ namespace polyfem
 		hessian /= _barrier_stiffness;
 #endif
 
-		if (!disable_collision && state.args["has_collision"])
+		if (!disable_collision && state.settings().has_collision)
 		{
 			timer.start();
 
 			igl::Timer timeri;
 			timeri.start();
 
-			Eigen::MatrixXd displaced;
+			Eigen::MatrixXd &displaced = workspace.displaced;
 			compute_displaced_points(full, displaced);
 			timeri.stop();
 			polyfem::logger().trace("\t\tdisplace pts time {}s", timeri.getElapsedTimeInSec());
@@ -652,18 +1304,29 @@ namespace polyfem
 			polyfem::logger().trace("\t\tconstraint set time {}s", timeri.getElapsedTimeInSec());
 			timeri.start();
 #ifdef USE_DIV_BARRIER_STIFFNESS
-			hessian += ipc::compute_barrier_potential_hessian(displaced, state.boundary_edges, state.boundary_triangles, _constraint_set, _dhat, project_to_psd);
-			hessian += ipc::compute_friction_potential_hessian(
-						   displaced_prev, displaced, state.boundary_edges, state.boundary_triangles, _friction_constraint_set, _epsv * dt(), project_to_psd)
-					   / _barrier_stiffness;
+			const ContactSparsity::ContactHessian barrier_hessian = ipc::compute_barrier_potential_hessian(displaced, state.boundary_edges, state.boundary_triangles, _constraint_set, _dhat, project_to_psd);
+			const ContactSparsity::ContactHessian friction_hessian = ipc::compute_friction_potential_hessian(
+																		 displaced_prev, displaced, state.boundary_edges, state.boundary_triangles, _friction_constraint_set, _epsv * dt(), project_to_psd)
+																	 / _barrier_stiffness;
 #else
-			hessian += _barrier_stiffness * ipc::compute_barrier_potential_hessian(displaced, state.boundary_edges, state.boundary_triangles, _constraint_set, _dhat, project_to_psd);
-			hessian += ipc::compute_friction_potential_hessian(
+			const ContactSparsity::ContactHessian barrier_hessian = _barrier_stiffness * ipc::compute_barrier_potential_hessian(displaced, state.boundary_edges, state.boundary_triangles, _constraint_set, _dhat, project_to_psd);
+			const ContactSparsity::ContactHessian friction_hessian = ipc::compute_friction_potential_hessian(
 				displaced_prev, displaced, state.boundary_edges, state.boundary_triangles, _friction_constraint_set, _epsv * dt(), project_to_psd);
 #endif
 			timeri.stop();
 			polyfem::logger().trace("\t\tonly ipc hessian time {}s", timeri.getElapsedTimeInSec());
 
+			// keeps the pattern of the hessian fixed while the contact pairs stay within the broad-phase candidates
+			timeri.start();
+			hessian.makeCompressed();
+			contact_sparsity_.assemble(
+				hessian, {&barrier_hessian, &friction_hessian},
+				[this](std::vector<ContactSparsity::Stencil> &stencils) { contact_stencils(stencils); },
+				workspace.contact_hessian);
+			std::swap(hessian, workspace.contact_hessian);
+			timeri.stop();
+			polyfem::logger().trace("\t\tcontact scatter time {}s", timeri.getElapsedTimeInSec());
+
 			timer.stop();
 			polyfem::logger().trace("\tipc hessian time {}s", timer.getElapsedTimeInSec());
 		}
@@ -676,30 +1339,65 @@ namespace polyfem
 
 	void NLProblem::full_to_reduced(const Eigen::MatrixXd &full, TVector &reduced) const
 	{
-		full_to_reduced_aux(state, full_size, reduced_size, full, reduced);
+		if (full_size == reduced_size)
+		{
+			reduced = full;
+			return;
+		}
+
+		assert(full.size() == full_size);
+		assert(full.cols() == 1);
+		reduced.resize(reduced_size);
+
+		for (int j = 0; j < reduced_size; ++j)
+			reduced(j) = full(reduced_to_full_map_[j]);
 	}
 
 	void NLProblem::reduced_to_full(const TVector &reduced, Eigen::MatrixXd &full)
 	{
-		reduced_to_full_aux(state, full_size, reduced_size, reduced, current_rhs(), full);
+		if (full_size == reduced_size)
+		{
+			full = reduced;
+			return;
+		}
+
+		assert(reduced.size() == reduced_size);
+		assert(reduced.cols() == 1);
+		const Eigen::MatrixXd &rhs = current_rhs();
+		full.resize(full_size, 1);
+
+		for (int b : state.boundary_nodes)
+			full(b) = rhs(b);
+		for (int j = 0; j < reduced_size; ++j)
+			full(reduced_to_full_map_[j]) = reduced(j);
 	}
 
 	void NLProblem::solution_changed(const TVector &newX)
 	{
 		if (disable_collision)
 			return;
-		if (!state.args["has_collision"])
+		if (!state.settings().has_collision)
 			return;
 
-		Eigen::MatrixXd displaced;
+		Eigen::MatrixXd &displaced = workspace.displaced;
 		reduced_to_full_displaced_points(newX, displaced);
 
-		if (_candidates.size() > 0)
+		if (_broad_phase_slack <= 0 && _candidates.size() > 0)
+		{
+			if (same_positions(_constraint_set_positions, displaced))
+			{
+				++total_stats_.constraint_set_reuses;
+				return;
+			}
+
 			ipc::construct_constraint_set(_candidates, state.boundary_nodes_pos, displaced, state.boundary_edges, state.boundary_triangles,
 										  _dhat, _constraint_set, state.boundary_faces_to_edges);
+			_constraint_set_positions = displaced;
+			_constraint_set_from_line_search = true;
+			energy_changed();
+		}
 		else
-			ipc::construct_constraint_set(state.boundary_nodes_pos, displaced, state.boundary_edges, state.boundary_triangles,
-										  _dhat, _constraint_set, state.boundary_faces_to_edges, /*dmin=*/0, _broad_phase_method, _ignore_codimensional_vertices);
+			update_constraint_set(displaced);
 	}
 
 	double NLProblem::heuristic_max_step(const TVector &dx)
@@ -727,23 +1425,25 @@ namespace polyfem
 	{
 		if (disable_collision)
 			return;
-		if (!state.args["has_collision"])
+		if (!state.settings().has_collision)
 			return;
 
-		Eigen::MatrixXd full;
-		if (x0.size() == reduced_size)
-			reduced_to_full(x0, full);
-		else
-			full = x0;
-
-		assert(full.size() == full_size);
-
-		Eigen::MatrixXd displaced;
+		const Eigen::MatrixXd &full = full_from(x0);
 
+		Eigen::MatrixXd &displaced = workspace.displaced;
 		compute_displaced_points(full, displaced);
 
 		const double dist_sqr = ipc::compute_minimum_distance(displaced, state.boundary_edges, state.boundary_triangles, _constraint_set);
 		polyfem::logger().trace("min_dist {}", sqrt(dist_sqr));
+
+		polyfem::logger().debug("\tbroad phase {}s ({} builds, {} reuses), ccd {}s ({} retries)",
+								iteration_stats_.broad_phase_time, iteration_stats_.broad_phase_builds, iteration_stats_.broad_phase_reuses, iteration_stats_.ccd_time, iteration_stats_.ccd_retries);
+		total_stats_.broad_phase_time += iteration_stats_.broad_phase_time;
+		total_stats_.ccd_time += iteration_stats_.ccd_time;
+		total_stats_.broad_phase_builds += iteration_stats_.broad_phase_builds;
+		total_stats_.broad_phase_reuses += iteration_stats_.broad_phase_reuses;
+		total_stats_.ccd_retries += iteration_stats_.ccd_retries;
+		iteration_stats_ = CollisionStats();
 		// igl::write_triangle_mesh("step.obj", displaced, state.boundary_triangles);
 
 		if (is_time_dependent)
@@ -754,6 +1454,7 @@ namespace polyfem
 				_barrier_stiffness, ipc::world_bbox_diagonal_length(displaced));
 			if (prev_barrier_stiffness != _barrier_stiffness)
 			{
+				energy_changed();
 				polyfem::logger().debug(
 					"updated barrier stiffness from {:g} to {:g}",
 					prev_barrier_stiffness, _barrier_stiffness);
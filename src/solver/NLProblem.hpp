@@ -4,6 +4,7 @@
 #include <polyfem/RhsAssembler.hpp>
 #include <polyfem/State.hpp>
 #include <polyfem/ImplicitTimeIntegrator.hpp>
+#include <polyfem/ContactSparsity.hpp>
 
 #include <polyfem/MatrixUtils.hpp>
 
@@ -25,6 +26,10 @@ namespace polyfem
 		NLProblem(State &state, const RhsAssembler &rhs_assembler, const double t, const double dhat, const bool project_to_psd, const bool no_reduced = false);
 		void init(const TVector &displacement);
 		void init_time_integrator(const TVector &x_prev, const TVector &v_prev, const TVector &a_prev, const double dt);
+		// initial guess of the next time step from the time integrator predictor
+		// x holds the reduced previous solution and is replaced by the prediction, clamped by CCD
+		// both ends of the clamped motion are expanded with the boundary conditions of the current step
+		void predict(TVector &x);
 		TVector initial_guess();
 
 		virtual double value(const TVector &x) override;
@@ -34,6 +39,15 @@ namespace polyfem
 		virtual double value(const TVector &x, const bool only_elastic);
 		void gradient(const TVector &x, TVector &gradv, const bool only_elastic);
 
+		// coefficients of the energy without the barrier and friction terms along x + alpha * dir, in increasing powers of alpha
+		// returns false if the elastic energy is not polynomial
+		virtual bool line_energy_polynomial(const TVector &x, const TVector &dir, Eigen::VectorXd &coeffs);
+		// true if value contains barrier and friction terms
+		bool has_contact_terms() const;
+		// barrier and friction terms of value at x and their derivative along dir, for the current constraint sets
+		double contact_energy(const TVector &x);
+		double contact_energy_slope(const TVector &x, const TVector &dir);
+
 		bool is_step_valid(const TVector &x0, const TVector &x1);
 		bool is_step_collision_free(const TVector &x0, const TVector &x1);
 		double max_step_size(const TVector &x0, const TVector &x1);
@@ -113,7 +127,10 @@ namespace polyfem
 		void reduced_to_full(const TVector &reduced, Eigen::MatrixXd &full);
 
 		virtual void update_quantities(const double t, const TVector &x);
-		void substepping(const double t);
+		virtual void substepping(const double t);
+		// adaptive time stepping: size of the next step and local error estimate of the step to the full solution x
+		void set_dt(const double dt);
+		double estimate_local_error(const Eigen::MatrixXd &x) const;
 		void solution_changed(const TVector &newX);
 		void update_lagging(const TVector &x, bool start_of_timestep);
 
@@ -128,6 +145,15 @@ namespace polyfem
 		double heuristic_max_step(const TVector &dx);
 
 		inline int max_ccd_max_iterations() const { return _max_ccd_max_iterations; }
+
+		// sorted reduced dofs of the elements touching the nodes with an active barrier at x, grown by n_rings rings of neighbouring elements
+		// empty if there is no contact
+		void local_contact_dofs(const TVector &x, const int n_rings, std::vector<int> &dofs);
+		// block of the reduced hessian on the sorted reduced dofs, the elastic part is assembled only on the elements touching them
+		virtual void local_hessian(const TVector &x, const std::vector<int> &dofs, THessian &hessian);
+
+		// broad-phase and ccd times and counts since the last call
+		json collision_stats(const bool reset = true);
 		inline void set_ccd_max_iterations(int v) { _ccd_max_iterations = v; }
 
 	protected:
@@ -137,6 +163,8 @@ namespace polyfem
 		void reduced_to_full_displaced_points(const TVector &reduced, Eigen::MatrixXd &displaced);
 		const RhsAssembler &rhs_assembler;
 		bool is_time_dependent;
+		// invalidates the memoized gradient
+		void energy_changed() { ++_energy_generation; }
 
 	private:
 		AssemblerUtils &assembler;
@@ -145,6 +173,31 @@ namespace polyfem
 		SpareMatrixCache mat_cache;
 
 		const int full_size, reduced_size;
+
+		// precomputed dof permutation: reduced -> full index, and full -> reduced (-1 for dirichlet dofs)
+		std::vector<int> reduced_to_full_map_;
+		std::vector<int> full_to_reduced_map_;
+		void init_reduction_maps();
+
+		// cached slice of the full hessian pattern: position in the reduced values of every full nonzero (-1 if removed)
+		std::vector<StiffnessMatrix::StorageIndex> hessian_outer_, hessian_inner_;
+		std::vector<int> hessian_slice_map_;
+		StiffnessMatrix reduced_hessian_pattern_;
+		bool same_hessian_pattern(const THessian &full) const;
+		void build_hessian_slice(const THessian &full);
+
+		// the barrier and friction hessians are added in place to a superset of their pattern
+		ContactSparsity contact_sparsity_;
+		void contact_stencils(std::vector<ContactSparsity::Stencil> &stencils) const;
+
+		// nodes of every element and elements of every node, built on the first local_contact_dofs
+		std::vector<std::vector<int>> element_nodes_, node_elements_;
+		void build_element_adjacency();
+
+		// local_hessian buffers, full_to_local_ is -1 between calls
+		std::vector<int> local_full_dofs_, local_elements_, full_to_local_;
+		std::vector<Eigen::Triplet<double>> local_entries_;
+
 		double t;
 		bool rhs_computed;
 		bool project_to_psd;
@@ -163,15 +216,95 @@ namespace polyfem
 		double _ccd_tolerance;
 		int _ccd_max_iterations, _max_ccd_max_iterations;
 
+		// adaptive ccd accuracy (solver_params adaptive_ccd): the line searches start with the loose tolerance and iteration
+		// budget at the first gradient of a solve and reach _ccd_tolerance and _ccd_max_iterations as the gradient norm drops
+		// (tolerance linear in the gradient norm ratio, iterations inversely proportional to it, see update_ccd_accuracy)
+		// the ccd stays conservative, a loose query only underestimates the collision-free step
+		bool _adaptive_ccd = false;
+		double _loose_ccd_tolerance;
+		int _loose_ccd_max_iterations;
+		double _first_grad_norm = -1;
+		double _grad_norm_ratio = 1;
+		double _line_search_ccd_tolerance;
+		int _line_search_ccd_max_iterations;
+		void update_ccd_accuracy();
+		bool loose_ccd() const { return _line_search_ccd_tolerance > _ccd_tolerance || _line_search_ccd_max_iterations < _ccd_max_iterations; }
+
 		const double &dt() const { return time_integrator->dt(); }
 
 		ipc::Constraints _constraint_set;
 		ipc::FrictionConstraints _friction_constraint_set;
 		ipc::Candidates _candidates;
 
+		// persistent broad phase: candidates of the positions _broad_phase_positions with boxes inflated by (dhat + slack) / 2
+		// they contain every pair closer than dhat and every pair colliding in a linear motion, as long as no vertex
+		// moved more than slack / 2 from _broad_phase_positions, so they are rebuilt only after large motions
+		ipc::Candidates _broad_phase_candidates;
+		Eigen::MatrixXd _broad_phase_positions;
+		double _broad_phase_slack;
+		// true if the line search uses _broad_phase_candidates instead of _candidates
+		bool _line_search_broad_phase = false;
+		bool broad_phase_covers(const Eigen::MatrixXd &displaced) const;
+		// returns false if the candidates were reused
+		bool update_broad_phase(const Eigen::MatrixXd &displaced);
+		void update_constraint_set(const Eigen::MatrixXd &displaced);
+
+		// automatic broad-phase method (ccd_method "auto"): the constraint-set builds are timed with every method
+		// in turn, the fastest is kept for the next _broad_phase_recheck builds and then all of them are timed again
+		bool _auto_broad_phase = false;
+		int _broad_phase_recheck;
+		std::vector<ipc::BroadPhaseMethod> _broad_phase_trials;
+		std::vector<double> _broad_phase_trial_times;
+		// index of the method being timed, -1 once one is selected
+		int _broad_phase_trial = -1;
+		int _broad_phase_builds_since_selection = 0;
+		json _broad_phase_selections = json::array();
+		void select_broad_phase(const double build_time);
+		const ipc::Candidates &line_search_candidates() const { return _line_search_broad_phase ? _broad_phase_candidates : _candidates; }
+
+		struct CollisionStats
+		{
+			double broad_phase_time = 0;
+			double ccd_time = 0;
+			int broad_phase_builds = 0;
+			int broad_phase_reuses = 0;
+			// loose ccd queries repeated at full accuracy
+			int ccd_retries = 0;
+			// rebuilds avoided by the memoization below
+			int constraint_set_reuses = 0;
+			int friction_set_reuses = 0;
+			int gradient_reuses = 0;
+		} iteration_stats_, total_stats_;
+
+		// iterate-keyed memoization across solution_changed, post_step, update_lagging and lagging_converged:
+		// positions of the last constraint and friction set builds, and the last gradient with its iterate
+		// _energy_generation changes with everything else the gradient depends on (sets, stiffness, rhs, time integrator)
+		Eigen::MatrixXd _constraint_set_positions, _friction_set_positions;
+		// true if the last constraint set was built from the line search candidates, it is only reused within the line search
+		bool _constraint_set_from_line_search = false;
+		double _friction_set_barrier_stiffness = -1;
+		TVector _gradient_x, _last_gradient;
+		long _gradient_generation = -1;
+		long _energy_generation = 0;
+		static bool same_positions(const Eigen::MatrixXd &a, const Eigen::MatrixXd &b) { return a.rows() == b.rows() && a.cols() == b.cols() && a.size() > 0 && a == b; }
+
 		std::shared_ptr<ImplicitTimeIntegrator> time_integrator;
 
+		// persistent buffers reused across value/gradient/hessian calls to avoid reallocations
+		struct Workspace
+		{
+			Eigen::MatrixXd full, full_dir;
+			Eigen::MatrixXd displaced, displaced1;
+			Eigen::MatrixXd grad;
+			TVector tmp, mass_tmp;
+			THessian hessian, contact_hessian;
+		} workspace;
+
+		// returns the full vector of x, either x itself or the workspace buffer
+		const Eigen::MatrixXd &full_from(const TVector &x);
+
 		void compute_cached_stiffness();
 		void update_barrier_stiffness(const TVector &full);
+		void update_barrier_stiffness_aux(const TVector &full);
 	};
 } // namespace polyfem
@@ -15,8 +15,11 @@
 #include <cppoptlib/linesearch/armijo.h>
 #include <cppoptlib/linesearch/morethuente.h>
 
+#include <algorithm>
 #include <cmath>
 #include <cfenv>
+#include <memory>
+#include <vector>
 
 namespace cppoptlib
 {
@@ -36,6 +39,7 @@ namespace cppoptlib
 			ArmijoAlt,
 			Bisection,
 			MoreThuente,
+			Exact,
 			None
 		};
 
@@ -69,6 +73,10 @@ namespace cppoptlib
 			{
 				line_search = LineSearch::MoreThuente;
 			}
+			else if (name == "exact")
+			{
+				line_search = LineSearch::Exact;
+			}
 			else if (name == "none")
 			{
 				line_search = LineSearch::None;
@@ -83,11 +91,10 @@ namespace cppoptlib
 			solver_info["line_search"] = name;
 		}
 
-		double armijo_linesearch(const TVector &x, const TVector &searchDir, ProblemType &objFunc, double alpha_init = 1.0)
+		double armijo_linesearch(const TVector &x, const TVector &searchDir, ProblemType &objFunc, double alpha_init = 1.0, const double c = 0.5)
 		{
 			static const int MAX_STEP_SIZE_ITER = 12;
 
-			const double c = 0.5;
 			const double tau = 0.5;
 			const double f_in = objFunc.value(x);
 
@@ -153,6 +160,84 @@ namespace cppoptlib
 				return alpha;
 		}
 
+		//for energies polynomial along the line (linear elasticity, St.Venant-Kirchhoff) the minimizer is found in closed form
+		//from the polynomial coefficients, without contact it is the step
+		//with contact the 1-D model is the polynomial plus the barrier and friction terms, which are the only terms evaluated
+		//along the line while backtracking from the closed-form step clamped by CCD
+		//armijo is used only if the model fails
+		double exact_linesearch(const TVector &x, const TVector &searchDir, ProblemType &objFunc)
+		{
+			static const int MAX_STEP_SIZE_ITER = 12;
+
+			Eigen::VectorXd coeffs;
+			if (!objFunc.line_energy_polynomial(x, searchDir, coeffs))
+				return armijo_linesearch(x, searchDir, objFunc);
+
+			double alpha = polynomial_minimizer(coeffs);
+			polyfem::logger().trace("exact line search step {}", alpha);
+			if (!std::isfinite(alpha) || alpha <= 0)
+				return armijo_linesearch(x, searchDir, objFunc);
+
+			alpha = std::min(objFunc.heuristic_max_step(searchDir), alpha);
+			TVector x1 = x + alpha * searchDir;
+
+			if (!objFunc.has_contact_terms())
+			{
+				if (objFunc.is_step_valid(x, x1))
+					return alpha;
+
+				return armijo_linesearch(x, searchDir, objFunc);
+			}
+
+			//the constraint sets are the ones of x
+			const double f_in = coeffs(0) + objFunc.contact_energy(x);
+			const double slope = coeffs(1) + objFunc.contact_energy_slope(x, searchDir);
+			if (!std::isfinite(f_in) || !std::isfinite(slope) || slope >= 0)
+				return armijo_linesearch(x, searchDir, objFunc);
+
+			//small sufficient decrease constant, the exact minimizer of a quadratic only decreases by half the linear model
+			const double Cache = 1e-4 * slope;
+			const double tau = 0.5;
+
+			objFunc.line_search_begin(x, x1);
+			objFunc.solution_changed(x1);
+			const double max_alpha = objFunc.max_step_size(x, x1);
+			if (max_alpha < alpha)
+			{
+				alpha = max_alpha;
+				x1 = x + alpha * searchDir;
+				objFunc.solution_changed(x1);
+			}
+
+			double f = polynomial_value(coeffs, alpha) + objFunc.contact_energy(x1);
+			bool valid = objFunc.is_step_valid(x, x1);
+
+			int cur_iter = 0;
+			while ((!std::isfinite(f) || f > f_in + alpha * Cache || !valid) && alpha > 1e-7 && cur_iter <= MAX_STEP_SIZE_ITER)
+			{
+				alpha *= tau;
+				x1 = x + alpha * searchDir;
+				objFunc.solution_changed(x1);
+
+				f = polynomial_value(coeffs, alpha) + objFunc.contact_energy(x1);
+				valid = objFunc.is_step_valid(x, x1);
+
+				cur_iter++;
+			}
+
+			objFunc.line_search_end();
+
+			if (std::isfinite(f) && f <= f_in + alpha * Cache && valid && alpha > 1e-7)
+			{
+				//max_step_size should return a collision free step
+				assert(objFunc.is_step_collision_free(x, x1));
+				return alpha;
+			}
+
+			polyfem::logger().debug("exact line search failed, falling back to armijo");
+			return armijo_linesearch(x, searchDir, objFunc);
+		}
+
 		double linesearch(const TVector &x, const TVector &grad, ProblemType &objFunc)
 		{
 			static const int MAX_STEP_SIZE_ITER = std::numeric_limits<int>::max();
@@ -322,11 +407,8 @@ namespace cppoptlib
 			// const json &params = State::state().solver_params();
 			// auto solver = LinearSolver::create(State::state().solver_type(), State::state().precond_type());
 
-			time.start();
-			auto solver = polysolve::LinearSolver::create(solver_type, precond_type);
-			solver->setParameters(solver_param);
-			time.stop();
-			polyfem::logger().debug("\tinternal solver {}, took {}s", solver->name(), time.getElapsedTimeInSec());
+			polysolve::LinearSolver &solver = linear_solver();
+			internal_solver = json::array();
 
 			// objFunc.set_ccd_max_iterations(objFunc.max_ccd_max_iterations() / 10);
 
@@ -340,16 +422,7 @@ namespace cppoptlib
 			TVector delta_x(reduced_size);
 			delta_x.setZero();
 
-			grad_time = 0;
-			assembly_time = 0;
-			inverting_time = 0;
-			linesearch_time = 0;
-			obj_fun_time = 0;
-			chekcing_for_nan_inf_time = 0;
-			broad_phase_ccd_time = 0;
-			ccd_time = 0;
-			constrain_set_update_time = 0;
-			classical_linesearch_time = 0;
+			reset_times();
 
 			polyfem::StiffnessMatrix hessian;
 			this->m_current.reset();
@@ -361,7 +434,7 @@ namespace cppoptlib
 			error_code_ = 0;
 
 			time.stop();
-			polyfem::logger().trace("\tinitialization took {}s", solver->name(), time.getElapsedTimeInSec());
+			polyfem::logger().trace("\tinitialization took {}s", time.getElapsedTimeInSec());
 
 			time.start();
 			objFunc.solution_changed(x0);
@@ -425,12 +498,10 @@ namespace cppoptlib
 
 				if (new_hessian && !line_search_failed)
 				{
-					//TODO: get the correct size
-					solver->analyzePattern(hessian, hessian.rows());
-					solver->factorize(hessian);
+					factorize_hessian(hessian);
 				}
 				if (!line_search_failed)
-					solver->solve(grad, delta_x);
+					solver.solve(grad, delta_x);
 
 				//gradient descent, check descent direction
 				const double residual = (hessian * delta_x - grad).norm();
@@ -444,37 +515,13 @@ namespace cppoptlib
 				delta_x *= -1;
 
 				json tmp;
-				solver->getInfo(tmp);
+				solver.getInfo(tmp);
 				internal_solver.push_back(tmp);
 
 				polyfem::logger().debug("\tinverting time {}s", time.getElapsedTimeInSec());
 				inverting_time += time.getElapsedTimeInSec();
 
-				time.start();
-
-				double rate;
-				switch (line_search)
-				{
-				case LineSearch::Armijo:
-					rate = armijo_linesearch(x0, delta_x, objFunc);
-					break;
-				case LineSearch::ArmijoAlt:
-					rate = Armijo<ProblemType, 1>::linesearch(x0, delta_x, objFunc);
-					break;
-				case LineSearch::Bisection:
-					rate = linesearch(x0, delta_x, objFunc);
-					break;
-				case LineSearch::MoreThuente:
-					rate = MoreThuente<ProblemType, 1>::linesearch(x0, delta_x, objFunc);
-					break;
-				case LineSearch::None:
-					rate = 1e-1;
-					break;
-				}
-
-				time.stop();
-				polyfem::logger().debug("\tlinesearch time {}s", time.getElapsedTimeInSec());
-				linesearch_time += time.getElapsedTimeInSec();
+				const double rate = line_search_step(x0, delta_x, objFunc);
 
 				if (std::isnan(rate))
 				{
@@ -565,6 +612,142 @@ namespace cppoptlib
 			} while (objFunc.callback(this->m_current, x0) && (this->m_status == Status::Continue));
 
 			polyfem::logger().info("Newton finished niters = {}, f = {}, ||g||_2 = {}", this->m_current.iterations, old_energy, this->m_current.gradNorm);
+			update_solver_info();
+		}
+
+		void getInfo(json &params)
+		{
+			params = solver_info;
+		}
+
+		int error_code() const { return error_code_; }
+
+	protected:
+		const json solver_param;
+		const std::string solver_type;
+		const std::string precond_type;
+
+		int error_code_;
+		bool use_gradient_norm_;
+		json solver_info;
+
+		json internal_solver = json::array();
+
+		LineSearch line_search = LineSearch::Armijo;
+
+		double grad_time;
+		double assembly_time;
+		double inverting_time;
+		double linesearch_time;
+		double constrain_set_update_time;
+		double obj_fun_time;
+		double chekcing_for_nan_inf_time;
+		double broad_phase_ccd_time;
+		double ccd_time;
+		double classical_linesearch_time;
+
+		//the linear solver and the symbolic analysis of the hessian persist across minimize calls
+		std::unique_ptr<polysolve::LinearSolver> linear_solver_;
+		std::vector<polyfem::StiffnessMatrix::StorageIndex> analyzed_outer_, analyzed_inner_;
+
+		polysolve::LinearSolver &linear_solver()
+		{
+			if (!linear_solver_)
+			{
+				igl::Timer time;
+				time.start();
+				linear_solver_ = polysolve::LinearSolver::create(solver_type, precond_type);
+				linear_solver_->setParameters(solver_param);
+				time.stop();
+				polyfem::logger().debug("\tinternal solver {}, took {}s", linear_solver_->name(), time.getElapsedTimeInSec());
+			}
+
+			return *linear_solver_;
+		}
+
+		//numeric factorization of the hessian, analyzePattern runs only if the sparsity changed
+		void factorize_hessian(const polyfem::StiffnessMatrix &hessian)
+		{
+			polysolve::LinearSolver &solver = linear_solver();
+
+			const bool same_pattern = hessian.isCompressed()
+									  && size_t(hessian.outerSize() + 1) == analyzed_outer_.size()
+									  && size_t(hessian.nonZeros()) == analyzed_inner_.size()
+									  && std::equal(analyzed_outer_.begin(), analyzed_outer_.end(), hessian.outerIndexPtr())
+									  && std::equal(analyzed_inner_.begin(), analyzed_inner_.end(), hessian.innerIndexPtr());
+
+			if (!same_pattern)
+			{
+				//TODO: get the correct size
+				solver.analyzePattern(hessian, hessian.rows());
+
+				analyzed_outer_.clear();
+				analyzed_inner_.clear();
+				if (hessian.isCompressed())
+				{
+					analyzed_outer_.assign(hessian.outerIndexPtr(), hessian.outerIndexPtr() + hessian.outerSize() + 1);
+					analyzed_inner_.assign(hessian.innerIndexPtr(), hessian.innerIndexPtr() + hessian.nonZeros());
+				}
+			}
+			else
+				polyfem::logger().trace("\tsame hessian pattern, skipping analyzePattern");
+
+			solver.factorize(hessian);
+		}
+
+		void reset_times()
+		{
+			grad_time = 0;
+			assembly_time = 0;
+			inverting_time = 0;
+			linesearch_time = 0;
+			obj_fun_time = 0;
+			chekcing_for_nan_inf_time = 0;
+			broad_phase_ccd_time = 0;
+			ccd_time = 0;
+			constrain_set_update_time = 0;
+			classical_linesearch_time = 0;
+		}
+
+		//runs the selected line search along delta_x, returns nan if it failed
+		double line_search_step(const TVector &x0, const TVector &delta_x, ProblemType &objFunc)
+		{
+			igl::Timer time;
+			time.start();
+
+			double rate;
+			switch (line_search)
+			{
+			case LineSearch::Armijo:
+				rate = armijo_linesearch(x0, delta_x, objFunc);
+				break;
+			case LineSearch::ArmijoAlt:
+				rate = Armijo<ProblemType, 1>::linesearch(x0, delta_x, objFunc);
+				break;
+			case LineSearch::Bisection:
+				rate = linesearch(x0, delta_x, objFunc);
+				break;
+			case LineSearch::MoreThuente:
+				rate = MoreThuente<ProblemType, 1>::linesearch(x0, delta_x, objFunc);
+				break;
+			case LineSearch::Exact:
+				rate = exact_linesearch(x0, delta_x, objFunc);
+				break;
+			case LineSearch::None:
+				rate = 1e-1;
+				break;
+			}
+
+			time.stop();
+			polyfem::logger().debug("\tlinesearch time {}s", time.getElapsedTimeInSec());
+			linesearch_time += time.getElapsedTimeInSec();
+
+			return rate;
+		}
+
+		//fills solver_info with the stopping criteria and the per iteration timings
+		void update_solver_info()
+		{
 			polyfem::logger().trace("grad {}s, assembly {}s, inverting {}s, linesearch {}s, constrain_set_update {}s, obj_fun {}s, chekcing_for_nan_inf {}s, broad_phase_ccd {}s, ccd {}s, classical_linesearch {}s",
 									grad_time,
 									assembly_time,
@@ -577,7 +760,8 @@ namespace cppoptlib
 									ccd_time,
 									classical_linesearch_time);
 			solver_info["internal_solver"] = internal_solver;
-			solver_info["internal_solver_first"] = internal_solver.front();
+			if (!internal_solver.empty())
+				solver_info["internal_solver_first"] = internal_solver.front();
 			solver_info["status"] = this->status();
 			solver_info["error_code"] = error_code_;
 
@@ -614,36 +798,62 @@ namespace cppoptlib
 			solver_info["time_classical_linesearch"] = classical_linesearch_time;
 		}
 
-		void getInfo(json &params)
+		//sum_k coeffs(k) alpha^k
+		static double polynomial_value(const Eigen::VectorXd &coeffs, const double alpha)
 		{
-			params = solver_info;
+			double res = 0;
+			for (int k = int(coeffs.size()) - 1; k >= 0; --k)
+				res = res * alpha + coeffs(k);
+			return res;
 		}
 
-		int error_code() const { return error_code_; }
-
-	private:
-		const json solver_param;
-		const std::string solver_type;
-		const std::string precond_type;
+		//global minimizer on (0, inf) of the polynomial sum_k coeffs(k) alpha^k, nan if it is unbounded or not decreasing
+		static double polynomial_minimizer(const Eigen::VectorXd &coeffs)
+		{
+			//drop vanishing leading terms
+			const double scale = coeffs.cwiseAbs().maxCoeff();
+			int degree = int(coeffs.size()) - 1;
+			while (degree > 0 && std::abs(coeffs(degree)) <= 1e-14 * scale)
+				--degree;
 
-		int error_code_;
-		bool use_gradient_norm_;
-		json solver_info;
+			if (degree < 2 || coeffs(degree) <= 0 || degree % 2 == 1)
+				return std::nan("");
 
-		json internal_solver = json::array();
+			const auto p = [&](const double a) {
+				double res = 0;
+				for (int k = degree; k >= 0; --k)
+					res = res * a + coeffs(k);
+				return res;
+			};
+
+			//roots of the derivative, from the eigenvalues of the companion matrix
+			const int n = degree - 1;
+			Eigen::MatrixXd companion = Eigen::MatrixXd::Zero(n, n);
+			for (int k = 0; k < n; ++k)
+				companion(k, n - 1) = -(k + 1) * coeffs(k + 1) / (degree * coeffs(degree));
+			for (int k = 1; k < n; ++k)
+				companion(k, k - 1) = 1;
+
+			const Eigen::VectorXcd roots = companion.eigenvalues();
+
+			double best_alpha = std::nan("");
+			double best_val = p(0);
+			for (int k = 0; k < roots.size(); ++k)
+			{
+				const double a = roots(k).real();
+				if (a <= 0 || std::abs(roots(k).imag()) > 1e-10 * std::max(1., std::abs(a)))
+					continue;
 
-		LineSearch line_search = LineSearch::Armijo;
+				const double val = p(a);
+				if (val < best_val)
+				{
+					best_val = val;
+					best_alpha = a;
+				}
+			}
 
-		double grad_time;
-		double assembly_time;
-		double inverting_time;
-		double linesearch_time;
-		double constrain_set_update_time;
-		double obj_fun_time;
-		double chekcing_for_nan_inf_time;
-		double broad_phase_ccd_time;
-		double ccd_time;
-		double classical_linesearch_time;
+			return best_alpha;
+		}
 
 		bool has_hessian_nans(const polyfem::StiffnessMatrix &hessian)
 		{
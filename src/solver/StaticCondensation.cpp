@@ -0,0 +1,293 @@
+#include "StaticCondensation.hpp"
+
+#include <polyfem/par_for.hpp>
+#include <polyfem/Logger.hpp>
+
+#include <igl/Timer.h>
+
+#include <algorithm>
+
+#ifdef POLYFEM_WITH_TBB
+#include <tbb/parallel_for.h>
+#include <tbb/enumerable_thread_specific.h>
+#endif
+
+namespace polyfem
+{
+	namespace
+	{
+		class LocalThreadSchurStorage
+		{
+		public:
+			std::vector<Eigen::Triplet<double>> entries;
+			Eigen::VectorXd rhs;
+		};
+	} // namespace
+
+	void StaticCondensation::init(const std::vector<ElementBases> &bases, const int n_bases, const int problem_dim, const std::vector<int> &boundary_nodes)
+	{
+		const int full_size = n_bases * problem_dim;
+
+		blocks_.clear();
+		n_interior_ = 0;
+
+		is_dirichlet_.assign(full_size, false);
+		for (int b : boundary_nodes)
+			is_dirichlet_[b] = true;
+
+		//nodes of every element, and number of elements using a node
+		std::vector<std::vector<int>> element_nodes(bases.size());
+		std::vector<int> node_valence(n_bases, 0);
+		for (size_t e = 0; e < bases.size(); ++e)
+		{
+			auto &nodes = element_nodes[e];
+			for (const auto &b : bases[e].bases)
+			{
+				for (const auto &g : b.global())
+					nodes.push_back(g.index);
+			}
+			std::sort(nodes.begin(), nodes.end());
+			nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+
+			for (int n : nodes)
+				++node_valence[n];
+		}
+
+		std::vector<bool> is_interior(full_size, false);
+		for (int n = 0; n < n_bases; ++n)
+		{
+			if (node_valence[n] != 1)
+				continue;
+
+			for (int d = 0; d < problem_dim; ++d)
+			{
+				const int dof = n * problem_dim + d;
+				if (!is_dirichlet_[dof])
+					is_interior[dof] = true;
+			}
+		}
+
+		for (size_t e = 0; e < bases.size(); ++e)
+		{
+			ElementBlock block;
+			for (int n : element_nodes[e])
+			{
+				for (int d = 0; d < problem_dim; ++d)
+				{
+					const int dof = n * problem_dim + d;
+					if (is_interior[dof])
+						block.interior.push_back(dof);
+					else
+						block.coupled.push_back(dof);
+				}
+			}
+
+			if (block.interior.empty())
+				continue;
+
+			n_interior_ += block.interior.size();
+			blocks_.emplace_back(std::move(block));
+		}
+
+		full_to_skeleton_.assign(full_size, -1);
+		skeleton_to_full_.clear();
+		skeleton_to_full_.reserve(full_size - n_interior_);
+		for (int i = 0; i < full_size; ++i)
+		{
+			if (is_interior[i])
+				continue;
+
+			full_to_skeleton_[i] = int(skeleton_to_full_.size());
+			skeleton_to_full_.push_back(i);
+		}
+
+		//boundary nodes are sorted and never interior, the order is preserved
+		skeleton_boundary_nodes_.clear();
+		skeleton_boundary_nodes_.reserve(boundary_nodes.size());
+		for (int b : boundary_nodes)
+			skeleton_boundary_nodes_.push_back(full_to_skeleton_[b]);
+
+		logger().debug("static condensation: {} interior dofs in {} elements, skeleton size {}", n_interior_, blocks_.size(), skeleton_to_full_.size());
+	}
+
+	void StaticCondensation::condense(const StiffnessMatrix &A, const Eigen::VectorXd &b, StiffnessMatrix &S, Eigen::VectorXd &bs)
+	{
+		assert(A.rows() == full_size() && A.cols() == full_size());
+		assert(b.size() == full_size());
+
+		igl::Timer timer;
+		timer.start();
+
+		const int n_skeleton = skeleton_size();
+		const int n_blocks = int(blocks_.size());
+
+#if defined(POLYFEM_WITH_CPP_THREADS)
+		std::vector<LocalThreadSchurStorage> storages(polyfem::get_n_threads());
+		for (auto &s : storages)
+			s.rhs.setZero(n_skeleton);
+#elif defined(POLYFEM_WITH_TBB)
+		typedef tbb::enumerable_thread_specific<LocalThreadSchurStorage> LocalStorage;
+		LocalThreadSchurStorage proto;
+		proto.rhs.setZero(n_skeleton);
+		LocalStorage storages(proto);
+#else
+		LocalThreadSchurStorage loc_storage;
+		loc_storage.rhs.setZero(n_skeleton);
+#endif
+
+#if defined(POLYFEM_WITH_CPP_THREADS)
+		polyfem::par_for(n_blocks, [&](int start, int end, int t) {
+			auto &loc_storage = storages[t];
+			for (int e = start; e < end; ++e)
+			{
+#elif defined(POLYFEM_WITH_TBB)
+		tbb::parallel_for(tbb::blocked_range<int>(0, n_blocks), [&](const tbb::blocked_range<int> &r) {
+			LocalStorage::reference loc_storage = storages.local();
+			for (int e = r.begin(); e != r.end(); ++e)
+			{
+#else
+		for (int e = 0; e < n_blocks; ++e)
+		{
+#endif
+				ElementBlock &block = blocks_[e];
+				const int n_i = int(block.interior.size());
+				const int n_c = int(block.coupled.size());
+
+				Eigen::MatrixXd Aii(n_i, n_i);
+				Eigen::VectorXd bi(n_i);
+				block.Ais.resize(n_i, n_c);
+				block.Asi.resize(n_c, n_i);
+				for (int i = 0; i < n_i; ++i)
+				{
+					const int gi = block.interior[i];
+					bi(i) = b(gi);
+					for (int j = 0; j < n_i; ++j)
+						Aii(i, j) = A.coeff(gi, block.interior[j]);
+					for (int j = 0; j < n_c; ++j)
+					{
+						block.Ais(i, j) = A.coeff(gi, block.coupled[j]);
+						block.Asi(j, i) = A.coeff(block.coupled[j], gi);
+					}
+				}
+
+				block.Aii.compute(Aii);
+
+				//S_cc -= A_ci A_ii^-1 A_ic, b_c -= A_ci A_ii^-1 b_i
+				const Eigen::MatrixXd AiiInvAis = block.Aii.solve(block.Ais);
+				const Eigen::VectorXd AiiInvbi = block.Aii.solve(bi);
+				const Eigen::MatrixXd schur = block.Asi * AiiInvAis;
+				const Eigen::VectorXd schur_rhs = block.Asi * AiiInvbi;
+
+				for (int i = 0; i < n_c; ++i)
+				{
+					//dirichlet rows are replaced by the solver, keep them untouched
+					if (is_dirichlet_[block.coupled[i]])
+						continue;
+
+					const int si = full_to_skeleton_[block.coupled[i]];
+					loc_storage.rhs(si) -= schur_rhs(i);
+					for (int j = 0; j < n_c; ++j)
+					{
+						if (std::abs(schur(i, j)) < 1e-30)
+							continue;
+						loc_storage.entries.emplace_back(si, full_to_skeleton_[block.coupled[j]], -schur(i, j));
+					}
+				}
+
+#if defined(POLYFEM_WITH_CPP_THREADS) || defined(POLYFEM_WITH_TBB)
+			}
+		});
+#else
+		}
+#endif
+
+		std::vector<Eigen::Triplet<double>> entries;
+		entries.reserve(A.nonZeros());
+		for (int k = 0; k < A.outerSize(); ++k)
+		{
+			for (StiffnessMatrix::InnerIterator it(A, k); it; ++it)
+			{
+				const int si = full_to_skeleton_[it.row()];
+				const int sj = full_to_skeleton_[it.col()];
+				if (si >= 0 && sj >= 0)
+					entries.emplace_back(si, sj, it.value());
+			}
+		}
+
+		bs.resize(n_skeleton);
+		for (int i = 0; i < n_skeleton; ++i)
+			bs(i) = b(skeleton_to_full_[i]);
+
+#if defined(POLYFEM_WITH_CPP_THREADS)
+		for (const auto &t : storages)
+		{
+			entries.insert(entries.end(), t.entries.begin(), t.entries.end());
+			bs += t.rhs;
+		}
+#elif defined(POLYFEM_WITH_TBB)
+		for (LocalStorage::iterator i = storages.begin(); i != storages.end(); ++i)
+		{
+			entries.insert(entries.end(), i->entries.begin(), i->entries.end());
+			bs += i->rhs;
+		}
+#else
+		entries.insert(entries.end(), loc_storage.entries.begin(), loc_storage.entries.end());
+		bs += loc_storage.rhs;
+#endif
+
+		S.resize(n_skeleton, n_skeleton);
+		S.setFromTriplets(entries.begin(), entries.end());
+		S.makeCompressed();
+
+		timer.stop();
+		logger().debug("static condensation: {} -> {} dofs, took {}s", full_size(), n_skeleton, timer.getElapsedTime());
+	}
+
+	void StaticCondensation::recover(const Eigen::VectorXd &b, const Eigen::VectorXd &xs, Eigen::VectorXd &x) const
+	{
+		assert(b.size() == full_size());
+		assert(xs.size() == skeleton_size());
+
+		x.resize(full_size());
+		for (int i = 0; i < skeleton_size(); ++i)
+			x(skeleton_to_full_[i]) = xs(i);
+
+		const int n_blocks = int(blocks_.size());
+
+		//every interior dof belongs to one block, so the writes never overlap
+		const auto recover_block = [&](const int e) {
+			const ElementBlock &block = blocks_[e];
+			const int n_i = int(block.interior.size());
+			const int n_c = int(block.coupled.size());
+
+			Eigen::VectorXd rhs(n_i);
+			for (int i = 0; i < n_i; ++i)
+				rhs(i) = b(block.interior[i]);
+
+			Eigen::VectorXd xc(n_c);
+			for (int j = 0; j < n_c; ++j)
+				xc(j) = xs(full_to_skeleton_[block.coupled[j]]);
+
+			rhs -= block.Ais * xc;
+			const Eigen::VectorXd xi = block.Aii.solve(rhs);
+
+			for (int i = 0; i < n_i; ++i)
+				x(block.interior[i]) = xi(i);
+		};
+
+#if defined(POLYFEM_WITH_CPP_THREADS)
+		polyfem::par_for(n_blocks, [&](int start, int end, int t) {
+			for (int e = start; e < end; ++e)
+				recover_block(e);
+		});
+#elif defined(POLYFEM_WITH_TBB)
+		tbb::parallel_for(tbb::blocked_range<int>(0, n_blocks), [&](const tbb::blocked_range<int> &r) {
+			for (int e = r.begin(); e != r.end(); ++e)
+				recover_block(e);
+		});
+#else
+		for (int e = 0; e < n_blocks; ++e)
+			recover_block(e);
+#endif
+	}
+} // namespace polyfem
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <polyfem/ElementBases.hpp>
+#include <polyfem/Types.hpp>
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include <vector>
+
+namespace polyfem
+{
+	//static condensation of the element interior (bubble) dofs
+	//a dof is interior if its node is used by a single element and it is not a dirichlet node,
+	//in that case its row of the stiffness couples only with the dofs of that element
+	//the interior block of every element is eliminated locally (Schur complement), the smaller
+	//skeleton system is solved globally, and the interior dofs are recovered element by element
+	class StaticCondensation
+	{
+	public:
+		//finds the interior dofs, problem_dim is the number of dofs per node
+		void init(const std::vector<ElementBases> &bases, const int n_bases, const int problem_dim, const std::vector<int> &boundary_nodes);
+
+		//true if there is nothing to condense (eg linear elements)
+		inline bool empty() const { return n_interior_ == 0; }
+
+		inline int full_size() const { return int(full_to_skeleton_.size()); }
+		inline int skeleton_size() const { return int(skeleton_to_full_.size()); }
+		inline int interior_size() const { return n_interior_; }
+
+		//dirichlet nodes in the skeleton numbering
+		inline const std::vector<int> &skeleton_boundary_nodes() const { return skeleton_boundary_nodes_; }
+
+		//computes the Schur complement S = A_ss - A_si A_ii^-1 A_is and the condensed rhs
+		//the local factorizations of A_ii are kept for recover
+		//rhs entries of dirichlet nodes are copied unchanged
+		void condense(const StiffnessMatrix &A, const Eigen::VectorXd &b, StiffnessMatrix &S, Eigen::VectorXd &bs);
+
+		//recovers the full solution from the skeleton one: x_i = A_ii^-1 (b_i - A_is x_s)
+		void recover(const Eigen::VectorXd &b, const Eigen::VectorXd &xs, Eigen::VectorXd &x) const;
+
+	private:
+		class ElementBlock
+		{
+		public:
+			//full indices of the interior dofs
+			std::vector<int> interior;
+			//full indices of the skeleton dofs coupled with the interior
+			std::vector<int> coupled;
+
+			Eigen::PartialPivLU<Eigen::MatrixXd> Aii;
+			//A_is and A_si restricted to the coupled dofs
+			Eigen::MatrixXd Ais, Asi;
+		};
+
+		std::vector<ElementBlock> blocks_;
+		std::vector<int> full_to_skeleton_;
+		std::vector<int> skeleton_to_full_;
+		std::vector<int> skeleton_boundary_nodes_;
+		std::vector<bool> is_dirichlet_;
+		int n_interior_ = 0;
+	};
+} // namespace polyfem
@@ -0,0 +1,27 @@
+#include "SimulationSettings.hpp"
+
+namespace polyfem
+{
+	void SimulationSettings::init(const json &args)
+	{
+		has_collision = args["has_collision"];
+		n_boundary_samples = args["n_boundary_samples"];
+		project_to_psd = args["project_to_psd"];
+
+		dhat = args["dhat"];
+		epsv = args["epsv"];
+		mu = args["mu"];
+		friction_iterations = args["friction_iterations"];
+		friction_convergence_tol = args.value("friction_convergence_tol", 1e-2);
+
+		const json &solver_params = args["solver_params"];
+		ccd_method = solver_params.value("ccd_method", std::string("hash_grid"));
+		ccd_tolerance = solver_params.value("ccd_tolerance", 1e-6);
+		ccd_max_iterations = solver_params.value("ccd_max_iterations", int(1e6));
+		adaptive_ccd = solver_params.value("adaptive_ccd", false);
+		loose_ccd_tolerance = solver_params.value("loose_ccd_tolerance", 1e-3);
+		loose_ccd_max_iterations = solver_params.value("loose_ccd_max_iterations", int(1e3));
+		broad_phase_slack = solver_params.value("broad_phase_slack", 1.);
+		broad_phase_recheck = solver_params.value("broad_phase_recheck", 50);
+	}
+} // namespace polyfem
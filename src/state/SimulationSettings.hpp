@@ -0,0 +1,44 @@
+#pragma once
+
+#include <polyfem/Common.hpp>
+
+#include <string>
+
+namespace polyfem
+{
+	//typed copy of the arguments read inside the non-linear solve
+	//parsed once from the json in State::init and refreshed at the end of State::build_basis
+	//so that the Newton and line-search loops do not perform string-keyed json lookups
+	class SimulationSettings
+	{
+	public:
+		void init(const json &args);
+
+		bool has_collision = false;
+		int n_boundary_samples = -1;
+		bool project_to_psd = false;
+
+		//contact
+		double dhat = 1e-3;
+		double epsv = 1e-3;
+		double mu = 0;
+		int friction_iterations = 1;
+		double friction_convergence_tol = 1e-2;
+
+		//collision detection, from solver_params
+		std::string ccd_method = "hash_grid";
+		double ccd_tolerance = 1e-6;
+		int ccd_max_iterations = 1e6;
+		//adaptive ccd accuracy in the line search, loosest tolerance and iteration budget used far from convergence
+		bool adaptive_ccd = false;
+		double loose_ccd_tolerance = 1e-3;
+		int loose_ccd_max_iterations = 1e3;
+		//the broad-phase candidates are kept while no vertex moves more than half of this slack (relative to dhat), 0 rebuilds them every time
+		double broad_phase_slack = 1;
+		//with ccd_method "auto", number of constraint-set builds before the broad-phase methods are timed again
+		int broad_phase_recheck = 50;
+
+		//depends on the mesh, set by State::build_basis
+		bool iso_parametric = true;
+	};
+} // namespace polyfem
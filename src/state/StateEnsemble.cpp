@@ -0,0 +1,132 @@
+#include <polyfem/State.hpp>
+
+#include <polyfem/Logger.hpp>
+#include <polyfem/par_for.hpp>
+
+#include <igl/Timer.h>
+
+#ifdef POLYFEM_WITH_TBB
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#endif
+
+#include <algorithm>
+
+namespace polyfem
+{
+	void State::reset_output_caches()
+	{
+		exporter_.reset();
+		vis_mesh_ = VisMesh();
+		//the keys point to the bases of the state that built them
+		vis_interpolation_.clear();
+	}
+
+	void State::solve_variant(const json &variant, const std::string &name, const json &base_params, const json &base_problem, const json &base_problem_params, json &j)
+	{
+		igl::Timer timer;
+		timer.start();
+
+		args["params"] = base_params;
+		if (variant.contains("params"))
+			args["params"].merge_patch(variant["params"]);
+
+		const auto params = build_json_params();
+		assembler.set_parameters(params);
+		density.init(params);
+
+		args["problem"] = variant.contains("problem") ? variant["problem"] : base_problem;
+		args["problem_params"] = base_problem_params;
+		if (variant.contains("problem_params"))
+			args["problem_params"].merge_patch(variant["problem_params"]);
+
+		problem = ProblemFactory::factory().get_problem(args["problem"]);
+		problem->clear();
+		problem->set_parameters(args["problem_params"]);
+		problem->init(*mesh);
+
+		assemble_rhs();
+		assemble_stiffness_mat();
+		solve_problem();
+		compute_errors();
+
+		timer.stop();
+
+		save_json(j);
+		j.erase("args");
+		j["name"] = name;
+		j["variant"] = variant;
+		j["variant_time"] = timer.getElapsedTime();
+	}
+
+	void State::solve_ensemble(const json &variants, json &results)
+	{
+		if (!mesh)
+		{
+			logger().error("Load the mesh first!");
+			return;
+		}
+		if (n_bases <= 0)
+		{
+			logger().error("Build the bases first!");
+			return;
+		}
+
+		//every worker solves its variants on a copy of the state, the copies share the mesh and copy the bases,
+		//boundary nodes and assembly caches, every variant only changes the material, the problem and its parameters
+		//this state is not modified
+		const json base_params = args["params"];
+		const json base_problem = args["problem"];
+		const json base_problem_params = args["problem_params"];
+		const std::string vis_mesh_path = args["export"]["paraview"].empty() ? args["export"]["vis_mesh"] : args["export"]["paraview"];
+		const double tend = args["tend"];
+
+		const int n_variants = variants.size();
+		const int n_workers = std::max(1, std::min(n_variants, int(get_n_threads())));
+		//the threads left are split among the workers
+		const int worker_threads = std::max(1, int(get_n_threads()) / n_workers);
+		logger().info("Ensemble of {} variants on {} workers with {} threads each", n_variants, n_workers, worker_threads);
+
+		std::vector<std::string> names(n_variants);
+		for (int i = 0; i < n_variants; ++i)
+			names[i] = variants[i].contains("name") ? std::string(variants[i]["name"]) : std::to_string(i);
+
+		std::vector<json> variant_results(n_variants);
+
+		const auto run_worker = [&](const int w) {
+			std::unique_ptr<State> worker(new State(*this));
+			worker->reset_output_caches();
+
+			for (int i = w; i < n_variants; i += n_workers)
+			{
+				logger().info("Ensemble variant {} ({}/{})", names[i], i + 1, n_variants);
+				worker->solve_variant(variants[i], names[i], base_params, base_problem, base_problem_params, variant_results[i]);
+
+				if (!vis_mesh_path.empty())
+					worker->save_vtu(worker->resolve_output_path(fmt::format("variant_{}.vtu", names[i])), tend);
+			}
+		};
+
+#if defined(POLYFEM_WITH_CPP_THREADS)
+		//a par_for inside a worker runs in the worker thread
+		polyfem::par_for(
+			n_workers, [&](int start, int end, int t) {
+				for (int w = start; w < end; ++w)
+					run_worker(w);
+			},
+			1);
+#elif defined(POLYFEM_WITH_TBB)
+		tbb::parallel_for(0, n_workers, [&](int w) {
+			tbb::task_arena arena(worker_threads);
+			arena.execute([&]() { run_worker(w); });
+		});
+#else
+		for (int w = 0; w < n_workers; ++w)
+			run_worker(w);
+#endif
+
+		results = json::array();
+		for (auto &j : variant_results)
+			results.push_back(std::move(j));
+	}
+} // namespace polyfem
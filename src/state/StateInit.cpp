@@ -4,6 +4,7 @@
 #include <polyfem/auto_q_bases.hpp>
 
 #include <polyfem/Logger.hpp>
+#include <polyfem/par_for.hpp>
 #include <polyfem/KernelProblem.hpp>
 
 #include <polysolve/LinearSolver.hpp>
@@ -106,6 +107,7 @@ namespace polyfem
 			{"project_to_psd", false},
 			{"use_al", false},
 			{"min_component", -1},
+			{"boundary_cache", ""},
 
 			{"has_collision", false},
 			{"dhat", 1e-3},
@@ -122,7 +124,11 @@ namespace polyfem
 			{"time_integrator", "ImplicitEuler"},
 			{"time_integrator_params",
 			 {{"gamma", 0.5},
-			  {"beta", 0.25}}},
+			  {"beta", 0.25},
+			  {"cfl", 0.5}}},
+			{"predictor", "previous"},
+			{"predictor_history", 3},
+			{"adaptive_time_step", {{"enabled", false}, {"tolerance", 1e-3}, {"min_dt_factor", 1e-3}, {"max_dt_factor", 50}, {"target_newton_iterations", 10}}},
 
 			{"scalar_formulation", "Laplacian"},
 			{"tensor_formulation", "LinearElasticity"},
@@ -143,6 +149,8 @@ namespace polyfem
 			{"iso_parametric", false},
 			{"integral_constraints", 2},
 			{"cache_size", 1000000},
+			{"max_threads", 0},
+			{"pin_threads", false},
 			{"al_weight", 1e6},
 			{"max_al_weight", 1e11},
 
@@ -154,6 +162,8 @@ namespace polyfem
 			{"precond_type", LinearSolver::defaultPrecond()},
 			{"solver_params", json({})},
 
+			{"static_condensation", false},
+
 			{"rhs_solver_type", LinearSolver::defaultSolver()},
 			{"rhs_precond_type", LinearSolver::defaultPrecond()},
 			{"rhs_solver_params", json({})},
@@ -183,6 +193,8 @@ namespace polyfem
 			  {"Ds", {9.4979, 1000000}}}},
 
 			{"problem_params", json({})},
+			{"load_cases", json::array()},
+			{"ensemble", json::array()},
 
 			{"output", ""},
 			// {"solution", ""},
@@ -203,6 +215,9 @@ namespace polyfem
 			  {"material_params", false},
 			  {"body_ids", false},
 			  {"contact_forces", false},
+			  {"async", false},
+			  {"async_queue_size", 2},
+			  {"vtu_format", "binary"},
 			  {"nodes", ""},
 			  {"wire_mesh", ""},
 			  {"iso_mesh", ""},
@@ -218,6 +233,12 @@ namespace polyfem
 			  {"mises", ""}}}};
 	}
 
+	State::~State()
+	{
+		//the queued exports read the state, they have to finish before any member is destroyed
+		exporter_.reset();
+	}
+
 	void State::init_logger(const std::string &log_file, int log_level, const bool is_quiet)
 	{
 		Logger::init(!is_quiet, log_file);
@@ -275,6 +296,10 @@ namespace polyfem
 			this->args["export"]["solution"] = args_in["solution"];
 		}
 
+		const int max_threads = args["max_threads"];
+		set_n_threads(std::max(0, max_threads), args["pin_threads"]);
+		logger().debug("Using {} threads", get_n_threads());
+
 		if (this->args["has_collision"])
 		{
 			if (!args_in.contains("project_to_psd"))
@@ -344,6 +369,8 @@ namespace polyfem
 		args["export"]["solution_mat"] = resolve_output_path(args["export"]["solution_mat"]);
 		args["export"]["stress_mat"] = resolve_output_path(args["export"]["stress_mat"]);
 		args["export"]["mises"] = resolve_output_path(args["export"]["mises"]);
+
+		settings_.init(args);
 	}
 
 } // namespace polyfem
@@ -11,9 +11,15 @@
 #include <polyfem/auto_q_bases.hpp>
 
 #include <polyfem/Logger.hpp>
+#include <polyfem/par_for.hpp>
 
 #include <igl/AABB.h>
 #include <igl/per_face_normals.h>
+#include <igl/Timer.h>
+
+#ifdef POLYFEM_WITH_TBB
+#include <tbb/parallel_for.h>
+#endif
 
 namespace polyfem
 {
@@ -696,6 +702,37 @@ namespace polyfem
 			return;
 		}
 
+		const int n_nodes = &basis == &bases ? n_bases : (&basis == &pressure_bases ? n_pressure_bases : -1);
+		if (n_nodes > 0 && fun.size() == n_nodes * actual_dim)
+		{
+			const VisOperator &op = vis_interpolation(basis, n_nodes, boundary_only);
+			if (op.rows() == n_points)
+			{
+				result.resize(n_points, actual_dim);
+
+				const auto interpolate = [&](const int start, const int end) {
+					for (int p = start; p < end; ++p)
+					{
+						result.row(p).setZero();
+						for (VisOperator::InnerIterator it(op, p); it; ++it)
+						{
+							for (int d = 0; d < actual_dim; ++d)
+								result(p, d) += it.value() * fun(it.col() * actual_dim + d);
+						}
+					}
+				};
+
+#ifdef POLYFEM_WITH_CPP_THREADS
+				polyfem::par_for(n_points, [&](int start, int end, int t) { interpolate(start, end); });
+#elif defined(POLYFEM_WITH_TBB)
+				tbb::parallel_for(tbb::blocked_range<int>(0, n_points), [&](const tbb::blocked_range<int> &r) { interpolate(r.begin(), r.end()); });
+#else
+				interpolate(0, n_points);
+#endif
+				return;
+			}
+		}
+
 		std::vector<AssemblyValues> tmp;
 
 		result.resize(n_points, actual_dim);
@@ -818,39 +855,14 @@ namespace polyfem
 		result.resize(n_points, 1);
 		assert(!problem->is_scalar());
 
-		int index = 0;
-		const auto &sampler = ref_element_sampler;
-
-		Eigen::MatrixXi vis_faces_poly;
-		Eigen::MatrixXd local_val;
+		const std::string formulation_name = formulation();
 		const auto &gbases = iso_parametric() ? bases : geom_bases;
 
-		for (int i = 0; i < int(bases.size()); ++i)
-		{
-			if (boundary_only && mesh->is_volume() && !mesh->is_boundary_element(i))
-				continue;
-
-			const ElementBases &bs = bases[i];
-			const ElementBases &gbs = gbases[i];
-			Eigen::MatrixXd local_pts;
-
-			if (mesh->is_simplex(i))
-				local_pts = sampler.simplex_points();
-			else if (mesh->is_cube(i))
-				local_pts = sampler.cube_points();
-			else
-			{
-				if (mesh->is_volume())
-					sampler.sample_polyhedron(polys_3d[i].first, polys_3d[i].second, local_pts, vis_faces_poly);
-				else
-					sampler.sample_polygon(polys[i], local_pts, vis_faces_poly);
-			}
-
-			assembler.compute_scalar_value(formulation(), i, bs, gbs, local_pts, fun, local_val);
-
-			result.block(index, 0, local_val.rows(), 1) = local_val;
-			index += local_val.rows();
-		}
+		for_each_vis_element(boundary_only, [&](const int i, const Eigen::MatrixXd &local_pts, const int offset) {
+			Eigen::MatrixXd local_val;
+			assembler.compute_scalar_value(formulation_name, i, bases[i], gbases[i], local_pts, fun, local_val);
+			result.block(offset, 0, local_val.rows(), 1) = local_val;
+		});
 	}
 
 	void State::compute_tensor_value(const int n_points, const Eigen::MatrixXd &fun, Eigen::MatrixXd &result, const bool boundary_only)
@@ -870,38 +882,126 @@ namespace polyfem
 		result.resize(n_points, actual_dim * actual_dim);
 		assert(!problem->is_scalar());
 
-		int index = 0;
-		const auto &sampler = ref_element_sampler;
+		const std::string formulation_name = formulation();
+		const auto &gbases = iso_parametric() ? bases : geom_bases;
 
+		for_each_vis_element(boundary_only, [&](const int i, const Eigen::MatrixXd &local_pts, const int offset) {
+			Eigen::MatrixXd local_val;
+			assembler.compute_tensor_value(formulation_name, i, bases[i], gbases[i], local_pts, fun, local_val);
+			result.block(offset, 0, local_val.rows(), local_val.cols()) = local_val;
+		});
+	}
+
+	void State::vis_local_points(const int i, Eigen::MatrixXd &local_pts) const
+	{
+		const auto &sampler = ref_element_sampler;
 		Eigen::MatrixXi vis_faces_poly;
-		Eigen::MatrixXd local_val;
-		const auto &gbases = iso_parametric() ? bases : geom_bases;
 
-		for (int i = 0; i < int(bases.size()); ++i)
+		if (mesh->is_simplex(i))
+			local_pts = sampler.simplex_points();
+		else if (mesh->is_cube(i))
+			local_pts = sampler.cube_points();
+		else
+		{
+			if (mesh->is_volume())
+				sampler.sample_polyhedron(polys_3d.at(i).first, polys_3d.at(i).second, local_pts, vis_faces_poly);
+			else
+				sampler.sample_polygon(polys.at(i), local_pts, vis_faces_poly);
+		}
+	}
+
+	void State::for_each_vis_element(const bool boundary_only, const std::function<void(const int, const Eigen::MatrixXd &, const int)> &func) const
+	{
+		const int n_elements = int(bases.size());
+
+		//the samples of simplices and cubes are the ones of the sampler, the polygons are sampled here
+		std::vector<const Eigen::MatrixXd *> local_pts(n_elements, nullptr);
+		std::map<int, Eigen::MatrixXd> poly_pts;
+		std::vector<int> offsets(n_elements, -1);
+		int n_points = 0;
+
+		for (int i = 0; i < n_elements; ++i)
 		{
 			if (boundary_only && mesh->is_volume() && !mesh->is_boundary_element(i))
 				continue;
 
-			const ElementBases &bs = bases[i];
-			const ElementBases &gbs = gbases[i];
-			Eigen::MatrixXd local_pts;
-
 			if (mesh->is_simplex(i))
-				local_pts = sampler.simplex_points();
+				local_pts[i] = &ref_element_sampler.simplex_points();
 			else if (mesh->is_cube(i))
-				local_pts = sampler.cube_points();
+				local_pts[i] = &ref_element_sampler.cube_points();
 			else
 			{
-				if (mesh->is_volume())
-					sampler.sample_polyhedron(polys_3d[i].first, polys_3d[i].second, local_pts, vis_faces_poly);
-				else
-					sampler.sample_polygon(polys[i], local_pts, vis_faces_poly);
+				vis_local_points(i, poly_pts[i]);
+				local_pts[i] = &poly_pts[i];
+			}
+
+			offsets[i] = n_points;
+			n_points += local_pts[i]->rows();
+		}
+
+		const auto run = [&](const int start, const int end) {
+			for (int i = start; i < end; ++i)
+			{
+				if (offsets[i] >= 0)
+					func(i, *local_pts[i], offsets[i]);
 			}
+		};
+
+#ifdef POLYFEM_WITH_CPP_THREADS
+		polyfem::par_for(n_elements, [&](int start, int end, int t) { run(start, end); });
+#elif defined(POLYFEM_WITH_TBB)
+		tbb::parallel_for(tbb::blocked_range<int>(0, n_elements), [&](const tbb::blocked_range<int> &r) { run(r.begin(), r.end()); });
+#else
+		run(0, n_elements);
+#endif
+	}
+
+	const State::VisOperator &State::vis_interpolation(const std::vector<ElementBases> &basis, const int n_nodes, const bool boundary_only)
+	{
+		//lookup without insertion, the export thread only finds the operators built by build_vis_cache
+		const auto key = std::make_pair(&basis, boundary_only);
+		const auto found = vis_interpolation_.find(key);
+		if (found != vis_interpolation_.end() && found->second.rows() > 0 && found->second.cols() == n_nodes)
+			return found->second;
+
+		VisOperator &op = vis_interpolation_[key];
+
+		igl::Timer timer;
+		timer.start();
+
+		std::vector<Eigen::Triplet<double>> entries;
+		std::vector<AssemblyValues> tmp;
+		MatrixXd local_pts;
+		int n_points = 0;
+
+		for (int i = 0; i < int(basis.size()); ++i)
+		{
+			if (boundary_only && mesh->is_volume() && !mesh->is_boundary_element(i))
+				continue;
+
+			const ElementBases &bs = basis[i];
+			vis_local_points(i, local_pts);
+			bs.evaluate_bases(local_pts, tmp);
 
-			assembler.compute_tensor_value(formulation(), i, bs, gbs, local_pts, fun, local_val);
+			for (size_t j = 0; j < bs.bases.size(); ++j)
+			{
+				for (const auto &g : bs.bases[j].global())
+				{
+					for (int p = 0; p < local_pts.rows(); ++p)
+						entries.emplace_back(n_points + p, g.index, g.val * tmp[j].val(p));
+				}
+			}
 
-			result.block(index, 0, local_val.rows(), local_val.cols()) = local_val;
-			index += local_val.rows();
+			n_points += local_pts.rows();
 		}
+
+		op.resize(n_points, n_nodes);
+		op.setFromTriplets(entries.begin(), entries.end());
+		op.makeCompressed();
+
+		timer.stop();
+		logger().debug("Visualization operator {}x{} ({} nonzeros) built in {}s", op.rows(), op.cols(), op.nonZeros(), timer.getElapsedTimeInSec());
+
+		return op;
 	}
 } // namespace polyfem
\ No newline at end of file
@@ -5,30 +5,128 @@
 
 #include <polyfem/VTUWriter.hpp>
 #include <polyfem/MeshUtils.hpp>
-
-// #ifdef POLYFEM_WITH_TBB
-// #include <tbb/task_scheduler_init.h>
-// #endif
+#include <polyfem/MatrixUtils.hpp>
 
 #include <igl/remove_unreferenced.h>
 #include <igl/remove_duplicate_vertices.h>
 #include <igl/isolines.h>
 #include <igl/write_triangle_mesh.h>
-#include <igl/edges.h>
-#include <igl/facet_adjacency_matrix.h>
-#include <igl/connected_components.h>
+#include <igl/Timer.h>
 
-#include <ipc/utils/faces_to_edges.hpp>
 #include <ipc/ipc.hpp>
 
 #include <ghc/fs_std.hpp> // filesystem
 
 #include <tinyxml2.h>
 
+#include <array>
+
+#ifdef POLYFEM_WITH_TBB
+#include <tbb/parallel_for.h>
+#endif
+
 extern "C" size_t getPeakRSS();
 
 namespace polyfem
 {
+	namespace
+	{
+		//vtu_format of the export args: "binary" (base64 inside the xml), "appended" (raw after the xml) or "compressed" (appended, zlib)
+		void set_vtu_format(const std::string &format, VTUWriter &writer)
+		{
+			if (format == "appended" || format == "compressed")
+				writer.set_appended(true, format == "compressed");
+			else if (format != "binary")
+				logger().warn("Unknown vtu_format {}, using binary", format);
+		}
+
+		template <typename T>
+		void hash_combine(std::size_t &seed, const T &v)
+		{
+			seed ^= std::hash<T>()(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+		}
+
+		//sub-triangles of a boundary face of a P1 to P4 tetrahedron, from its boundary nodes
+		void triangulate_boundary_face(const std::vector<int> &loc_nodes, std::vector<std::array<int, 3>> &tris)
+		{
+			if (loc_nodes.size() == 3)
+			{
+				tris.push_back({{loc_nodes[0], loc_nodes[1], loc_nodes[2]}});
+			}
+			else if (loc_nodes.size() == 6)
+			{
+				tris.push_back({{loc_nodes[0], loc_nodes[3], loc_nodes[5]}});
+				tris.push_back({{loc_nodes[3], loc_nodes[1], loc_nodes[4]}});
+				tris.push_back({{loc_nodes[4], loc_nodes[2], loc_nodes[5]}});
+				tris.push_back({{loc_nodes[3], loc_nodes[4], loc_nodes[5]}});
+			}
+			else if (loc_nodes.size() == 10)
+			{
+				tris.push_back({{loc_nodes[0], loc_nodes[3], loc_nodes[8]}});
+				tris.push_back({{loc_nodes[3], loc_nodes[4], loc_nodes[9]}});
+				tris.push_back({{loc_nodes[4], loc_nodes[1], loc_nodes[5]}});
+				tris.push_back({{loc_nodes[5], loc_nodes[6], loc_nodes[9]}});
+				tris.push_back({{loc_nodes[6], loc_nodes[2], loc_nodes[7]}});
+				tris.push_back({{loc_nodes[7], loc_nodes[8], loc_nodes[9]}});
+				tris.push_back({{loc_nodes[8], loc_nodes[3], loc_nodes[9]}});
+				tris.push_back({{loc_nodes[9], loc_nodes[4], loc_nodes[5]}});
+				tris.push_back({{loc_nodes[6], loc_nodes[7], loc_nodes[9]}});
+			}
+			else if (loc_nodes.size() == 15)
+			{
+				tris.push_back({{loc_nodes[0], loc_nodes[3], loc_nodes[11]}});
+				tris.push_back({{loc_nodes[3], loc_nodes[4], loc_nodes[12]}});
+				tris.push_back({{loc_nodes[3], loc_nodes[12], loc_nodes[11]}});
+				tris.push_back({{loc_nodes[12], loc_nodes[10], loc_nodes[11]}});
+				tris.push_back({{loc_nodes[4], loc_nodes[5], loc_nodes[13]}});
+				tris.push_back({{loc_nodes[4], loc_nodes[13], loc_nodes[12]}});
+				tris.push_back({{loc_nodes[12], loc_nodes[13], loc_nodes[14]}});
+				tris.push_back({{loc_nodes[12], loc_nodes[14], loc_nodes[10]}});
+				tris.push_back({{loc_nodes[14], loc_nodes[9], loc_nodes[10]}});
+				tris.push_back({{loc_nodes[5], loc_nodes[1], loc_nodes[6]}});
+				tris.push_back({{loc_nodes[5], loc_nodes[6], loc_nodes[13]}});
+				tris.push_back({{loc_nodes[6], loc_nodes[7], loc_nodes[13]}});
+				tris.push_back({{loc_nodes[13], loc_nodes[7], loc_nodes[14]}});
+				tris.push_back({{loc_nodes[7], loc_nodes[8], loc_nodes[14]}});
+				tris.push_back({{loc_nodes[14], loc_nodes[8], loc_nodes[9]}});
+				tris.push_back({{loc_nodes[8], loc_nodes[2], loc_nodes[9]}});
+			}
+			else
+			{
+				logger().error("unsupported boundary face with {} nodes", loc_nodes.size());
+				assert(false);
+			}
+		}
+
+		bool read_boundary_cache(const std::string &prefix, const Eigen::MatrixXi &header, Eigen::MatrixXd &V, Eigen::MatrixXi &F, Eigen::MatrixXi &E, Eigen::MatrixXi &FE)
+		{
+			if (!fs::exists(prefix + "_header.bin"))
+				return false;
+
+			Eigen::MatrixXi cached_header;
+			if (!read_matrix_binary(prefix + "_header.bin", cached_header) || cached_header != header)
+			{
+				logger().debug("Boundary cache {} does not match the mesh, rebuilding it", prefix);
+				return false;
+			}
+
+			return read_matrix_binary(prefix + "_nodes.bin", V)
+				   && read_matrix_binary(prefix + "_triangles.bin", F)
+				   && read_matrix_binary(prefix + "_edges.bin", E)
+				   && read_matrix_binary(prefix + "_faces_to_edges.bin", FE);
+		}
+
+		void write_boundary_cache(const std::string &prefix, const Eigen::MatrixXi &header, const Eigen::MatrixXd &V, const Eigen::MatrixXi &F, const Eigen::MatrixXi &E, const Eigen::MatrixXi &FE)
+		{
+			//the header goes last, so that an interrupted write is not read back
+			if (write_matrix_binary(prefix + "_nodes.bin", V)
+				&& write_matrix_binary(prefix + "_triangles.bin", F)
+				&& write_matrix_binary(prefix + "_edges.bin", E)
+				&& write_matrix_binary(prefix + "_faces_to_edges.bin", FE))
+				write_matrix_binary(prefix + "_header.bin", header);
+		}
+	} // namespace
+
 	void State::get_sidesets(Eigen::MatrixXd &pts, Eigen::MatrixXi &faces, Eigen::MatrixXd &sidesets)
 	{
 		if (!mesh)
@@ -328,192 +426,164 @@ namespace polyfem
 		auto &boundary_nodes_pos_ = (!for_pressure) ? boundary_nodes_pos : boundary_nodes_pos_pressure;
 		if (!for_pressure)
 			boundary_faces_to_edges.resize(0, 0);
-		if (mesh->is_volume())
+
+		const int dim = mesh->dimension();
+		const int min_component = args["min_component"];
+
+		//the cache is valid for the same boundary primitives, vertex positions, number of nodes and filtering
+		const std::string cache = args["boundary_cache"];
+		const std::string cache_prefix = cache.empty() ? "" : resolve_output_path(cache) + (for_pressure ? "_pressure" : "");
+		Eigen::MatrixXi cache_header(1, 6);
+		if (!cache_prefix.empty())
 		{
-			boundary_nodes_pos_.resize(n_bases, 3);
-			boundary_nodes_pos_.setZero();
-			const Mesh3D &mesh3d = *dynamic_cast<Mesh3D *>(mesh.get());
+			std::size_t hash = 0;
+			for (const auto &lb : local_boundary)
+			{
+				hash_combine(hash, lb.element_id());
+				for (int j = 0; j < lb.size(); ++j)
+					hash_combine(hash, lb.global_primitive_id(j));
+			}
+			//the geometry, the same connectivity with moved or transformed vertices gives other node positions
+			hash_combine(hash, mesh->n_vertices());
+			for (int v = 0; v < mesh->n_vertices(); ++v)
+			{
+				const RowVectorNd p = mesh->point(v);
+				for (int d = 0; d < p.size(); ++d)
+					hash_combine(hash, p(d));
+			}
+			cache_header << dim, n_bases, (for_pressure ? n_pressure_bases : 0), min_component, int(hash & 0x7fffffff), int((hash >> 31) & 0x7fffffff);
+
+			Eigen::MatrixXi faces_to_edges;
+			if (read_boundary_cache(cache_prefix, cache_header, boundary_nodes_pos_, boundary_triangles_, boundary_edges_, faces_to_edges))
+			{
+				if (!for_pressure)
+					boundary_faces_to_edges = faces_to_edges;
+				logger().debug("Loaded boundary mesh from {}", cache_prefix);
+				return;
+			}
+		}
 
-			std::vector<std::tuple<int, int, int>> tris;
+		igl::Timer timer;
+		timer.start();
 
-			for (auto it = local_boundary.begin(); it != local_boundary.end(); ++it)
+		//nodes and primitives of every local boundary are extracted in parallel and gathered in order
+		const int n_local_boundary = local_boundary.size();
+		const Mesh3D *mesh3d = mesh->is_volume() ? dynamic_cast<Mesh3D *>(mesh.get()) : nullptr;
+		const Mesh2D *mesh2d = mesh->is_volume() ? nullptr : dynamic_cast<Mesh2D *>(mesh.get());
+		std::vector<std::vector<const Local2Global *>> lb_nodes(n_local_boundary);
+		std::vector<std::vector<std::array<int, 3>>> lb_primitives(n_local_boundary);
+
+		const auto extract_local_boundary = [&](const int i) {
+			const auto &lb = local_boundary[i];
+			const auto &b = (!for_pressure) ? bases[lb.element_id()] : pressure_bases[lb.element_id()];
+			auto &nodes_out = lb_nodes[i];
+			auto &primitives = lb_primitives[i];
+
+			for (int j = 0; j < lb.size(); ++j)
 			{
-				const auto &lb = *it;
-				const auto &b = (!for_pressure) ? bases[lb.element_id()] : pressure_bases[lb.element_id()];
+				const int eid = lb.global_primitive_id(j);
 
-				for (int j = 0; j < lb.size(); ++j)
+				if (mesh->is_volume())
 				{
-					const int eid = lb.global_primitive_id(j);
-					const int lid = lb[j];
-					const auto nodes = b.local_nodes_for_primitive(eid, mesh3d);
-
 					if (!mesh->is_simplex(lb.element_id()))
 					{
 						logger().trace("skipping element {} since it is not a simplex", eid);
 						continue;
 					}
 
+					const auto nodes = b.local_nodes_for_primitive(eid, *mesh3d);
 					std::vector<int> loc_nodes;
-
 					for (long n = 0; n < nodes.size(); ++n)
 					{
-						auto &bs = b.bases[nodes(n)];
-						const auto &glob = bs.global();
+						const auto &glob = b.bases[nodes(n)].global();
 						if (glob.size() != 1)
 							continue;
 
-						int gindex = glob.front().index;
-						boundary_nodes_pos_.row(gindex) = glob.front().node;
-						loc_nodes.push_back(gindex);
+						nodes_out.push_back(&glob.front());
+						loc_nodes.push_back(glob.front().index);
 					}
 
-					if (loc_nodes.size() == 3)
-					{
-						tris.emplace_back(loc_nodes[0], loc_nodes[1], loc_nodes[2]);
-					}
-					else if (loc_nodes.size() == 6)
-					{
-						tris.emplace_back(loc_nodes[0], loc_nodes[3], loc_nodes[5]);
-						tris.emplace_back(loc_nodes[3], loc_nodes[1], loc_nodes[4]);
-						tris.emplace_back(loc_nodes[4], loc_nodes[2], loc_nodes[5]);
-						tris.emplace_back(loc_nodes[3], loc_nodes[4], loc_nodes[5]);
-					}
-					else if (loc_nodes.size() == 10)
-					{
-						tris.emplace_back(loc_nodes[0], loc_nodes[3], loc_nodes[8]);
-						tris.emplace_back(loc_nodes[3], loc_nodes[4], loc_nodes[9]);
-						tris.emplace_back(loc_nodes[4], loc_nodes[1], loc_nodes[5]);
-						tris.emplace_back(loc_nodes[5], loc_nodes[6], loc_nodes[9]);
-						tris.emplace_back(loc_nodes[6], loc_nodes[2], loc_nodes[7]);
-						tris.emplace_back(loc_nodes[7], loc_nodes[8], loc_nodes[9]);
-						tris.emplace_back(loc_nodes[8], loc_nodes[3], loc_nodes[9]);
-						tris.emplace_back(loc_nodes[9], loc_nodes[4], loc_nodes[5]);
-						tris.emplace_back(loc_nodes[6], loc_nodes[7], loc_nodes[9]);
-					}
-					else if (loc_nodes.size() == 15)
-					{
-						tris.emplace_back(loc_nodes[0], loc_nodes[3], loc_nodes[11]);
-						tris.emplace_back(loc_nodes[3], loc_nodes[4], loc_nodes[12]);
-						tris.emplace_back(loc_nodes[3], loc_nodes[12], loc_nodes[11]);
-						tris.emplace_back(loc_nodes[12], loc_nodes[10], loc_nodes[11]);
-						tris.emplace_back(loc_nodes[4], loc_nodes[5], loc_nodes[13]);
-						tris.emplace_back(loc_nodes[4], loc_nodes[13], loc_nodes[12]);
-						tris.emplace_back(loc_nodes[12], loc_nodes[13], loc_nodes[14]);
-						tris.emplace_back(loc_nodes[12], loc_nodes[14], loc_nodes[10]);
-						tris.emplace_back(loc_nodes[14], loc_nodes[9], loc_nodes[10]);
-						tris.emplace_back(loc_nodes[5], loc_nodes[1], loc_nodes[6]);
-						tris.emplace_back(loc_nodes[5], loc_nodes[6], loc_nodes[13]);
-						tris.emplace_back(loc_nodes[6], loc_nodes[7], loc_nodes[13]);
-						tris.emplace_back(loc_nodes[13], loc_nodes[7], loc_nodes[14]);
-						tris.emplace_back(loc_nodes[7], loc_nodes[8], loc_nodes[14]);
-						tris.emplace_back(loc_nodes[14], loc_nodes[8], loc_nodes[9]);
-						tris.emplace_back(loc_nodes[8], loc_nodes[2], loc_nodes[9]);
-					}
-					else
-					{
-						std::cout << loc_nodes.size() << std::endl;
-						assert(false);
-					}
+					triangulate_boundary_face(loc_nodes, primitives);
 				}
-			}
-
-			boundary_triangles_.resize(tris.size(), 3);
-			for (int i = 0; i < tris.size(); ++i)
-			{
-				boundary_triangles_.row(i) << std::get<0>(tris[i]), std::get<2>(tris[i]), std::get<1>(tris[i]);
-			}
-
-			if (args["min_component"] > 0)
-			{
-				Eigen::SparseMatrix<int> adj;
-				igl::facet_adjacency_matrix(boundary_triangles_, adj);
-				Eigen::MatrixXi C, counts;
-				igl::connected_components(adj, C, counts);
-
-				std::vector<int> valid;
-				const int min_count = args["min_component"];
-
-				for (int i = 0; i < counts.size(); ++i)
+				else
 				{
-					if (counts(i) >= min_count)
+					const auto nodes = b.local_nodes_for_primitive(eid, *mesh2d);
+					int prev_node = -1;
+					for (long n = 0; n < nodes.size(); ++n)
 					{
-						valid.push_back(i);
-					}
-				}
+						const auto &glob = b.bases[nodes(n)].global();
+						if (glob.size() != 1)
+							continue;
 
-				tris.clear();
-				for (int i = 0; i < C.size(); ++i)
-				{
-					for (int v : valid)
-					{
-						if (v == C(i))
-						{
-							tris.emplace_back(boundary_triangles_(i, 0), boundary_triangles_(i, 1), boundary_triangles_(i, 2));
-							break;
-						}
+						const int gindex = glob.front().index;
+						nodes_out.push_back(&glob.front());
+						if (prev_node >= 0)
+							primitives.push_back({{prev_node, gindex, -1}});
+						prev_node = gindex;
 					}
 				}
-
-				boundary_triangles_.resize(tris.size(), 3);
-				for (int i = 0; i < tris.size(); ++i)
-				{
-					boundary_triangles_.row(i) << std::get<0>(tris[i]), std::get<1>(tris[i]), std::get<2>(tris[i]);
-				}
 			}
+		};
+
+#ifdef POLYFEM_WITH_CPP_THREADS
+		polyfem::par_for(n_local_boundary, [&](int start, int end, int t) {
+			for (int i = start; i < end; ++i)
+				extract_local_boundary(i);
+		});
+#elif defined(POLYFEM_WITH_TBB)
+		tbb::parallel_for(tbb::blocked_range<int>(0, n_local_boundary), [&](const tbb::blocked_range<int> &r) {
+			for (int i = r.begin(); i != r.end(); ++i)
+				extract_local_boundary(i);
+		});
+#else
+		for (int i = 0; i < n_local_boundary; ++i)
+			extract_local_boundary(i);
+#endif
 
-			if (boundary_triangles_.rows() > 0)
+		boundary_nodes_pos_.resize(n_bases, dim);
+		boundary_nodes_pos_.setZero();
+		int n_primitives = 0;
+		for (int i = 0; i < n_local_boundary; ++i)
+		{
+			for (const auto *g : lb_nodes[i])
+				boundary_nodes_pos_.row(g->index) = g->node.head(dim);
+			n_primitives += lb_primitives[i].size();
+		}
+
+		if (mesh->is_volume())
+		{
+			boundary_triangles_.resize(n_primitives, 3);
+			int index = 0;
+			for (const auto &primitives : lb_primitives)
 			{
-				igl::edges(boundary_triangles_, boundary_edges_);
-				boundary_faces_to_edges = ipc::faces_to_edges(boundary_triangles_, boundary_edges_);
+				for (const auto &t : primitives)
+					boundary_triangles_.row(index++) << t[0], t[2], t[1];
 			}
 
+			Eigen::MatrixXi faces_to_edges;
+			boundary_faces_and_edges(min_component, boundary_triangles_, boundary_edges_, faces_to_edges);
+			if (!for_pressure)
+				boundary_faces_to_edges = faces_to_edges;
+
 			// igl::write_triangle_mesh("test.obj", boundary_nodes_pos_, boundary_triangles_);
 		}
 		else
 		{
-			boundary_nodes_pos_.resize(n_bases, 2);
-			boundary_nodes_pos_.setZero();
-			const Mesh2D &mesh2d = *dynamic_cast<Mesh2D *>(mesh.get());
-
-			std::vector<std::pair<int, int>> edges;
-
-			for (auto it = local_boundary.begin(); it != local_boundary.end(); ++it)
-			{
-				const auto &lb = *it;
-				const auto &b = (!for_pressure) ? bases[lb.element_id()] : pressure_bases[lb.element_id()];
-
-				for (int j = 0; j < lb.size(); ++j)
-				{
-					const int eid = lb.global_primitive_id(j);
-					const int lid = lb[j];
-					const auto nodes = b.local_nodes_for_primitive(eid, mesh2d);
-
-					int prev_node = -1;
-
-					for (long n = 0; n < nodes.size(); ++n)
-					{
-						auto &bs = b.bases[nodes(n)];
-						const auto &glob = bs.global();
-						if (glob.size() != 1)
-							continue;
-
-						int gindex = glob.front().index;
-						boundary_nodes_pos_.row(gindex) << glob.front().node(0), glob.front().node(1);
-
-						if (prev_node >= 0)
-							edges.emplace_back(prev_node, gindex);
-						prev_node = gindex;
-					}
-				}
-			}
-
 			boundary_triangles_.resize(0, 0);
-			boundary_edges_.resize(edges.size(), 2);
-			for (int i = 0; i < edges.size(); ++i)
+			boundary_edges_.resize(n_primitives, 2);
+			int index = 0;
+			for (const auto &primitives : lb_primitives)
 			{
-				boundary_edges_.row(i) << edges[i].first, edges[i].second;
+				for (const auto &e : primitives)
+					boundary_edges_.row(index++) << e[0], e[1];
 			}
 		}
+
+		timer.stop();
+		logger().debug("Boundary mesh extraction took {}s ({} triangles, {} edges)", timer.getElapsedTime(), boundary_triangles_.rows(), boundary_edges_.rows());
+
+		if (!cache_prefix.empty())
+			write_boundary_cache(cache_prefix, cache_header, boundary_nodes_pos_, boundary_triangles_, boundary_edges_, for_pressure ? Eigen::MatrixXi() : boundary_faces_to_edges);
 	}
 
 	std::string State::resolve_output_path(const std::string &path)
@@ -679,10 +749,8 @@ namespace polyfem
 		j["sol_min"] = mmin;
 		j["sol_max"] = mmax;
 
-#if defined(POLYFEM_WITH_CPP_THREADS)
+#if defined(POLYFEM_WITH_CPP_THREADS) || defined(POLYFEM_WITH_TBB)
 		j["num_threads"] = polyfem::get_n_threads();
-#elif defined(POLYFEM_WITH_TBB)
-		j["num_threads"] = std::thread::hardware_concurrency(); //tbb::task_scheduler_init::default_num_threads();
 #else
 		j["num_threads"] = 1;
 #endif
@@ -936,7 +1004,59 @@ namespace polyfem
 		assert(tet_index == tets.rows());
 	}
 
-	void State::save_vtu(const std::string &path, const double t)
+	//the export thread always finds the mesh built by build_vis_cache
+	const State::VisMesh &State::vis_mesh(const bool boundary_only)
+	{
+		if (!vis_mesh_.built || vis_mesh_.boundary_only != boundary_only)
+		{
+			igl::Timer timer;
+			timer.start();
+			build_vis_mesh(vis_mesh_.points, vis_mesh_.tets, vis_mesh_.el_id, vis_mesh_.discr);
+			vis_mesh_.boundary_only = boundary_only;
+			vis_mesh_.built = true;
+			timer.stop();
+			logger().debug("Visualization mesh with {} points built in {}s", vis_mesh_.points.rows(), timer.getElapsedTimeInSec());
+		}
+
+		return vis_mesh_;
+	}
+
+	void State::build_vis_cache(const bool boundary_only)
+	{
+		if (!mesh || n_bases <= 0)
+			return;
+
+		vis_mesh(boundary_only);
+		vis_interpolation(bases, n_bases, boundary_only);
+		//save_wire samples the whole mesh
+		vis_interpolation(bases, n_bases, false);
+		if (assembler.is_mixed(formulation()))
+			vis_interpolation(pressure_bases, n_pressure_bases, boundary_only);
+	}
+
+	State::ExportOptions State::export_options() const
+	{
+		const json &export_args = args.at("export");
+
+		ExportOptions options;
+		options.vis_boundary_only = export_args.at("vis_boundary_only");
+		options.material_params = export_args.at("material_params");
+		options.body_ids = export_args.at("body_ids");
+		options.sol_on_grid = export_args.at("sol_on_grid") > 0;
+		options.surface = export_args.at("surface");
+		options.contact_forces = export_args.at("contact_forces");
+		options.use_spline = args.at("use_spline");
+		options.vtu_format = export_args.at("vtu_format");
+		options.dhat = args.at("dhat");
+		return options;
+	}
+
+	void State::save_vtu(const std::string &path, const double t, const Eigen::MatrixXd &solution, const Eigen::MatrixXd &pressure_solution)
+	{
+		save_vtu(path, t, solution, pressure_solution, export_options());
+	}
+
+	void State::save_vtu(const std::string &path, const double t, const Eigen::MatrixXd &solution, const Eigen::MatrixXd &pressure_solution, const ExportOptions &options)
 	{
 		if (!mesh)
 		{
@@ -954,26 +1074,22 @@ namespace polyfem
 			logger().error("Assemble the rhs first!");
 			return;
 		}
-		if (sol.size() <= 0)
+		if (solution.size() <= 0)
 		{
 			logger().error("Solve the problem first!");
 			return;
 		}
 
-		Eigen::MatrixXd points;
-		Eigen::MatrixXi tets;
-		Eigen::MatrixXi el_id;
-		Eigen::MatrixXd discr;
-
-		build_vis_mesh(points, tets, el_id, discr);
+		const bool boundary_only = options.vis_boundary_only;
+		const VisMesh &vis = vis_mesh(boundary_only);
+		const Eigen::MatrixXd &points = vis.points;
+		const Eigen::MatrixXi &tets = vis.tets;
+		const Eigen::MatrixXi &el_id = vis.el_id;
+		const Eigen::MatrixXd &discr = vis.discr;
 
 		Eigen::MatrixXd fun, exact_fun, err;
-		const bool boundary_only = args["export"]["vis_boundary_only"];
-		const bool material_params = args["export"]["material_params"];
-		const bool body_ids = args["export"]["body_ids"];
-		const bool sol_on_grid = args["export"]["sol_on_grid"] > 0;
 
-		if (sol_on_grid)
+		if (options.sol_on_grid)
 		{
 			const int problem_dim = problem->is_scalar() ? 1 : mesh->dimension();
 			Eigen::MatrixXd tmp, tmp_grad;
@@ -998,14 +1114,14 @@ namespace polyfem
 				Eigen::MatrixXd pt(1, bc.cols() - 1);
 				for (int d = 1; d < bc.cols(); ++d)
 					pt(d - 1) = bc(d);
-				interpolate_at_local_vals(el_id, pt, tmp, tmp_grad);
+				interpolate_at_local_vals(el_id, pt, solution, tmp, tmp_grad);
 
 				res.row(i) = tmp;
 				res_grad.row(i) = tmp_grad;
 
 				if (assembler.is_mixed(formulation()))
 				{
-					interpolate_at_local_vals(el_id, 1, pressure_bases, pt, pressure, tmp_p, tmp_grad_p);
+					interpolate_at_local_vals(el_id, 1, pressure_bases, pt, pressure_solution, tmp_p, tmp_grad_p);
 					res_p.row(i) = tmp_p;
 					res_grad_p.row(i) = tmp_grad_p;
 				}
@@ -1030,7 +1146,7 @@ namespace polyfem
 			}
 		}
 
-		interpolate_function(points.rows(), sol, fun, boundary_only);
+		interpolate_function(points.rows(), solution, fun, boundary_only);
 
 		if (problem->has_exact_sol())
 		{
@@ -1039,6 +1155,7 @@ namespace polyfem
 		}
 
 		VTUWriter writer;
+		set_vtu_format(options.vtu_format, writer);
 
 		if (solve_export_to_file && fun.cols() != 1 && !mesh->is_volume())
 		{
@@ -1058,7 +1175,7 @@ namespace polyfem
 		if (assembler.is_mixed(formulation()))
 		{
 			Eigen::MatrixXd interp_p;
-			interpolate_function(points.rows(), 1, pressure_bases, pressure, interp_p, boundary_only);
+			interpolate_function(points.rows(), 1, pressure_bases, pressure_solution, interp_p, boundary_only);
 			if (solve_export_to_file)
 				writer.add_field("pressure", interp_p);
 			else
@@ -1084,7 +1201,7 @@ namespace polyfem
 		if (fun.cols() != 1)
 		{
 			Eigen::MatrixXd vals, tvals;
-			compute_scalar_value(points.rows(), sol, vals, boundary_only);
+			compute_scalar_value(points.rows(), solution, vals, boundary_only);
 			if (solve_export_to_file)
 				writer.add_field("scalar_value", vals);
 			else
@@ -1092,7 +1209,7 @@ namespace polyfem
 
 			if (solve_export_to_file)
 			{
-				compute_tensor_value(points.rows(), sol, tvals, boundary_only);
+				compute_tensor_value(points.rows(), solution, tvals, boundary_only);
 				for (int i = 0; i < tvals.cols(); ++i)
 				{
 					const int ii = (i / mesh->dimension()) + 1;
@@ -1101,9 +1218,9 @@ namespace polyfem
 				}
 			}
 
-			if (!args["use_spline"])
+			if (!options.use_spline)
 			{
-				average_grad_based_function(points.rows(), sol, vals, tvals, boundary_only);
+				average_grad_based_function(points.rows(), solution, vals, tvals, boundary_only);
 				if (solve_export_to_file)
 					writer.add_field("scalar_value_avg", vals);
 				else
@@ -1116,7 +1233,7 @@ namespace polyfem
 			}
 		}
 
-		if (material_params)
+		if (options.material_params)
 		{
 			const LameParameters &params = assembler.lame_params();
 
@@ -1139,7 +1256,7 @@ namespace polyfem
 			writer.add_field("rho", rhos);
 		}
 
-		if (body_ids)
+		if (options.body_ids)
 		{
 
 			Eigen::MatrixXd ids(points.rows(), 1);
@@ -1163,20 +1280,25 @@ namespace polyfem
 			solution_frames.back().connectivity = tets;
 		}
 
-		const bool export_surface = args["export"]["surface"];
-		if (export_surface)
+		if (options.surface)
 		{
-			save_surface(path.substr(0, path.length() - 4) + "_surf.vtu");
+			save_surface(path.substr(0, path.length() - 4) + "_surf.vtu", solution, pressure_solution, options);
 		}
 	}
 
-	void State::save_surface(const std::string &export_surface)
+	void State::save_surface(const std::string &export_surface, const Eigen::MatrixXd &solution, const Eigen::MatrixXd &pressure_solution)
+	{
+		save_surface(export_surface, solution, pressure_solution, export_options());
+	}
+
+	void State::save_surface(const std::string &export_surface, const Eigen::MatrixXd &solution, const Eigen::MatrixXd &pressure_solution, const ExportOptions &options)
 	{
-		const bool material_params = args["export"]["material_params"];
-		const bool body_ids = args["export"]["body_ids"];
-		const bool contact_forces = args["export"]["contact_forces"] && !problem->is_scalar();
+		const bool material_params = options.material_params;
+		const bool body_ids = options.body_ids;
+		const bool contact_forces = options.contact_forces && !problem->is_scalar();
 
 		VTUWriter writer;
+		set_vtu_format(options.vtu_format, writer);
 		Eigen::MatrixXd fun, interp_p, discr, vect;
 
 		Eigen::MatrixXd lsol, lp, lgrad, lpgrad;
@@ -1193,11 +1315,11 @@ namespace polyfem
 		for (int i = 0; i < boundary_vis_vertices.rows(); ++i)
 		{
 			const int el_index = boundary_vis_elements_ids(i);
-			interpolate_at_local_vals(el_index, boundary_vis_local_vertices.row(i), sol, lsol, lgrad);
+			interpolate_at_local_vals(el_index, boundary_vis_local_vertices.row(i), solution, lsol, lgrad);
 			assert(lsol.size() == actual_dim);
 			if (assembler.is_mixed(formulation()))
 			{
-				interpolate_at_local_vals(el_index, 1, pressure_bases, boundary_vis_local_vertices.row(i), pressure, lp, lpgrad);
+				interpolate_at_local_vals(el_index, 1, pressure_bases, boundary_vis_local_vertices.row(i), pressure_solution, lp, lpgrad);
 				assert(lp.size() == 1);
 				interp_p(i) = lp(0);
 			}
@@ -1223,7 +1345,7 @@ namespace polyfem
 				const auto &gbases = iso_parametric() ? bases : geom_bases;
 				const ElementBases &gbs = gbases[el_index];
 				const ElementBases &bs = bases[el_index];
-				assembler.compute_tensor_value(formulation(), el_index, bs, gbs, boundary_vis_local_vertices.row(i), sol, tensor_flat);
+				assembler.compute_tensor_value(formulation(), el_index, bs, gbs, boundary_vis_local_vertices.row(i), solution, tensor_flat);
 				assert(tensor_flat.size() == actual_dim * actual_dim);
 				Map<Eigen::MatrixXd> tensor(tensor_flat.data(), actual_dim, actual_dim);
 				vect.row(i) = boundary_vis_normals.row(i) * tensor;
@@ -1233,28 +1355,29 @@ namespace polyfem
 		if (contact_forces && solve_export_to_file)
 		{
 			const int problem_dim = mesh->dimension();
-			Eigen::MatrixXd displaced(sol.size() / problem_dim, problem_dim);
-			assert(displaced.rows() * problem_dim == sol.size());
-			for (int i = 0; i < sol.size(); i += problem_dim)
+			Eigen::MatrixXd displaced(solution.size() / problem_dim, problem_dim);
+			assert(displaced.rows() * problem_dim == solution.size());
+			for (int i = 0; i < solution.size(); i += problem_dim)
 			{
 				for (int d = 0; d < problem_dim; ++d)
 				{
-					displaced(i / problem_dim, d) = sol(i + d);
+					displaced(i / problem_dim, d) = solution(i + d);
 				}
 			}
-			assert(displaced(0, 0) == sol(0));
-			assert(displaced(0, 1) == sol(1));
+			assert(displaced(0, 0) == solution(0));
+			assert(displaced(0, 1) == solution(1));
 
 			VTUWriter contact_writer;
+			set_vtu_format(options.vtu_format, contact_writer);
 			writer.add_field("solution", displaced);
 
 			displaced += boundary_nodes_pos;
 			ipc::Constraints constraint_set;
 			ipc::construct_constraint_set(boundary_nodes_pos, displaced, boundary_edges, boundary_triangles,
-										  args["dhat"], constraint_set, boundary_faces_to_edges, /*dmin=*/0,
+										  options.dhat, constraint_set, boundary_faces_to_edges, /*dmin=*/0,
 										  ipc::BroadPhaseMethod::HASH_GRID, /*ignore_codimensional_vertices=*/true);
-			const Eigen::MatrixXd cgrad = ipc::compute_barrier_potential_gradient(displaced, boundary_edges, boundary_triangles, constraint_set, args["dhat"]);
-			assert(cgrad.size() == sol.size());
+			const Eigen::MatrixXd cgrad = ipc::compute_barrier_potential_gradient(displaced, boundary_edges, boundary_triangles, constraint_set, options.dhat);
+			assert(cgrad.size() == solution.size());
 
 			Eigen::MatrixXd cgrad_reshaped(cgrad.size() / problem_dim, problem_dim);
 			assert(cgrad_reshaped.rows() * problem_dim == cgrad.size());
@@ -1339,7 +1462,7 @@ namespace polyfem
 		}
 	}
 
-	void State::save_wire(const std::string &name, bool isolines)
+	void State::save_wire(const std::string &name, const Eigen::MatrixXd &solution, bool isolines)
 	{
 		if (!solve_export_to_file) //TODO?
 			return;
@@ -1441,7 +1564,7 @@ namespace polyfem
 		}
 
 		Eigen::MatrixXd fun;
-		interpolate_function(pts_index, sol, fun);
+		interpolate_function(pts_index, solution, fun);
 
 		// Eigen::MatrixXd exact_fun, err;
 
@@ -1474,7 +1597,7 @@ namespace polyfem
 
 		// if (fun.cols() != 1) {
 		// 	Eigen::MatrixXd scalar_val;
-		// 	compute_scalar_value(pts_index, sol, scalar_val);
+		// 	compute_scalar_value(pts_index, solution, scalar_val);
 		// 	writer.add_field("scalar_value", scalar_val);
 		// }
 
@@ -1524,6 +1647,42 @@ namespace polyfem
 		save_edges(name, points, edges);
 	}
 
+	void State::save_timestep(const double time, const int t)
+	{
+		const std::string vtu_path = resolve_output_path(fmt::format("step_{:d}.vtu", t));
+		const std::string wire_path = resolve_output_path(fmt::format("step_{:d}.obj", t));
+
+		//the frames kept in memory are filled by save_vtu in the solver thread
+		const bool async = args.at("export").at("async");
+		if (!async || !solve_export_to_file)
+		{
+			save_vtu(vtu_path, time);
+			save_wire(wire_path);
+			return;
+		}
+
+		if (!exporter_)
+		{
+			const int queue_size = args.at("export").at("async_queue_size");
+			exporter_ = std::make_shared<AsyncExporter>(std::max(1, queue_size));
+		}
+		const ExportOptions options = export_options();
+		build_vis_cache(options.vis_boundary_only);
+
+		//the snapshot of the step and of the export arguments is owned by the job, the caches are built above
+		//and the rest of the state does not change during the solve
+		exporter_->push([this, vtu_path, wire_path, time, options, solution = sol, pressure_solution = pressure]() {
+			save_vtu(vtu_path, time, solution, pressure_solution, options);
+			save_wire(wire_path, solution);
+		});
+	}
+
+	void State::flush_timesteps()
+	{
+		if (exporter_)
+			exporter_->flush();
+	}
+
 	void State::save_pvd(const std::string &name, const std::function<std::string(int)> &vtu_names, int time_steps, double t0, double dt)
 	{
 		FILE *pvd_file = fopen(name.c_str(), "w");
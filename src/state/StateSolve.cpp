@@ -1,6 +1,7 @@
 #include <polyfem/State.hpp>
 
 #include <polyfem/BDF.hpp>
+#include <polyfem/ExplicitCentralDifference.hpp>
 #include <polyfem/TransientNavierStokesSolver.hpp>
 #include <polyfem/OperatorSplittingSolver.hpp>
 #include <polyfem/NavierStokesSolver.hpp>
@@ -8,8 +9,11 @@
 #include <polyfem/NLProblem.hpp>
 #include <polyfem/ALNLProblem.hpp>
 
+#include <polyfem/HybridNewtonSolver.hpp>
+#include <polyfem/LocalContactNewtonSolver.hpp>
 #include <polyfem/LbfgsSolver.hpp>
 #include <polyfem/SparseNewtonDescentSolver.hpp>
+#include <polyfem/StaticCondensation.hpp>
 
 #include <polysolve/LinearSolver.hpp>
 #include <polysolve/FEMSolver.hpp>
@@ -42,6 +46,36 @@ namespace polyfem
 				read_matrix_binary(path, mat);
 			}
 		}
+
+		//replaces the rows and columns of the dirichlet dofs by the identity, as dirichlet_solve does before solving
+		void apply_dirichlet_identity(const std::vector<int> &dirichlet_nodes, StiffnessMatrix &A)
+		{
+			std::vector<bool> is_dirichlet(A.rows(), false);
+			for (const int n : dirichlet_nodes)
+				is_dirichlet[n] = true;
+
+			for (int k = 0; k < A.outerSize(); ++k)
+			{
+				for (StiffnessMatrix::InnerIterator it(A, k); it; ++it)
+				{
+					if (is_dirichlet[it.row()] || is_dirichlet[it.col()])
+						it.valueRef() = it.row() == it.col() ? 1 : 0;
+				}
+			}
+		}
+
+		template <typename ProblemType>
+		std::shared_ptr<cppoptlib::SparseNewtonDescentSolver<ProblemType>> make_nl_solver(const std::string &name, const json &solver_params, const std::string &solver_type, const std::string &precond_type)
+		{
+			if (name == "hybrid")
+				return std::make_shared<cppoptlib::HybridNewtonSolver<ProblemType>>(solver_params, solver_type, precond_type);
+			if (name == "local_contact")
+				return std::make_shared<cppoptlib::LocalContactNewtonSolver<ProblemType>>(solver_params, solver_type, precond_type);
+
+			if (name != "newton")
+				logger().warn("Unknown nl_solver {}, using newton", name);
+			return std::make_shared<cppoptlib::SparseNewtonDescentSolver<ProblemType>>(solver_params, solver_type, precond_type);
+		}
 	} // namespace
 
 	void State::solve_transient_navier_stokes_split(const int time_steps, const double dt, const RhsAssembler &rhs_assembler)
@@ -112,7 +146,7 @@ namespace polyfem
 			logger().info("Advection finished!");
 
 			/* apply boundary condition */
-			rhs_assembler.set_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, sol, time);
+			rhs_assembler.set_bc(local_boundary, boundary_nodes, settings_.n_boundary_samples, local_neumann_boundary, sol, time);
 
 			/* viscosity */
 			logger().info("Solving diffusion...");
@@ -134,15 +168,14 @@ namespace polyfem
 			pressure = pressure / dt;
 
 			/* apply boundary condition */
-			rhs_assembler.set_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, sol, time);
+			rhs_assembler.set_bc(local_boundary, boundary_nodes, settings_.n_boundary_samples, local_neumann_boundary, sol, time);
 
 			/* export to vtu */
 			if (args["save_time_sequence"] && !(t % (int)args["skip_frame"]))
 			{
 				if (!solve_export_to_file)
 					solution_frames.emplace_back();
-				save_vtu(resolve_output_path(fmt::format("step_{:d}.vtu", t)), time);
-				save_wire(resolve_output_path(fmt::format("step_{:d}.obj", t)));
+				save_timestep(time, t);
 			}
 		}
 
@@ -198,8 +231,8 @@ namespace polyfem
 			logger().info("{}/{} steps, dt={}s t={}s", t, time_steps, current_dt, time);
 
 			bdf.rhs(prev_sol);
-			rhs_assembler.compute_energy_grad(local_boundary, boundary_nodes, density, args["n_boundary_samples"], local_neumann_boundary, rhs, time, current_rhs);
-			rhs_assembler.set_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, current_rhs, time);
+			rhs_assembler.compute_energy_grad(local_boundary, boundary_nodes, density, settings_.n_boundary_samples, local_neumann_boundary, rhs, time, current_rhs);
+			rhs_assembler.set_bc(local_boundary, boundary_nodes, settings_.n_boundary_samples, local_neumann_boundary, current_rhs, time);
 
 			const int prev_size = current_rhs.size();
 			if (prev_size != rhs.size())
@@ -219,8 +252,7 @@ namespace polyfem
 			{
 				if (!solve_export_to_file)
 					solution_frames.emplace_back();
-				save_vtu(resolve_output_path(fmt::format("step_{:d}.vtu", t)), time);
-				save_wire(resolve_output_path(fmt::format("step_{:d}.obj", t)));
+				save_timestep(time, t);
 			}
 		}
 
@@ -251,10 +283,15 @@ namespace polyfem
 		solver->setParameters(params);
 		logger().info("{}...", solver->name());
 
-		StiffnessMatrix A;
+		StiffnessMatrix A, A_factorized;
 		Eigen::VectorXd b;
 		Eigen::MatrixXd current_rhs = rhs;
 
+		//the system matrix only depends on alpha/dt, it is factorized once and refactorized when
+		//that changes (BDF start-up or a new dt), fluids need the zero columns removal of dirichlet_solve
+		const bool prefactorize_matrix = !assembler.is_fluid(formulation());
+		double factorized_alpha_dt = 0;
+
 		const int BDF_order = args["BDF_order"];
 		// const int aux_steps = BDF_order-1;
 		BDF bdf(BDF_order);
@@ -269,8 +306,8 @@ namespace polyfem
 			double current_dt = dt;
 
 			logger().info("{}/{} {}s", t, time_steps, time);
-			rhs_assembler.compute_energy_grad(local_boundary, boundary_nodes, density, args["n_boundary_samples"], local_neumann_boundary, rhs, time, current_rhs);
-			rhs_assembler.set_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, current_rhs, time);
+			rhs_assembler.compute_energy_grad(local_boundary, boundary_nodes, density, settings_.n_boundary_samples, local_neumann_boundary, rhs, time, current_rhs);
+			rhs_assembler.set_bc(local_boundary, boundary_nodes, settings_.n_boundary_samples, local_neumann_boundary, current_rhs, time);
 
 			if (assembler.is_mixed(formulation()))
 			{
@@ -279,14 +316,31 @@ namespace polyfem
 				current_rhs.block(current_rhs.rows() - n_pressure_bases - use_avg_pressure, 0, n_pressure_bases + use_avg_pressure, current_rhs.cols()).setZero();
 			}
 
-			A = (bdf.alpha() / current_dt) * mass + stiffness;
+			const double alpha_dt = bdf.alpha() / current_dt;
+			const bool refactorize = alpha_dt != factorized_alpha_dt;
+			if (!prefactorize_matrix || refactorize)
+				A = alpha_dt * mass + stiffness;
 			bdf.rhs(x);
 			b = (mass * x) / current_dt;
 			for (int i : boundary_nodes)
 				b[i] = 0;
 			b += current_rhs;
 
-			spectrum = dirichlet_solve(*solver, A, b, boundary_nodes, x, precond_num, args["export"]["stiffness_mat"], t == time_steps && args["export"]["spectrum"], assembler.is_fluid(formulation()), use_avg_pressure);
+			if (prefactorize_matrix)
+			{
+				if (refactorize)
+				{
+					logger().debug("factorizing the system matrix, alpha/dt={}", alpha_dt);
+					A_factorized = A;
+					polysolve::prefactorize(*solver, A_factorized, boundary_nodes, precond_num, args["export"]["stiffness_mat"]);
+					factorized_alpha_dt = alpha_dt;
+				}
+				polysolve::dirichlet_solve_prefactorized(*solver, A, b, boundary_nodes, x);
+				if (t == time_steps && args["export"]["spectrum"])
+					spectrum = polysolve::compute_specturm(A_factorized);
+			}
+			else
+				spectrum = dirichlet_solve(*solver, A, b, boundary_nodes, x, precond_num, args["export"]["stiffness_mat"], t == time_steps && args["export"]["spectrum"], assembler.is_fluid(formulation()), use_avg_pressure);
 			bdf.new_solution(x);
 			sol = x;
 
@@ -300,8 +354,7 @@ namespace polyfem
 				if (!solve_export_to_file)
 					solution_frames.emplace_back();
 
-				save_vtu(resolve_output_path(fmt::format("step_{:d}.vtu", t)), time);
-				save_wire(resolve_output_path(fmt::format("step_{:d}.obj", t)));
+				save_timestep(time, t);
 			}
 		}
 
@@ -314,7 +367,7 @@ namespace polyfem
 
 	void State::solve_transient_tensor_linear(const int time_steps, const double t0, const double dt, const RhsAssembler &rhs_assembler)
 	{
-		assert(!problem->is_scalar() && assembler.is_linear(formulation()) && !args["has_collision"] && problem->is_time_dependent());
+		assert(!problem->is_scalar() && assembler.is_linear(formulation()) && !settings_.has_collision && problem->is_time_dependent());
 		assert(!assembler.is_mixed(formulation()));
 
 		const json &params = solver_params();
@@ -347,9 +400,13 @@ namespace polyfem
 		// makes the algorithm implicit and equivalent to the trapezoidal rule (unconditionally stable).
 
 		Eigen::MatrixXd temp, b;
-		StiffnessMatrix A;
+		StiffnessMatrix A, A_factorized;
 		Eigen::VectorXd x, btmp;
 
+		//the system matrix only depends on dt, it is factorized once and back-substituted every step
+		const bool prefactorize_matrix = !assembler.is_fluid(formulation());
+		double factorized_dt = 0;
+
 		for (int t = 1; t <= time_steps; ++t)
 		{
 			const double dt2 = dt * dt;
@@ -364,26 +421,42 @@ namespace polyfem
 			temp = -(uOld + dt * vOld + ((1 / 2. - beta) * dt2) * aOld);
 			b = stiffness * temp + current_rhs;
 
-			rhs_assembler.set_acceleration_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, b, t0 + dt * t);
+			rhs_assembler.set_acceleration_bc(local_boundary, boundary_nodes, settings_.n_boundary_samples, local_neumann_boundary, b, t0 + dt * t);
 
-			A = stiffness * beta * dt2 + mass;
+			const bool refactorize = dt != factorized_dt;
+			if (!prefactorize_matrix || refactorize)
+				A = stiffness * beta * dt2 + mass;
 			btmp = b;
-			spectrum = dirichlet_solve(*solver, A, btmp, boundary_nodes, x, precond_num, args["export"]["stiffness_mat"], t == 1 && args["export"]["spectrum"], assembler.is_fluid(formulation()), use_avg_pressure);
+			if (prefactorize_matrix)
+			{
+				if (refactorize)
+				{
+					logger().debug("factorizing the system matrix, dt={}", dt);
+					A_factorized = A;
+					polysolve::prefactorize(*solver, A_factorized, boundary_nodes, precond_num, args["export"]["stiffness_mat"]);
+					factorized_dt = dt;
+
+					if (t == 1 && args["export"]["spectrum"])
+						spectrum = polysolve::compute_specturm(A_factorized);
+				}
+				polysolve::dirichlet_solve_prefactorized(*solver, A, btmp, boundary_nodes, x);
+			}
+			else
+				spectrum = dirichlet_solve(*solver, A, btmp, boundary_nodes, x, precond_num, args["export"]["stiffness_mat"], t == 1 && args["export"]["spectrum"], assembler.is_fluid(formulation()), use_avg_pressure);
 			acceleration = x;
 
 			sol += dt * vOld + dt2 * ((1 / 2.0 - beta) * aOld + beta * acceleration);
 			velocity += dt * ((1 - gamma) * aOld + gamma * acceleration);
 
-			rhs_assembler.set_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, sol, t0 + dt * t);
-			rhs_assembler.set_velocity_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, velocity, t0 + dt * t);
-			rhs_assembler.set_acceleration_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, acceleration, t0 + dt * t);
+			rhs_assembler.set_bc(local_boundary, boundary_nodes, settings_.n_boundary_samples, local_neumann_boundary, sol, t0 + dt * t);
+			rhs_assembler.set_velocity_bc(local_boundary, boundary_nodes, settings_.n_boundary_samples, local_neumann_boundary, velocity, t0 + dt * t);
+			rhs_assembler.set_acceleration_bc(local_boundary, boundary_nodes, settings_.n_boundary_samples, local_neumann_boundary, acceleration, t0 + dt * t);
 
 			if (args["save_time_sequence"] && !(t % (int)args["skip_frame"]))
 			{
 				if (!solve_export_to_file)
 					solution_frames.emplace_back();
-				save_vtu(resolve_output_path(fmt::format("step_{:d}.vtu", t)), t0 + dt * t);
-				save_wire(resolve_output_path(fmt::format("step_{:d}.obj", t)));
+				save_timestep(t0 + dt * t, t);
 			}
 
 			logger().info("{}/{} t={}", t, time_steps, t0 + dt * t);
@@ -420,9 +493,98 @@ namespace polyfem
 		}
 	}
 
+	void State::solve_transient_tensor_explicit(const int time_steps, const double t0, const double dt, const RhsAssembler &rhs_assembler)
+	{
+		assert(!problem->is_scalar() && !settings_.has_collision && problem->is_time_dependent());
+		assert(!assembler.is_mixed(formulation()));
+
+		const std::string v_path = resolve_path(args["import"]["v_path"], args["root_path"]);
+
+		Eigen::MatrixXd velocity;
+		if (!v_path.empty())
+			import_matrix(v_path, args["import"], velocity);
+		else
+			rhs_assembler.initial_velocity(velocity);
+
+		const auto &gbases = iso_parametric() ? bases : geom_bases;
+		const int n_samples = settings_.n_boundary_samples;
+
+		//sub-steps every frame so that the step respects the CFL condition
+		const double dt_stable = ExplicitCentralDifference::stable_dt(bases, assembler.lame_params(), density, args["time_integrator_params"]["cfl"]);
+		const int n_substeps = std::max(1, int(std::ceil(dt / dt_stable)));
+		const double h = dt / n_substeps;
+		logger().info("Explicit central difference: stable dt {}, {} substeps of {} per time step", dt_stable, n_substeps, h);
+
+		ExplicitCentralDifference integrator;
+		if (!integrator.init(mass, boundary_nodes, sol, velocity, h))
+			return;
+
+		Eigen::MatrixXd force, grad, x_bc = sol;
+
+		igl::Timer timer;
+		for (int t = 1; t <= time_steps; ++t)
+		{
+			timer.start();
+			for (int s = 0; s < n_substeps; ++s)
+			{
+				const double time = t0 + dt * (t - 1) + h * s;
+
+				//net force f_ext - f_int at the beginning of the substep, the element sweep is done in parallel by the assembler
+				rhs_assembler.compute_energy_grad(local_boundary, boundary_nodes, density, n_samples, local_neumann_boundary, rhs, time, force);
+				rhs_assembler.set_bc(std::vector<LocalBoundary>(), std::vector<int>(), n_samples, local_neumann_boundary, force, time);
+				assembler.assemble_energy_gradient(formulation(), mesh->is_volume(), n_bases, bases, gbases, ass_vals_cache, sol, grad);
+				force -= grad;
+
+				rhs_assembler.set_bc(local_boundary, boundary_nodes, n_samples, std::vector<LocalBoundary>(), x_bc, time + h);
+
+				integrator.step(force, x_bc);
+				sol = integrator.x();
+			}
+			velocity = integrator.v();
+			timer.stop();
+
+			if (args["save_time_sequence"] && !(t % (int)args["skip_frame"]))
+			{
+				if (!solve_export_to_file)
+					solution_frames.emplace_back();
+				save_timestep(t0 + dt * t, t);
+			}
+
+			logger().info("{}/{} t={} ({}s)", t, time_steps, t0 + dt * t, timer.getElapsedTimeInSec());
+		}
+
+		{
+			const std::string u_path = resolve_output_path(args["export"]["u_path"]);
+			const std::string v_path = resolve_output_path(args["export"]["v_path"]);
+			const std::string a_path = resolve_output_path(args["export"]["a_path"]);
+
+			if (!u_path.empty())
+				write_matrix_binary(u_path, sol);
+			if (!v_path.empty())
+				write_matrix_binary(v_path, velocity);
+			if (!a_path.empty())
+				write_matrix_binary(a_path, Eigen::MatrixXd(integrator.a()));
+		}
+
+		save_pvd(
+			resolve_output_path("sim.pvd"),
+			[](int i)
+			{ return fmt::format("step_{:d}.vtu", i); },
+			time_steps, t0, dt);
+
+		if (args["export"]["surface"])
+		{
+			save_pvd(
+				resolve_output_path("sim_surf.pvd"),
+				[](int i)
+				{ return fmt::format("step_{:d}_surf.vtu", i); },
+				time_steps, t0, dt);
+		}
+	}
+
 	void State::solve_transient_tensor_non_linear(const int time_steps, const double t0, const double dt, const RhsAssembler &rhs_assembler)
 	{
-		assert(!problem->is_scalar() && (!assembler.is_linear(formulation()) || args["has_collision"]) && problem->is_time_dependent());
+		assert(!problem->is_scalar() && (!assembler.is_linear(formulation()) || settings_.has_collision) && problem->is_time_dependent());
 		assert(!assembler.is_mixed(formulation()));
 
 		// FD for debug
@@ -514,7 +676,7 @@ namespace polyfem
 		timer.stop();
 		logger().trace("done, took {}s", timer.getElapsedTime());
 
-		if (args["has_collision"])
+		if (settings_.has_collision)
 		{
 			timer.start();
 			logger().trace("Checking collisions...");
@@ -546,7 +708,7 @@ namespace polyfem
 		const int reduced_size = n_bases * mesh->dimension() - boundary_nodes.size();
 		VectorXd tmp_sol;
 
-		NLProblem nl_problem(*this, rhs_assembler, t0 + dt, args["dhat"], args["project_to_psd"]);
+		NLProblem nl_problem(*this, rhs_assembler, t0 + dt, settings_.dhat, settings_.project_to_psd);
 		nl_problem.init_time_integrator(sol, velocity, acceleration, dt);
 
 		solver_info = json::array();
@@ -555,14 +717,64 @@ namespace polyfem
 		// {
 		double al_weight = args["al_weight"];
 		const double max_al_weight = args["max_al_weight"];
-		ALNLProblem alnl_problem(*this, rhs_assembler, t0 + dt, args["dhat"], args["project_to_psd"], al_weight);
+		ALNLProblem alnl_problem(*this, rhs_assembler, t0 + dt, settings_.dhat, settings_.project_to_psd, al_weight);
 		alnl_problem.init_time_integrator(sol, velocity, acceleration, dt);
 
 		timer.stop();
 		logger().trace("done, took {}s", timer.getElapsedTime());
 
-		for (int t = 1; t <= time_steps; ++t)
+		// the solvers keep their linear solver and symbolic factorization across AL weights and time steps
+		cppoptlib::SparseNewtonDescentSolver<ALNLProblem> alnlsolver(solver_params(), solver_type(), precond_type());
+		alnlsolver.setLineSearch(args["line_search"]);
+		auto nlsolver = make_nl_solver<NLProblem>(args["nl_solver"], solver_params(), solver_type(), precond_type());
+		nlsolver->setLineSearch(args["line_search"]);
+
+		// adaptive time stepping: the step size follows the local error estimate and the newton convergence,
+		// the output frames are still at t0 + i * dt and are interpolated from the accepted steps
+		const json &adaptive_params = args["adaptive_time_step"];
+		const bool adaptive_dt = adaptive_params["enabled"];
+		const double dt_tolerance = adaptive_params["tolerance"];
+		const double min_dt = dt * double(adaptive_params["min_dt_factor"]);
+		const double max_dt = dt * double(adaptive_params["max_dt_factor"]);
+		const int target_newton_iterations = adaptive_params["target_newton_iterations"];
+		const double t_end = t0 + time_steps * dt;
+
+		double length_scale = 1;
+		if (adaptive_dt)
 		{
+			RowVectorNd min, max;
+			mesh->bounding_box(min, max);
+			length_scale = (max - min).norm();
+		}
+
+		double time = t0;
+		double h = dt;
+		int frame = 1;
+		int step = 0;
+		Eigen::MatrixXd prev_sol;
+
+		igl::Timer step_timer;
+		while (frame <= time_steps)
+		{
+			++step;
+			if (adaptive_dt)
+			{
+				h = std::min(h, t_end - time);
+				// avoid a last step smaller than the minimum
+				if (t_end - time - h < min_dt)
+					h = t_end - time;
+
+				nl_problem.set_dt(h);
+				alnl_problem.set_dt(h);
+				nl_problem.substepping(time + h);
+				alnl_problem.substepping(time + h);
+				prev_sol = sol;
+			}
+
+			step_timer.start();
+			int al_iterations = 0, newton_iterations = 0;
+			bool converged = true;
+
 			nl_problem.full_to_reduced(sol, tmp_sol);
 			assert(sol.size() == rhs.size());
 			assert(tmp_sol.size() < rhs.size());
@@ -570,13 +782,16 @@ namespace polyfem
 			timer.start();
 			logger().trace("Updating lagging...");
 
+			// the lagged quantities (e.g., displaced_prev of the friction) are taken at x^t, before the prediction
 			nl_problem.update_lagging(tmp_sol, /*start_of_timestep=*/true);
 			alnl_problem.update_lagging(sol, /*start_of_timestep=*/true);
 
 			timer.stop();
 			logger().trace("done, took {}s", timer.getElapsedTime());
 
-			if (args["friction_iterations"] > 0)
+			nl_problem.predict(tmp_sol);
+
+			if (settings_.friction_iterations > 0)
 			{
 				logger().debug("Lagging iteration 1");
 			}
@@ -588,17 +803,17 @@ namespace polyfem
 				alnl_problem.set_weight(al_weight);
 				logger().debug("Solving AL Problem with weight {}", al_weight);
 
-				cppoptlib::SparseNewtonDescentSolver<ALNLProblem> alnlsolver(solver_params(), solver_type(), precond_type());
-				alnlsolver.setLineSearch(args["line_search"]);
 				alnl_problem.init(sol);
 				tmp_sol = sol;
 				alnlsolver.minimize(alnl_problem, tmp_sol);
 				json alnl_solver_info;
 				alnlsolver.getInfo(alnl_solver_info);
+				al_iterations += int(alnl_solver_info["iterations"]);
 
 				solver_info.push_back({{"type", "al"},
-									   {"t", t},
+									   {"t", step},
 									   {"weight", al_weight},
+									   {"collision", alnl_problem.collision_stats()},
 									   {"info", alnl_solver_info}});
 
 				sol = tmp_sol;
@@ -610,6 +825,7 @@ namespace polyfem
 				if (al_weight >= max_al_weight)
 				{
 					logger().error("Unable to solve AL problem, weight {} >= {}, stopping", al_weight, max_al_weight);
+					converged = false;
 					break;
 				}
 			}
@@ -617,62 +833,124 @@ namespace polyfem
 			al_weight = args["al_weight"];
 			logger().debug("Solving Problem");
 
-			cppoptlib::SparseNewtonDescentSolver<NLProblem> nlsolver(solver_params(), solver_type(), precond_type());
-			nlsolver.setLineSearch(args["line_search"]);
 			nl_problem.init(sol);
-			nlsolver.minimize(nl_problem, tmp_sol);
+			nlsolver->minimize(nl_problem, tmp_sol);
 			json nl_solver_info;
-			nlsolver.getInfo(nl_solver_info);
+			nlsolver->getInfo(nl_solver_info);
+			newton_iterations += int(nl_solver_info["iterations"]);
+			converged = converged && nlsolver->error_code() != -10;
 			nl_problem.reduced_to_full(tmp_sol, sol);
 
 			// Lagging loop (start at 1 because we already did an iteration above)
 			int lag_i;
-			for (lag_i = 1; lag_i < args["friction_iterations"] && !nl_problem.lagging_converged(tmp_sol, /*do_lagging_update=*/true); lag_i++)
+			for (lag_i = 1; lag_i < settings_.friction_iterations && !nl_problem.lagging_converged(tmp_sol, /*do_lagging_update=*/true); lag_i++)
 			{
 				logger().debug("Lagging iteration {:d}", lag_i + 1);
 				nl_problem.init(sol);
-				nlsolver.minimize(nl_problem, tmp_sol);
-				json nl_solver_info;
-				nlsolver.getInfo(nl_solver_info);
+				nlsolver->minimize(nl_problem, tmp_sol);
+				nlsolver->getInfo(nl_solver_info);
+				newton_iterations += int(nl_solver_info["iterations"]);
+				converged = converged && nlsolver->error_code() != -10;
 				nl_problem.reduced_to_full(tmp_sol, sol);
 			}
+			step_timer.stop();
 
-			if (args["friction_iterations"] > 0)
+			if (settings_.friction_iterations > 0)
 			{
 				logger().info(
-					lag_i >= args["friction_iterations"]
+					lag_i >= settings_.friction_iterations
 						? "Maxed out at {:d} lagging iteration{}"
 						: "Converged using {:d} lagging iteration{}",
 					lag_i, lag_i > 1 ? "s" : "");
 			}
 
+			double next_h = h;
+			if (adaptive_dt)
+			{
+				const double error = nl_problem.estimate_local_error(sol) / (dt_tolerance * length_scale);
+
+				// elementary controller on the error, capped by the newton convergence
+				double factor = 0.9 / std::sqrt(std::max(error, 1e-10));
+				if (newton_iterations > target_newton_iterations)
+					factor = std::min(factor, double(target_newton_iterations) / newton_iterations);
+				factor = std::min(2., std::max(0.2, factor));
+
+				if ((!converged || error > 1) && h > min_dt)
+				{
+					logger().debug("Rejected step t={} dt={}, error {}, converged {}", time + h, h, error, converged);
+					solver_info.push_back({{"type", "rejected"},
+										   {"t", step},
+										   {"dt", h},
+										   {"error", error},
+										   {"newton_iterations", newton_iterations}});
+
+					sol = prev_sol;
+					h = std::max(min_dt, h * std::min(factor, 0.5));
+					continue;
+				}
+				if (!converged)
+					logger().warn("Step at t={} did not converge with the minimum dt={}, accepting it", time + h, h);
+
+				next_h = std::min(max_dt, std::max(min_dt, h * factor));
+			}
+			const double new_time = adaptive_dt ? time + h : t0 + frame * dt;
+
 			timer.start();
 			logger().trace("Update quantities...");
 
-			nl_problem.update_quantities(t0 + (t + 1) * dt, sol);
-			alnl_problem.update_quantities(t0 + (t + 1) * dt, sol);
+			nl_problem.update_quantities(new_time + next_h, sol);
+			alnl_problem.update_quantities(new_time + next_h, sol);
 			timer.stop();
 			logger().trace("done, took {}s", timer.getElapsedTime());
 
-			if (args["save_time_sequence"] && !(t % (int)args["skip_frame"]))
+			// output every frame reached by this step
+			while (frame <= time_steps && t0 + frame * dt <= new_time + 1e-8 * dt)
 			{
-				timer.start();
-				logger().trace("Saving VTU...");
+				const double frame_time = t0 + frame * dt;
 
-				if (!solve_export_to_file)
-					solution_frames.emplace_back();
-				save_vtu(resolve_output_path(fmt::format("step_{:d}.vtu", t)), t0 + dt * t);
-				save_wire(resolve_output_path(fmt::format("step_{:d}.obj", t)));
+				if (args["save_time_sequence"] && !(frame % (int)args["skip_frame"]))
+				{
+					timer.start();
+					logger().trace("Saving VTU...");
+
+					Eigen::MatrixXd accepted_sol;
+					if (adaptive_dt)
+					{
+						const double s = std::min(1., (frame_time - time) / h);
+						accepted_sol = sol;
+						sol = prev_sol + s * (accepted_sol - prev_sol);
+					}
+
+					if (!solve_export_to_file)
+						solution_frames.emplace_back();
+					save_timestep(frame_time, frame);
+
+					if (adaptive_dt)
+						sol = accepted_sol;
+
+					timer.stop();
+					logger().trace("done, took {}s", timer.getElapsedTime());
+				}
 
-				timer.stop();
-				logger().trace("done, took {}s", timer.getElapsedTime());
+				logger().info("{}/{}  t={}", frame, time_steps, frame_time);
+				++frame;
 			}
 
-			logger().info("{}/{}  t={}", t, time_steps, t0 + dt * t);
+			logger().debug("Newton iterations {}, AL iterations {}, solve took {}s", newton_iterations, al_iterations, step_timer.getElapsedTime());
 
 			solver_info.push_back({{"type", "rc"},
-								   {"t", t},
+								   {"t", step},
+								   {"time", new_time},
+								   {"dt", h},
+								   {"predictor", args["predictor"]},
+								   {"newton_iterations", newton_iterations},
+								   {"al_iterations", al_iterations},
+								   {"time_step_solve", step_timer.getElapsedTime()},
+								   {"collision", nl_problem.collision_stats()},
 								   {"info", nl_solver_info}});
+
+			time = new_time;
+			h = next_h;
 		}
 		// }
 		// else
@@ -789,11 +1067,10 @@ namespace polyfem
 	void State::solve_linear()
 	{
 		assert(!problem->is_time_dependent());
-		assert(assembler.is_linear(formulation()) && !args["has_collision"]);
+		assert(assembler.is_linear(formulation()) && !settings_.has_collision);
 		const json &params = solver_params();
 		auto solver = polysolve::LinearSolver::create(args["solver_type"], args["precond_type"]);
 		solver->setParameters(params);
-		StiffnessMatrix A;
 		Eigen::VectorXd b;
 		logger().info("{}...", solver->name());
 		json rhs_solver_params = args["rhs_solver_params"];
@@ -807,28 +1084,163 @@ namespace polyfem
 								   args["rhs_solver_type"], args["rhs_precond_type"], rhs_solver_params);
 
 		if (formulation() != "Bilaplacian")
-			rhs_assembler.set_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, rhs);
+			rhs_assembler.set_bc(local_boundary, boundary_nodes, settings_.n_boundary_samples, local_neumann_boundary, rhs);
 		else
-			rhs_assembler.set_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], std::vector<LocalBoundary>(), rhs);
+			rhs_assembler.set_bc(local_boundary, boundary_nodes, settings_.n_boundary_samples, std::vector<LocalBoundary>(), rhs);
 
 		const int problem_dim = problem->is_scalar() ? 1 : mesh->dimension();
 		const int precond_num = problem_dim * n_bases;
 
-		A = stiffness;
 		Eigen::VectorXd x;
 		b = rhs;
-		spectrum = dirichlet_solve(*solver, A, b, boundary_nodes, x, precond_num, args["export"]["stiffness_mat"], args["export"]["spectrum"], assembler.is_fluid(formulation()), use_avg_pressure);
+
+		StaticCondensation condensation;
+		if (args["static_condensation"] && !assembler.is_mixed(formulation()))
+			condensation.init(bases, n_bases, problem_dim, boundary_nodes);
+
+		if (!condensation.empty())
+		{
+			//only the skeleton system is solved, it is the matrix exported by stiffness_mat and spectrum
+			StiffnessMatrix S;
+			Eigen::VectorXd bs, xs;
+			condensation.condense(stiffness, b, S, bs);
+			logger().info("Static condensation: {} -> {} dofs", condensation.full_size(), condensation.skeleton_size());
+
+			spectrum = dirichlet_solve(*solver, S, bs, condensation.skeleton_boundary_nodes(), xs, condensation.skeleton_size(), args["export"]["stiffness_mat"], args["export"]["spectrum"], assembler.is_fluid(formulation()), use_avg_pressure);
+			condensation.recover(b, xs, x);
+			logger().debug("Solver error: {}", (S * xs - bs).norm());
+		}
+		else
+		{
+			StiffnessMatrix A = stiffness;
+			spectrum = dirichlet_solve(*solver, A, b, boundary_nodes, x, precond_num, args["export"]["stiffness_mat"], args["export"]["spectrum"], assembler.is_fluid(formulation()), use_avg_pressure);
+			logger().debug("Solver error: {}", (A * x - b).norm());
+		}
 		sol = x;
 		solver->getInfo(solver_info);
 
-		logger().debug("Solver error: {}", (A * sol - b).norm());
-
 		if (assembler.is_mixed(formulation()))
 		{
 			sol_to_pressure();
 		}
 	}
 
+	void State::solve_linear_multi_rhs(const Eigen::MatrixXd &rhs_block, Eigen::MatrixXd &sols)
+	{
+		assert(!problem->is_time_dependent());
+		assert(assembler.is_linear(formulation()) && !settings_.has_collision);
+		assert(rhs_block.rows() == stiffness.rows());
+
+		const json &params = solver_params();
+		auto solver = polysolve::LinearSolver::create(args["solver_type"], args["precond_type"]);
+		solver->setParameters(params);
+		logger().info("{} for {} right-hand sides...", solver->name(), rhs_block.cols());
+
+		const int problem_dim = problem->is_scalar() ? 1 : mesh->dimension();
+		const int precond_num = problem_dim * n_bases;
+
+		sols.resize(rhs_block.rows(), rhs_block.cols());
+		Eigen::VectorXd b, x;
+
+		//fluids need the zero columns removal of dirichlet_solve
+		if (assembler.is_fluid(formulation()))
+		{
+			StiffnessMatrix A;
+			for (int c = 0; c < rhs_block.cols(); ++c)
+			{
+				A = stiffness;
+				b = rhs_block.col(c);
+				spectrum = dirichlet_solve(*solver, A, b, boundary_nodes, x, precond_num, args["export"]["stiffness_mat"], c == 0 && args["export"]["spectrum"], true, use_avg_pressure);
+				sols.col(c) = x;
+			}
+		}
+		else
+		{
+			//the spectrum is the one of the system solve_linear reports, with the dirichlet dofs eliminated
+			StiffnessMatrix A = stiffness;
+			apply_dirichlet_identity(boundary_nodes, A);
+			polysolve::prefactorize(*solver, A, boundary_nodes, precond_num, args["export"]["stiffness_mat"]);
+			if (args["export"]["spectrum"])
+				spectrum = polysolve::compute_specturm(A);
+
+			for (int c = 0; c < rhs_block.cols(); ++c)
+			{
+				polysolve::dirichlet_solve_prefactorized(*solver, stiffness, rhs_block.col(c), boundary_nodes, x);
+				sols.col(c) = x;
+			}
+		}
+
+		solver->getInfo(solver_info);
+	}
+
+	void State::solve_load_cases()
+	{
+		assert(!problem->is_time_dependent());
+		const json &load_cases = args["load_cases"];
+
+		json rhs_solver_params = args["rhs_solver_params"];
+		rhs_solver_params["mtype"] = -2; // matrix type for Pardiso (2 = SPD)
+		const int size = problem->is_scalar() ? 1 : mesh->dimension();
+
+		const auto set_case_problem = [&](const int c) {
+			json case_params = args["problem_params"];
+			if (load_cases[c].contains("problem_params"))
+				case_params.merge_patch(load_cases[c]["problem_params"]);
+			problem->clear();
+			problem->set_parameters(case_params);
+		};
+
+		//assembles the rhs of every case, assemble_rhs evaluates the body forces of the current problem
+		Eigen::MatrixXd rhs_block(rhs.rows(), load_cases.size());
+		for (size_t c = 0; c < load_cases.size(); ++c)
+		{
+			set_case_problem(c);
+			assemble_rhs();
+
+			RhsAssembler rhs_assembler(assembler, *mesh,
+									   n_bases, size,
+									   bases, iso_parametric() ? bases : geom_bases, ass_vals_cache,
+									   formulation(), *problem,
+									   args["bc_method"],
+									   args["rhs_solver_type"], args["rhs_precond_type"], rhs_solver_params);
+			if (formulation() != "Bilaplacian")
+				rhs_assembler.set_bc(local_boundary, boundary_nodes, settings_.n_boundary_samples, local_neumann_boundary, rhs);
+			else
+				rhs_assembler.set_bc(local_boundary, boundary_nodes, settings_.n_boundary_samples, std::vector<LocalBoundary>(), rhs);
+
+			assert(rhs.rows() == rhs_block.rows());
+			rhs_block.col(c) = rhs;
+		}
+
+		solve_linear_multi_rhs(rhs_block, load_case_sols);
+
+		const std::string solution_path = args["export"]["solution"];
+		const double tend = args["tend"];
+		for (int c = load_case_sols.cols() - 1; c >= 0; --c)
+		{
+			const std::string name = load_cases[c].contains("name") ? std::string(load_cases[c]["name"]) : std::to_string(c);
+
+			//problem, rhs (with the boundary conditions) and solution of the case, as after solve_linear
+			set_case_problem(c);
+			rhs = rhs_block.col(c);
+			sol = load_case_sols.col(c);
+			if (assembler.is_mixed(formulation()))
+				sol_to_pressure();
+
+			logger().info("Load case {}: ||u||_inf={}", name, sol.lpNorm<Eigen::Infinity>());
+
+			save_vtu(resolve_output_path(fmt::format("case_{}.vtu", name)), tend);
+			if (!solution_path.empty())
+			{
+				std::ofstream out(fmt::format("{}.case_{}", solution_path, name));
+				out.precision(100);
+				out << std::scientific;
+				out << sol << std::endl;
+			}
+		}
+		//the state is left with the first case
+	}
+
 	void State::solve_navier_stokes()
 	{
 		assert(!problem->is_time_dependent());
@@ -846,7 +1258,7 @@ namespace polyfem
 								   formulation(), *problem,
 								   args["bc_method"],
 								   args["rhs_solver_type"], args["rhs_precond_type"], rhs_solver_params);
-		rhs_assembler.set_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, rhs);
+		rhs_assembler.set_bc(local_boundary, boundary_nodes, settings_.n_boundary_samples, local_neumann_boundary, rhs);
 		ns_solver.minimize(*this, rhs, x);
 		sol = x;
 		sol_to_pressure();
@@ -855,7 +1267,7 @@ namespace polyfem
 	void State::solve_non_linear()
 	{
 		assert(!problem->is_time_dependent());
-		assert(!assembler.is_linear(formulation()) || args["has_collision"]);
+		assert(!assembler.is_linear(formulation()) || settings_.has_collision);
 
 		const int full_size = n_bases * mesh->dimension();
 		const int reduced_size = n_bases * mesh->dimension() - boundary_nodes.size();
@@ -941,8 +1353,8 @@ namespace polyfem
 			// 	exit(0);
 		}
 
-		ALNLProblem alnl_problem(*this, rhs_assembler, 1, args["dhat"], args["project_to_psd"], args["al_weight"]);
-		NLProblem nl_problem(*this, rhs_assembler, 1, args["dhat"], args["project_to_psd"]);
+		ALNLProblem alnl_problem(*this, rhs_assembler, 1, settings_.dhat, settings_.project_to_psd, args["al_weight"]);
+		NLProblem nl_problem(*this, rhs_assembler, 1, settings_.dhat, settings_.project_to_psd);
 
 		double al_weight = args["al_weight"];
 		const double max_al_weight = args["max_al_weight"];
@@ -955,6 +1367,11 @@ namespace polyfem
 
 		solver_info = json::array();
 
+		// one solver for the whole continuation: the linear solver and its symbolic factorization
+		// are reused for every weight, and every solve starts from the previous AL solution
+		cppoptlib::SparseNewtonDescentSolver<ALNLProblem> alnlsolver(solver_params(), solver_type(), precond_type());
+		alnlsolver.setLineSearch(args["line_search"]);
+
 		int index = 0;
 		nl_problem.line_search_begin(sol, tmp_sol);
 		while (!std::isfinite(nl_problem.value(tmp_sol)) || !nl_problem.is_step_valid(sol, tmp_sol) || !nl_problem.is_step_collision_free(sol, tmp_sol))
@@ -963,8 +1380,6 @@ namespace polyfem
 			alnl_problem.set_weight(al_weight);
 			logger().debug("Solving AL Problem with weight {}", al_weight);
 
-			cppoptlib::SparseNewtonDescentSolver<ALNLProblem> alnlsolver(solver_params(), solver_type(), precond_type());
-			alnlsolver.setLineSearch(args["line_search"]);
 			alnl_problem.init(sol);
 			tmp_sol = sol;
 			alnlsolver.minimize(alnl_problem, tmp_sol);
@@ -973,6 +1388,7 @@ namespace polyfem
 
 			solver_info.push_back({{"type", "al"},
 								   {"weight", al_weight},
+								   {"collision", alnl_problem.collision_stats()},
 								   {"info", alnl_solver_info}});
 
 			sol = tmp_sol;
@@ -998,15 +1414,16 @@ namespace polyfem
 		}
 		nl_problem.line_search_end();
 		logger().debug("Solving Problem");
-		cppoptlib::SparseNewtonDescentSolver<NLProblem> nlsolver(solver_params(), solver_type(), precond_type());
-		nlsolver.setLineSearch(args["line_search"]);
+		auto nlsolver = make_nl_solver<NLProblem>(args["nl_solver"], solver_params(), solver_type(), precond_type());
+		nlsolver->setLineSearch(args["line_search"]);
 		nl_problem.init(sol);
-		nlsolver.minimize(nl_problem, tmp_sol);
+		nlsolver->minimize(nl_problem, tmp_sol);
 		json nl_solver_info;
-		nlsolver.getInfo(nl_solver_info);
+		nlsolver->getInfo(nl_solver_info);
 
 		nl_problem.reduced_to_full(tmp_sol, sol);
 		solver_info.push_back({{"type", "rc"},
+							   {"collision", nl_problem.collision_stats()},
 							   {"info", nl_solver_info}});
 
 		{
@@ -0,0 +1,113 @@
+#include "ExplicitCentralDifference.hpp"
+
+#include <polyfem/Logger.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace polyfem
+{
+	bool ExplicitCentralDifference::init(const StiffnessMatrix &mass, const std::vector<int> &boundary_nodes, const Eigen::VectorXd &x, const Eigen::VectorXd &v, const double dt)
+	{
+		assert(mass.rows() == x.size() && mass.cols() == x.size());
+
+		//hrz lumping: the diagonal scaled to keep the total mass, row sums are zero or negative at the vertices of p2 elements
+		//for p1 elements it is the row sum lumping
+		Eigen::VectorXd lumped = mass.diagonal();
+		const double diagonal_mass = lumped.sum();
+		const double total_mass = mass.sum();
+		if (diagonal_mass > 0)
+			lumped *= total_mass / diagonal_mass;
+
+		inv_mass_.resize(lumped.size());
+		for (int i = 0; i < lumped.size(); ++i)
+		{
+			if (!(lumped(i) > 0) || !std::isfinite(lumped(i)))
+			{
+				logger().error("Non positive lumped mass {} at dof {}, the explicit integrator cannot run", lumped(i), i);
+				return false;
+			}
+			inv_mass_(i) = 1. / lumped(i);
+		}
+
+		boundary_nodes_ = boundary_nodes;
+		for (int b : boundary_nodes_)
+			inv_mass_(b) = 0;
+
+		x_ = x;
+		v_half_ = v;
+		a_.setZero(x.size());
+		dt_ = dt;
+		first_step_ = true;
+
+		return true;
+	}
+
+	void ExplicitCentralDifference::step(const Eigen::VectorXd &force, const Eigen::VectorXd &x_bc)
+	{
+		assert(force.size() == x_.size());
+		assert(x_bc.size() == x_.size());
+
+		a_ = inv_mass_.cwiseProduct(force);
+
+		//the first step starts from v_0, the half step is v_{1/2} = v_0 + dt/2 a_0
+		v_half_ += (first_step_ ? 0.5 * dt_ : dt_) * a_;
+		first_step_ = false;
+
+		//prescribed dofs move linearly to their value at t_{n+1}
+		for (int b : boundary_nodes_)
+			v_half_(b) = (x_bc(b) - x_(b)) / dt_;
+
+		x_ += dt_ * v_half_;
+
+		for (int b : boundary_nodes_)
+			x_(b) = x_bc(b);
+	}
+
+	double ExplicitCentralDifference::stable_dt(const std::vector<ElementBases> &bases, const LameParameters &lame_params, const Density &density, const double cfl)
+	{
+		double min_dt = std::numeric_limits<double>::max();
+
+		for (size_t e = 0; e < bases.size(); ++e)
+		{
+			std::vector<RowVectorNd> nodes;
+			for (const auto &b : bases[e].bases)
+			{
+				for (const auto &g : b.global())
+					nodes.push_back(g.node);
+			}
+
+			if (nodes.size() < 2)
+				continue;
+
+			RowVectorNd center = RowVectorNd::Zero(nodes.front().size());
+			double spacing = std::numeric_limits<double>::max();
+			for (size_t i = 0; i < nodes.size(); ++i)
+			{
+				center += nodes[i];
+				for (size_t j = i + 1; j < nodes.size(); ++j)
+				{
+					const double d = (nodes[i] - nodes[j]).norm();
+					if (d > 0)
+						spacing = std::min(spacing, d);
+				}
+			}
+			center /= nodes.size();
+
+			const double x = center(0);
+			const double y = center(1);
+			const double z = center.size() > 2 ? center(2) : 0.;
+
+			double lambda, mu;
+			lame_params.lambda_mu(x, y, z, e, lambda, mu);
+			const double rho = density(x, y, z, e);
+
+			const double wave_speed = std::sqrt((lambda + 2 * mu) / rho);
+			min_dt = std::min(min_dt, spacing / wave_speed);
+		}
+
+		logger().debug("explicit stable dt estimate {} (cfl {})", cfl * min_dt, cfl);
+		return cfl * min_dt;
+	}
+} // namespace polyfem
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <polyfem/ElementBases.hpp>
+#include <polyfem/ElasticityUtils.hpp>
+#include <polyfem/Types.hpp>
+
+#include <Eigen/Core>
+#include <vector>
+
+namespace polyfem
+{
+	// explicit central difference (leapfrog) with a lumped mass:
+	// v_{n+1/2} = v_{n-1/2} + dt M^-1 f(x_n), x_{n+1} = x_n + dt v_{n+1/2}
+	// no linear solve is needed, but the scheme is only stable for dt below the CFL limit (see stable_dt)
+	class ExplicitCentralDifference
+	{
+	public:
+		// the mass is lumped (hrz, diagonal scaling), the dirichlet dofs are prescribed and not integrated
+		// returns false if a lumped mass is not positive
+		bool init(const StiffnessMatrix &mass, const std::vector<int> &boundary_nodes, const Eigen::VectorXd &x, const Eigen::VectorXd &v, const double dt);
+
+		// advances x_n to x_{n+1} given the net force f(x_n) = f_ext - f_int
+		// x_bc contains the dirichlet values at t_{n+1} (other entries are ignored)
+		void step(const Eigen::VectorXd &force, const Eigen::VectorXd &x_bc);
+
+		inline const Eigen::VectorXd &x() const { return x_; }
+		// velocity at the last half step
+		inline const Eigen::VectorXd &v() const { return v_half_; }
+		// acceleration at the beginning of the last step
+		inline const Eigen::VectorXd &a() const { return a_; }
+		inline double dt() const { return dt_; }
+
+		// largest stable step: min over the elements of the node spacing divided by the
+		// dilatational wave speed sqrt((lambda + 2 mu) / rho), times the safety factor cfl
+		static double stable_dt(const std::vector<ElementBases> &bases, const LameParameters &lame_params, const Density &density, const double cfl);
+
+	private:
+		// inverse of the lumped mass, zero on the dirichlet dofs
+		Eigen::VectorXd inv_mass_;
+		std::vector<int> boundary_nodes_;
+
+		Eigen::VectorXd x_, v_half_, a_;
+		double dt_;
+		bool first_step_ = true;
+	};
+} // namespace polyfem
@@ -7,15 +7,20 @@ namespace polyfem
 
 	void ImplicitEuler::update_quantities(const Eigen::VectorXd &x)
 	{
-		Eigen::VectorXd v = (x - x_prev) / dt();
-		a_prev = (v - v_prev) / dt();
-		v_prev = v;
+		// a = (v - v_prev) / dt with v = (x - x_prev) / dt, written without temporaries
+		a_prev.noalias() = (x - x_prev - dt() * v_prev) / (dt() * dt());
+		v_prev.noalias() = (x - x_prev) / dt();
 		x_prev = x;
+		_time += dt();
+
+		push_history();
+		update_x_tilde();
 	}
 
-	Eigen::VectorXd ImplicitEuler::x_tilde() const
+	void ImplicitEuler::update_x_tilde()
 	{
-		return x_prev + dt() * v_prev;
+		_x_tilde.resize(x_prev.size());
+		_x_tilde.noalias() = x_prev + dt() * v_prev;
 	}
 
 	double ImplicitEuler::acceleration_scaling() const
@@ -12,9 +12,10 @@ namespace polyfem
 
 		void update_quantities(const Eigen::VectorXd &x) override;
 
-		Eigen::VectorXd x_tilde() const override;
-
 		double acceleration_scaling() const override;
+
+	protected:
+		void update_x_tilde() override;
 	};
 
 } // namespace polyfem
@@ -11,16 +11,21 @@ namespace polyfem
 
 	void ImplicitNewmark::update_quantities(const Eigen::VectorXd &x)
 	{
-		Eigen::VectorXd tmp = x_prev + dt() * (v_prev + dt() * (0.5 - beta) * a_prev);
-		v_prev += dt() * (1 - gamma) * a_prev;	 // vᵗ + h(1 - γ)aᵗ
-		a_prev = (x - tmp) / (beta * dt() * dt()); // aᵗ⁺¹ = ...
-		v_prev += dt() * gamma * a_prev;		   // hγaᵗ⁺¹
+		// _x_tilde = xᵗ + hvᵗ + h²(½ - β)aᵗ
+		v_prev += dt() * (1 - gamma) * a_prev;					  // vᵗ + h(1 - γ)aᵗ
+		a_prev.noalias() = (x - _x_tilde) / (beta * dt() * dt()); // aᵗ⁺¹ = ...
+		v_prev += dt() * gamma * a_prev;						  // hγaᵗ⁺¹
 		x_prev = x;
+		_time += dt();
+
+		push_history();
+		update_x_tilde();
 	}
 
-	Eigen::VectorXd ImplicitNewmark::x_tilde() const
+	void ImplicitNewmark::update_x_tilde()
 	{
-		return x_prev + dt() * (v_prev + dt() * (0.5 - beta) * a_prev);
+		_x_tilde.resize(x_prev.size());
+		_x_tilde.noalias() = x_prev + dt() * (v_prev + dt() * (0.5 - beta) * a_prev);
 	}
 
 	double ImplicitNewmark::acceleration_scaling() const
@@ -14,12 +14,12 @@ namespace polyfem
 
 		void update_quantities(const Eigen::VectorXd &x) override;
 
-		Eigen::VectorXd x_tilde() const override;
-
 		double acceleration_scaling() const override;
 
 	protected:
 		double gamma = 0.5, beta = 0.25;
+
+		void update_x_tilde() override;
 	};
 
 } // namespace polyfem
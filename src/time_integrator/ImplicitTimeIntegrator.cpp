@@ -5,6 +5,8 @@
 #include <polyfem/Logger.hpp>
 #include <polyfem/MatrixUtils.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 
 namespace polyfem
@@ -16,6 +18,82 @@ namespace polyfem
 		this->v_prev = v_prev;
 		this->a_prev = a_prev;
 		_dt = dt;
+
+		_time = 0;
+		x_history.clear();
+		t_history.clear();
+		push_history();
+
+		update_x_tilde();
+	}
+
+	void ImplicitTimeIntegrator::set_dt(const double dt)
+	{
+		_dt = dt;
+		update_x_tilde();
+	}
+
+	double ImplicitTimeIntegrator::estimate_local_error(const Eigen::VectorXd &x) const
+	{
+		assert(x.size() == x_prev.size());
+		double err = 0;
+		for (int i = 0; i < x.size(); ++i)
+			err = std::max(err, std::abs(x(i) - (x_prev(i) + dt() * v_prev(i) + 0.5 * dt() * dt() * a_prev(i))));
+		return err;
+	}
+
+	void ImplicitTimeIntegrator::set_predictor(const std::string &type, const int history)
+	{
+		if (type == "previous" || type == "constant_velocity" || type == "constant_acceleration" || type == "extrapolation")
+			_predictor = type;
+		else
+		{
+			logger().warn("Unknown predictor ({}). Using previous solution.", type);
+			_predictor = "previous";
+		}
+
+		_predictor_history = std::max(1, history);
+	}
+
+	void ImplicitTimeIntegrator::push_history()
+	{
+		if (_predictor != "extrapolation")
+			return;
+
+		x_history.push_front(x_prev);
+		t_history.push_front(_time);
+
+		while (x_history.size() > size_t(_predictor_history))
+		{
+			x_history.pop_back();
+			t_history.pop_back();
+		}
+	}
+
+	void ImplicitTimeIntegrator::predict(Eigen::VectorXd &x) const
+	{
+		if (_predictor == "constant_velocity")
+			x = x_prev + dt() * v_prev;
+		else if (_predictor == "constant_acceleration")
+			x = x_prev + dt() * v_prev + 0.5 * dt() * dt() * a_prev;
+		else if (_predictor == "extrapolation" && x_history.size() > 1)
+		{
+			// Lagrange polynomial through the stored solutions evaluated at the next time
+			const double t_next = t_history.front() + dt();
+			x.setZero(x_prev.size());
+			for (size_t i = 0; i < x_history.size(); ++i)
+			{
+				double li = 1;
+				for (size_t j = 0; j < x_history.size(); ++j)
+				{
+					if (i != j)
+						li *= (t_next - t_history[j]) / (t_history[i] - t_history[j]);
+				}
+				x += li * x_history[i];
+			}
+		}
+		else
+			x = x_prev;
 	}
 
 	void ImplicitTimeIntegrator::save_raw(const std::string &x_path, const std::string &v_path, const std::string &a_path) const
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <deque>
 #include <map>
 #include <vector>
 
@@ -21,11 +22,24 @@ namespace polyfem
 
 		virtual void update_quantities(const Eigen::VectorXd &x) = 0;
 
-		virtual Eigen::VectorXd x_tilde() const = 0;
+		// cached, updated in init and update_quantities
+		const Eigen::VectorXd &x_tilde() const { return _x_tilde; }
 
 		virtual double acceleration_scaling() const = 0;
 
 		const double &dt() const { return _dt; }
+		// changes the size of the next step, used by adaptive time stepping
+		void set_dt(const double dt);
+
+		// local error estimate of the step to x: distance from the explicit second order
+		// prediction x_prev + dt v_prev + dt^2/2 a_prev (predictor-corrector difference)
+		double estimate_local_error(const Eigen::VectorXd &x) const;
+
+		// predictor used for the initial guess of the next step: "previous", "constant_velocity",
+		// "constant_acceleration" or "extrapolation" (polynomial through the last history solutions)
+		void set_predictor(const std::string &type, const int history);
+		inline const std::string &predictor() const { return _predictor; }
+		void predict(Eigen::VectorXd &x) const;
 
 		virtual void save_raw(const std::string &x_path, const std::string &v_path, const std::string &a_path) const;
 
@@ -35,6 +49,19 @@ namespace polyfem
 	protected:
 		double _dt;
 		Eigen::VectorXd x_prev, v_prev, a_prev;
+		Eigen::VectorXd _x_tilde;
+
+		virtual void update_x_tilde() = 0;
+
+		std::string _predictor = "previous";
+		int _predictor_history = 3;
+		// accepted solutions and their times, most recent first (only stored for extrapolation)
+		std::deque<Eigen::VectorXd> x_history;
+		std::deque<double> t_history;
+		double _time = 0;
+
+		// to be called once x_prev holds the new solution
+		void push_history();
 	};
 
 } // namespace polyfem
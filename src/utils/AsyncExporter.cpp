@@ -0,0 +1,120 @@
+#include <polyfem/AsyncExporter.hpp>
+
+#include <polyfem/Logger.hpp>
+
+#include <igl/Timer.h>
+
+namespace polyfem
+{
+	AsyncExporter::AsyncExporter(const int queue_size)
+		: queue_size_(queue_size)
+	{
+		if (queue_size_ > 0)
+			worker_ = std::thread([this]() { run(); });
+	}
+
+	AsyncExporter::~AsyncExporter()
+	{
+		if (!worker_.joinable())
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		job_pushed_.notify_one();
+		worker_.join();
+
+		if (error_)
+			logger().error("Export failed, some output files are missing");
+	}
+
+	void AsyncExporter::push(std::function<void()> job)
+	{
+		if (!worker_.joinable())
+		{
+			run_job(job);
+			return;
+		}
+
+		igl::Timer timer;
+		timer.start();
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			job_done_.wait(lock, [this]() { return int(jobs_.size()) < queue_size_; });
+			jobs_.push_back(std::move(job));
+		}
+		job_pushed_.notify_one();
+		timer.stop();
+		wait_time_ += timer.getElapsedTimeInSec();
+	}
+
+	void AsyncExporter::flush()
+	{
+		igl::Timer timer;
+		timer.start();
+		std::exception_ptr error;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			if (worker_.joinable())
+				job_done_.wait(lock, [this]() { return jobs_.empty() && !busy_; });
+			std::swap(error, error_);
+		}
+		timer.stop();
+		wait_time_ += timer.getElapsedTimeInSec();
+		logger().debug("Export queue flushed, the solver waited {}s for the exporter", wait_time_);
+
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+	void AsyncExporter::run()
+	{
+		while (true)
+		{
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				job_pushed_.wait(lock, [this]() { return stop_ || !jobs_.empty(); });
+				if (jobs_.empty())
+					return;
+
+				job = std::move(jobs_.front());
+				jobs_.pop_front();
+				busy_ = true;
+			}
+			// a job was removed, a blocked push can continue
+			job_done_.notify_all();
+
+			run_job(job);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				busy_ = false;
+			}
+			job_done_.notify_all();
+		}
+	}
+
+	void AsyncExporter::run_job(const std::function<void()> &job)
+	{
+		try
+		{
+			job();
+		}
+		catch (const std::exception &e)
+		{
+			logger().error("Export failed: {}", e.what());
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!error_)
+				error_ = std::current_exception();
+		}
+		catch (...)
+		{
+			logger().error("Export failed");
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!error_)
+				error_ = std::current_exception();
+		}
+	}
+} // namespace polyfem
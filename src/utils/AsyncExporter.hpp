@@ -0,0 +1,53 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace polyfem
+{
+	// runs the export jobs of a time dependent simulation in order on a background thread, so the output of
+	// a step is written while the next one is solved
+	// push blocks while queue_size jobs are waiting (back-pressure on the solver), with queue_size <= 0 the
+	// jobs run in the calling thread
+	// the jobs must own the data they write (e.g., a copy of the solution), the state they read has to stay
+	// constant until flush
+	class AsyncExporter
+	{
+	public:
+		explicit AsyncExporter(const int queue_size);
+		// waits for the queued jobs
+		~AsyncExporter();
+
+		AsyncExporter(const AsyncExporter &) = delete;
+		AsyncExporter &operator=(const AsyncExporter &) = delete;
+
+		void push(std::function<void()> job);
+		// waits for the queued jobs and rethrows the first exception thrown by one of them
+		void flush();
+
+		inline int queue_size() const { return queue_size_; }
+		// time the solver thread spent waiting for the exporter, in push and flush
+		inline double wait_time() const { return wait_time_; }
+
+	private:
+		void run();
+		// runs job and keeps its exception for flush
+		void run_job(const std::function<void()> &job);
+
+		const int queue_size_;
+
+		std::thread worker_;
+		std::mutex mutex_;
+		std::condition_variable job_pushed_, job_done_;
+		std::deque<std::function<void()>> jobs_;
+		bool busy_ = false;
+		bool stop_ = false;
+		std::exception_ptr error_;
+
+		double wait_time_ = 0;
+	};
+} // namespace polyfem
@@ -163,13 +163,11 @@ void polyfem::SpareMatrixCache::init(const size_t rows, const size_t cols)
 
 void polyfem::SpareMatrixCache::init(const SpareMatrixCache &other)
 {
-	if (main_cache_ == nullptr)
-	{
-		if (other.main_cache_ == nullptr)
-			main_cache_ = &other;
-		else
-			main_cache_ = other.main_cache_;
-	}
+	// a persistent local cache can be reused for another main cache
+	if (other.main_cache_ == nullptr)
+		main_cache_ = &other;
+	else
+		main_cache_ = other.main_cache_;
 	size_ = other.size_;
 
 	values_.resize(other.values_.size());
@@ -372,5 +370,6 @@ template bool polyfem::read_matrix_binary<double>(const std::string &, Eigen::Ma
 
 template bool polyfem::write_matrix_binary<Eigen::MatrixXd>(const std::string &, const Eigen::MatrixXd &);
 template bool polyfem::write_matrix_binary<Eigen::MatrixXf>(const std::string &, const Eigen::MatrixXf &);
+template bool polyfem::write_matrix_binary<Eigen::MatrixXi>(const std::string &, const Eigen::MatrixXi &);
 template bool polyfem::write_matrix_binary<Eigen::VectorXd>(const std::string &, const Eigen::VectorXd &);
 template bool polyfem::write_matrix_binary<Eigen::VectorXf>(const std::string &, const Eigen::VectorXf &);
\ No newline at end of file
@@ -1,24 +1,327 @@
 #include <polyfem/par_for.hpp>
 
+#include <algorithm>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef POLYFEM_WITH_TBB
+#include <tbb/global_control.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_scheduler_observer.h>
+#include <atomic>
+#include <memory>
+#endif
+
+#ifdef POLYFEM_WITH_CPP_THREADS
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
 #include <vector>
+#endif
 
 namespace polyfem
 {
-	void par_for(const int size, const std::function<void(int, int, int)> &func)
+	namespace
 	{
+		size_t default_n_threads()
+		{
+			return std::max<size_t>(1, std::thread::hardware_concurrency());
+		}
+
+		// requested number of threads (0 is all) and core pinning
+		size_t n_threads_setting = 0;
+		bool pin_threads = false;
+
+#ifdef __linux__
+		// cores the process is allowed to run on, read before any thread is pinned
+		const cpu_set_t &process_cpus()
+		{
+			static const cpu_set_t cpus = []() {
+				cpu_set_t set;
+				CPU_ZERO(&set);
+				sched_getaffinity(0, sizeof(set), &set);
+				return set;
+			}();
+			return cpus;
+		}
+#endif
+
+		// pins the calling thread to the index-th core available to the process, so that
+		// simulations started with different cpu sets (eg taskset) do not overlap
+		void pin_current_thread(const int index)
+		{
+#ifdef __linux__
+			const cpu_set_t &cpus = process_cpus();
+			const int n_cpus = CPU_COUNT(&cpus);
+			if (n_cpus <= 0 || index < 0)
+				return;
+
+			int k = index % n_cpus;
+			for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+			{
+				if (!CPU_ISSET(cpu, &cpus) || k-- > 0)
+					continue;
+
+				cpu_set_t set;
+				CPU_ZERO(&set);
+				CPU_SET(cpu, &set);
+				pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+				return;
+			}
+#endif
+		}
+
+		// lets the calling thread run again on every core available to the process
+		void unpin_current_thread()
+		{
+#ifdef __linux__
+			const cpu_set_t &cpus = process_cpus();
+			if (CPU_COUNT(&cpus) > 0)
+				pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+		}
+
+#ifdef POLYFEM_WITH_TBB
+		std::unique_ptr<tbb::global_control> tbb_thread_limit;
+
+		// the thread index is local to each arena, so the threads of different arenas (eg the ensemble ones) would
+		// share their cores, every thread gets instead a process wide slot the first time it is pinned
+		// slot 0 is the thread that called set_n_threads
+		std::atomic<int> next_pin_slot(1);
+		thread_local int pin_slot = -1;
+		thread_local bool pinned = false;
+
+		// pins the threads entering the scheduler while pinning is on, and restores the affinity
+		// of the ones pinned before once it is turned off
+		class PinningObserver : public tbb::task_scheduler_observer
+		{
+		public:
+			PinningObserver() { observe(true); }
+			void on_scheduler_entry(bool) override
+			{
+				if (pin_threads)
+				{
+					if (pin_slot < 0)
+						pin_slot = next_pin_slot++;
+					pin_current_thread(pin_slot);
+					pinned = true;
+				}
+				else if (pinned)
+				{
+					unpin_current_thread();
+					pinned = false;
+				}
+			}
+		};
+		std::unique_ptr<PinningObserver> tbb_pinning;
+#endif
+
+#ifdef POLYFEM_WITH_CPP_THREADS
+		// id of the pool thread running the current chunk, -1 outside of a parallel region
+		thread_local int current_thread_id = -1;
+
+		// workers sleep between parallel regions and claim chunks from a shared atomic counter,
+		// the calling thread takes part as thread 0
+		class ThreadPool
+		{
+		public:
+			static ThreadPool &instance()
+			{
+				static ThreadPool pool;
+				return pool;
+			}
+
+			~ThreadPool() { stop_workers(); }
+
+			size_t size() const { return n_threads_; }
+
+			void resize(const size_t n_threads)
+			{
+				std::lock_guard<std::mutex> run_lock(run_mutex_);
+				stop_workers();
+				start_workers(n_threads == 0 ? default_n_threads() : n_threads);
+			}
+
+			void run(const int size, const int grain_size, const std::function<void(int, int, int)> &func)
+			{
+				if (size <= 0)
+					return;
+
+				// nested regions and single threaded pools run in the calling thread
+				if (current_thread_id >= 0 || n_threads_ == 1 || size <= grain_size)
+				{
+					func(0, size, std::max(0, current_thread_id));
+					return;
+				}
+
+				std::lock_guard<std::mutex> run_lock(run_mutex_);
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					func_ = &func;
+					size_ = size;
+					grain_size_ = grain_size > 0 ? grain_size : std::max(1, int(size / (8 * n_threads_)));
+					next_ = 0;
+					error_ = nullptr;
+					n_active_ = workers_.size();
+					++generation_;
+				}
+				start_cv_.notify_all();
+
+				work(0);
+
+				std::unique_lock<std::mutex> lock(mutex_);
+				done_cv_.wait(lock, [&]() { return n_active_ == 0; });
+				func_ = nullptr;
+
+				if (error_)
+					std::rethrow_exception(error_);
+			}
+
+		private:
+			ThreadPool() { start_workers(default_n_threads()); }
+
+			void start_workers(const size_t n_threads)
+			{
+				stop_ = false;
+				n_threads_ = n_threads;
+				for (size_t t = 1; t < n_threads_; ++t)
+					workers_.emplace_back(&ThreadPool::worker_loop, this, int(t), generation_);
+			}
+
+			void stop_workers()
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					stop_ = true;
+				}
+				start_cv_.notify_all();
+				for (auto &w : workers_)
+					w.join();
+				workers_.clear();
+			}
+
+			// seen_generation is read by the caller, since the first region can start before the thread runs
+			void worker_loop(const int id, size_t seen_generation)
+			{
+				if (pin_threads)
+					pin_current_thread(id);
+
+				while (true)
+				{
+					{
+						std::unique_lock<std::mutex> lock(mutex_);
+						start_cv_.wait(lock, [&]() { return stop_ || generation_ != seen_generation; });
+						if (stop_)
+							return;
+						seen_generation = generation_;
+					}
+
+					work(id);
+
+					std::lock_guard<std::mutex> lock(mutex_);
+					if (--n_active_ == 0)
+						done_cv_.notify_one();
+				}
+			}
+
+			void work(const int id)
+			{
+				current_thread_id = id;
+				try
+				{
+					int start;
+					while ((start = next_.fetch_add(grain_size_)) < size_)
+						(*func_)(start, std::min(start + grain_size_, size_), id);
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					if (!error_)
+						error_ = std::current_exception();
+					next_ = size_;
+				}
+				current_thread_id = -1;
+			}
+
+			std::vector<std::thread> workers_;
+			size_t n_threads_ = 1;
+
+			// serializes the parallel regions started by different threads
+			std::mutex run_mutex_;
+
+			std::mutex mutex_;
+			std::condition_variable start_cv_, done_cv_;
+			size_t generation_ = 0;
+			size_t n_active_ = 0;
+			bool stop_ = false;
+
+			// current parallel region
+			const std::function<void(int, int, int)> *func_ = nullptr;
+			int size_ = 0, grain_size_ = 1;
+			std::atomic<int> next_{0};
+			std::exception_ptr error_;
+		};
+#endif
+	} // namespace
+
+	void par_for(const int size, const std::function<void(int, int, int)> &func, const int grain_size)
+	{
+#ifdef POLYFEM_WITH_CPP_THREADS
+		ThreadPool::instance().run(size, grain_size, func);
+#else
+		if (size > 0)
+			func(0, size, 0);
+#endif
+	}
+
+	size_t get_n_threads()
+	{
+#ifdef POLYFEM_WITH_CPP_THREADS
+		return ThreadPool::instance().size();
+#else
+		return n_threads_setting == 0 ? default_n_threads() : n_threads_setting;
+#endif
+	}
+
+	void set_n_threads(const size_t n_threads, const bool pin)
+	{
+		if (n_threads == n_threads_setting && pin == pin_threads)
+			return;
+
+#ifdef __linux__
+		process_cpus();
+#endif
+		n_threads_setting = n_threads;
+		const bool was_pinned = pin_threads;
+		pin_threads = pin;
+
+		if (pin)
+			pin_current_thread(0);
+		else if (was_pinned)
+			unpin_current_thread();
+
 #ifdef POLYFEM_WITH_CPP_THREADS
-		const size_t n_threads = get_n_threads();
-		std::vector<std::thread> threads(n_threads);
+		ThreadPool::instance().resize(n_threads);
+#elif defined(POLYFEM_WITH_TBB)
+		tbb_thread_limit.reset();
+		if (n_threads > 0)
+			tbb_thread_limit = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, n_threads);
 
-		for (int t = 0; t < n_threads; t++)
+		// the observer stays once pinning was used, to unpin the workers when they next enter the scheduler
+		if (pin)
 		{
-			threads[t] = std::thread(std::bind(
-				func,
-				t * size / n_threads,
-				(t + 1) == n_threads ? size : (t + 1) * size / n_threads,
-				t));
+			pin_slot = 0;
+			pinned = true;
 		}
-		std::for_each(threads.begin(), threads.end(), [](std::thread &x) { x.join(); });
+		else
+			pinned = false;
+		if (pin && !tbb_pinning)
+			tbb_pinning = std::make_unique<PinningObserver>();
 #endif
 	}
-}
\ No newline at end of file
+} // namespace polyfem
@@ -1,8 +1,21 @@
+#pragma once
+
+#include <cstddef>
 #include <functional>
-#include <thread>
 
 namespace polyfem
 {
-	void par_for(const int size, const std::function<void(int, int, int)> &func);
-	inline size_t get_n_threads() { return std::thread::hardware_concurrency(); }
-}
+	// runs func(start, end, thread_id) on chunks of [0, size) using a persistent pool of threads
+	// chunks are claimed dynamically, so a thread can receive several chunks and storages indexed
+	// by thread_id (in [0, get_n_threads())) must be initialized before the call
+	// grain_size is the chunk size, if <= 0 every thread gets about 8 chunks
+	// a par_for called inside another one runs serially in the calling thread with its thread_id
+	void par_for(const int size, const std::function<void(int, int, int)> &func, const int grain_size = 0);
+
+	// number of threads used by par_for
+	size_t get_n_threads();
+	// limits the number of threads used by par_for and tbb, 0 means hardware concurrency
+	// if pin is true every thread is bound to one of the cores available to the process (linux only)
+	// turning it off restores the affinity of the calling thread, and of the other threads when they next run
+	void set_n_threads(const size_t n_threads, const bool pin = false);
+} // namespace polyfem
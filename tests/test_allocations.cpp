@@ -0,0 +1,262 @@
+#include <polyfem/State.hpp>
+#include <polyfem/NLProblem.hpp>
+#include <polyfem/ImplicitTimeIntegrator.hpp>
+
+#include <catch.hpp>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+
+using namespace polyfem;
+
+////////////////////////////////////////////////////////////////////////////////
+// Eigen allocates with malloc and not operator new, so we count at the malloc
+// level by interposing the glibc allocator. The interposer replaces malloc for
+// the whole executable, so these tests are built into allocation_tests and not
+// into unit_tests.
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+#define POLYFEM_COUNT_ALLOCATIONS
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void *__libc_memalign(size_t alignment, size_t size);
+
+namespace
+{
+	std::atomic<bool> count_allocations(false);
+	std::atomic<size_t> n_allocations(0);
+	std::atomic<size_t> max_allocation(0);
+
+	inline void record_allocation(const size_t size)
+	{
+		if (!count_allocations)
+			return;
+
+		++n_allocations;
+		size_t prev = max_allocation;
+		while (prev < size && !max_allocation.compare_exchange_weak(prev, size))
+			;
+	}
+
+	class AllocationCounter
+	{
+	public:
+		AllocationCounter()
+		{
+			n_allocations = 0;
+			max_allocation = 0;
+			count_allocations = true;
+		}
+		~AllocationCounter() { count_allocations = false; }
+
+		size_t count() const { return n_allocations; }
+		// size in bytes of the largest allocation
+		size_t max_size() const { return max_allocation; }
+	};
+} // namespace
+
+extern "C" void *malloc(size_t size)
+{
+	record_allocation(size);
+	return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+	record_allocation(n * size);
+	return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+	record_allocation(size);
+	return __libc_realloc(ptr, size);
+}
+
+extern "C" int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+	record_allocation(size);
+	*ptr = __libc_memalign(alignment, size);
+	return *ptr ? 0 : ENOMEM;
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size)
+{
+	record_allocation(size);
+	return __libc_memalign(alignment, size);
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef POLYFEM_COUNT_ALLOCATIONS
+TEST_CASE("time_integrator_no_alloc", "[allocations]")
+{
+	const int n = 100;
+	for (const auto &name : ImplicitTimeIntegrator::get_time_integrator_names())
+	{
+		auto time_integrator = ImplicitTimeIntegrator::construct_time_integrator(name);
+		time_integrator->set_parameters(json({{"gamma", 0.5}, {"beta", 0.25}}));
+		time_integrator->init(Eigen::VectorXd::Zero(n), Eigen::VectorXd::Zero(n), Eigen::VectorXd::Zero(n), 0.1);
+
+		Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+		double sum = 0;
+		size_t allocations;
+		{
+			AllocationCounter counter;
+			for (int i = 0; i < 10; ++i)
+			{
+				time_integrator->update_quantities(x);
+				sum += time_integrator->x_tilde().sum();
+				x *= 0.5;
+			}
+			allocations = counter.count();
+		}
+
+		REQUIRE(std::isfinite(sum));
+		REQUIRE(allocations == 0);
+	}
+}
+
+namespace
+{
+	// two stacked n x n grids of the unit square 0.02 apart, closer than dhat
+	void contact_mesh(Eigen::MatrixXd &V, Eigen::MatrixXi &F)
+	{
+		const int n = 8;
+		const double gap = 0.02;
+		V.resize(2 * (n + 1) * (n + 1), 2);
+		F.resize(2 * 2 * n * n, 3);
+		for (int b = 0; b < 2; ++b)
+		{
+			const int v0 = b * (n + 1) * (n + 1);
+			for (int j = 0; j <= n; ++j)
+				for (int i = 0; i <= n; ++i)
+					V.row(v0 + j * (n + 1) + i) << double(i) / n, double(j) / n + b * (1 + gap);
+
+			for (int j = 0; j < n; ++j)
+				for (int i = 0; i < n; ++i)
+				{
+					const int f = 2 * (b * n * n + j * n + i);
+					const int v = v0 + j * (n + 1) + i;
+					F.row(f) << v, v + 1, v + n + 2;
+					F.row(f + 1) << v, v + n + 2, v + n + 1;
+				}
+		}
+	}
+} // namespace
+
+TEST_CASE("nl_problem_no_alloc", "[allocations]")
+{
+	Eigen::MatrixXd V;
+	Eigen::MatrixXi F;
+	contact_mesh(V, F);
+
+	json in_args = json({});
+	in_args["normalize_mesh"] = false;
+	in_args["problem"] = "GenericTensor";
+	in_args["tensor_formulation"] = "NeoHookean";
+	in_args["has_collision"] = true;
+	in_args["dhat"] = 0.05;
+	in_args["max_threads"] = 1;
+	in_args["problem_params"] = {{"dirichlet_boundary", {{{"id", 2}, {"value", {0, 0}}}, {{"id", 4}, {"value", {0, 0}}}}}};
+
+	State state;
+	state.init_logger("", 6, false);
+	state.init(in_args);
+	state.load_mesh(V, F);
+
+	state.compute_mesh_stats();
+	state.build_basis();
+
+	state.assemble_rhs();
+	state.assemble_stiffness_mat();
+
+	const int size = state.mesh->dimension();
+	RhsAssembler rhs_assembler(state.assembler, *state.mesh,
+							   state.n_bases, size,
+							   state.bases, state.bases, state.ass_vals_cache,
+							   state.formulation(), *state.problem,
+							   state.args["bc_method"],
+							   state.args["rhs_solver_type"], state.args["rhs_precond_type"], state.args["rhs_solver_params"]);
+
+	NLProblem nl_problem(state, rhs_assembler, 1, state.args["dhat"], false);
+
+	Eigen::MatrixXd full = Eigen::MatrixXd::Zero(state.n_bases * size, 1);
+	NLProblem::TVector x, x1, grad;
+	StiffnessMatrix hessian;
+	nl_problem.full_to_reduced(full, x);
+	nl_problem.init(full);
+	nl_problem.update_lagging(x, /*start_of_timestep=*/true);
+	x1.resize(x.size());
+
+	double energy = 0;
+	// a newton iteration: energy, gradient and hessian at x, then a line search towards a step down the gradient
+	const auto newton_iteration = [&]() {
+		nl_problem.solution_changed(x);
+		energy += nl_problem.value(x);
+		nl_problem.gradient(x, grad);
+		nl_problem.hessian(x, hessian);
+
+		x1.noalias() = x - grad;
+		nl_problem.line_search_begin(x, x1);
+		nl_problem.solution_changed(x1);
+		const double alpha = nl_problem.max_step_size(x, x1);
+		nl_problem.is_step_valid(x, x1);
+		energy += alpha * nl_problem.value(x1);
+		nl_problem.line_search_end();
+	};
+
+	size_t cold_allocations, warm_allocations;
+	{
+		AllocationCounter counter;
+		newton_iteration();
+		cold_allocations = counter.count();
+	}
+	{
+		AllocationCounter counter;
+		newton_iteration();
+		warm_allocations = counter.count();
+	}
+	// the contact terms (ipc) and the per-element temporaries of the local assemblers still allocate,
+	// the buffers of the size of the problem are reused
+	REQUIRE(std::isfinite(energy));
+	REQUIRE(warm_allocations < cold_allocations);
+
+	// elastic energy and gradient: the assembler thread storages and the workspace are reused,
+	// only per-element temporaries are allocated
+	size_t elastic_max_size;
+	{
+		AllocationCounter counter;
+		for (int i = 0; i < 3; ++i)
+		{
+			energy += nl_problem.value(x, true);
+			nl_problem.gradient(x, grad, true);
+		}
+		elastic_max_size = counter.max_size();
+	}
+	REQUIRE(std::isfinite(energy));
+	REQUIRE(elastic_max_size < full.size() * sizeof(double));
+
+	// the dof bookkeeping of a newton iteration: gathers, scatters and the memoized constraint set
+	nl_problem.solution_changed(x);
+	size_t allocations;
+	{
+		AllocationCounter counter;
+		for (int i = 0; i < 10; ++i)
+		{
+			nl_problem.reduced_to_full(x, full);
+			nl_problem.full_to_reduced(full, x);
+			nl_problem.solution_changed(x);
+		}
+		allocations = counter.count();
+	}
+
+	REQUIRE(allocations == 0);
+	REQUIRE(x.size() == grad.size());
+	REQUIRE(hessian.rows() == x.size());
+}
+#endif
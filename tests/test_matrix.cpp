@@ -1,5 +1,6 @@
 ////////////////////////////////////////////////////////////////////////////////
 #include <polyfem/MatrixUtils.hpp>
+#include <polyfem/ContactSparsity.hpp>
 #include <polyfem/auto_eigs.hpp>
 #include <polyfem/AutodiffTypes.hpp>
 
@@ -244,3 +245,145 @@ TEST_CASE("cache", "[matrix]")
 	REQUIRE(tmp2.coeff(9, 4) == 6);
 	REQUIRE(tmp2.coeff(9, 9) == 4);
 }
+
+TEST_CASE("contact_sparsity", "[matrix]")
+{
+	const int n = 8;
+	StiffnessMatrix base(n, n);
+	std::vector<Eigen::Triplet<double>> entries;
+	for (int i = 0; i < n; ++i)
+	{
+		entries.emplace_back(i, i, 2);
+		if (i > 0)
+		{
+			entries.emplace_back(i, i - 1, -1);
+			entries.emplace_back(i - 1, i, -1);
+		}
+	}
+	base.setFromTriplets(entries.begin(), entries.end());
+	base.makeCompressed();
+
+	// nodes 0 and 3 (dim 2) come into contact, the stencil also covers node 2
+	ContactSparsity::ContactHessian contact(n, n);
+	contact.insert(0, 6) = 1;
+	contact.insert(6, 0) = 1;
+	contact.insert(6, 6) = 3;
+	contact.makeCompressed();
+
+	int n_stencil_calls = 0;
+	const auto stencils = [&](std::vector<ContactSparsity::Stencil> &s) {
+		++n_stencil_calls;
+		s.push_back({{0, 2, 3, -1}});
+	};
+
+	ContactSparsity sparsity;
+	sparsity.set_dim(2);
+	StiffnessMatrix out;
+	sparsity.assemble(base, {&contact}, stencils, out);
+
+	REQUIRE(sparsity.n_grows() == 1);
+	REQUIRE(n_stencil_calls == 1);
+	REQUIRE((Eigen::MatrixXd(out) - Eigen::MatrixXd(base) - Eigen::MatrixXd(contact)).norm() == 0);
+	// 2x2 blocks of the pairs of nodes of the stencil
+	REQUIRE(out.nonZeros() > base.nonZeros() + 2);
+
+	// a different contact inside the stencil keeps the pattern
+	ContactSparsity::ContactHessian contact1(n, n);
+	contact1.insert(1, 5) = 2;
+	contact1.insert(5, 1) = 2;
+	contact1.makeCompressed();
+
+	const StiffnessMatrix out0 = out;
+	sparsity.assemble(base, {&contact1}, stencils, out);
+
+	REQUIRE(sparsity.n_grows() == 1);
+	REQUIRE(n_stencil_calls == 1);
+	REQUIRE(out.nonZeros() == out0.nonZeros());
+	REQUIRE(std::equal(out.innerIndexPtr(), out.innerIndexPtr() + out.nonZeros(), out0.innerIndexPtr()));
+	REQUIRE((Eigen::MatrixXd(out) - Eigen::MatrixXd(base) - Eigen::MatrixXd(contact1)).norm() == 0);
+
+	// a pair out of range grows the pattern
+	ContactSparsity::ContactHessian contact2(n, n);
+	contact2.insert(2, 7) = 1;
+	contact2.makeCompressed();
+	sparsity.assemble(base, {&contact2}, stencils, out);
+
+	REQUIRE(sparsity.n_grows() == 2);
+	REQUIRE(out.coeff(2, 7) == 1);
+}
+
+TEST_CASE("contact_sparsity_rebuild", "[matrix]")
+{
+	const int n = 8;
+	StiffnessMatrix base(n, n);
+	std::vector<Eigen::Triplet<double>> entries;
+	for (int i = 0; i < n; ++i)
+	{
+		entries.emplace_back(i, i, 2);
+		if (i > 0)
+		{
+			entries.emplace_back(i, i - 1, -1);
+			entries.emplace_back(i - 1, i, -1);
+		}
+	}
+	base.setFromTriplets(entries.begin(), entries.end());
+	base.makeCompressed();
+
+	const auto has_entry = [](const StiffnessMatrix &m, const int i, const int j) {
+		for (StiffnessMatrix::InnerIterator it(m, j); it; ++it)
+		{
+			if (it.row() == i)
+				return true;
+		}
+		return false;
+	};
+
+	const auto contact_at = [n](const int i, const int j) {
+		ContactSparsity::ContactHessian contact(n, n);
+		contact.insert(i, j) = 1;
+		contact.insert(j, i) = 1;
+		contact.makeCompressed();
+		return contact;
+	};
+
+	ContactSparsity::Stencil stencil;
+	const auto stencils = [&](std::vector<ContactSparsity::Stencil> &s) { s.push_back(stencil); };
+
+	ContactSparsity sparsity;
+	sparsity.set_dim(2);
+	sparsity.set_max_growth(1.1);
+	StiffnessMatrix out;
+
+	// the contact moves from the pair of nodes 0, 1 to 2, 3 (dim 2), the pattern keeps both
+	const ContactSparsity::ContactHessian contact0 = contact_at(0, 2);
+	const ContactSparsity::ContactHessian contact1 = contact_at(4, 6);
+	stencil = {{0, 1, -1, -1}};
+	sparsity.assemble(base, {&contact0}, stencils, out);
+	stencil = {{2, 3, -1, -1}};
+	sparsity.assemble(base, {&contact1}, stencils, out);
+
+	REQUIRE(sparsity.n_grows() == 2);
+	REQUIRE(sparsity.n_rebuilds() == 0);
+	REQUIRE(has_entry(out, 0, 2));
+	REQUIRE(has_entry(out, 4, 6));
+
+	// the pattern is now larger than 1.1 times its first build, the next growth drops the stale pairs
+	stencil = {{0, 3, -1, -1}};
+	const ContactSparsity::ContactHessian contact = contact_at(0, 7);
+	sparsity.assemble(base, {&contact}, stencils, out);
+
+	REQUIRE(sparsity.n_grows() == 3);
+	REQUIRE(sparsity.n_rebuilds() == 1);
+	REQUIRE(!has_entry(out, 0, 2));
+	REQUIRE(!has_entry(out, 4, 6));
+	REQUIRE(has_entry(out, 0, 7));
+	REQUIRE((Eigen::MatrixXd(out) - Eigen::MatrixXd(base) - Eigen::MatrixXd(contact)).norm() == 0);
+
+	// without stencils (no broad-phase slack) the pattern only covers the contact entries
+	ContactSparsity no_stencils;
+	no_stencils.set_dim(2);
+	no_stencils.assemble(base, {&contact}, [](std::vector<ContactSparsity::Stencil> &) {}, out);
+
+	REQUIRE(out.nonZeros() == base.nonZeros() + 2);
+	REQUIRE((Eigen::MatrixXd(out) - Eigen::MatrixXd(base) - Eigen::MatrixXd(contact)).norm() == 0);
+}
@@ -0,0 +1,194 @@
+////////////////////////////////////////////////////////////////////////////////
+#include <polyfem/par_for.hpp>
+
+#include <catch.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+////////////////////////////////////////////////////////////////////////////////
+
+using namespace polyfem;
+
+#ifdef __linux__
+TEST_CASE("par_for_unpin", "[par_for]")
+{
+	cpu_set_t before, after;
+	CPU_ZERO(&before);
+	CPU_ZERO(&after);
+	sched_getaffinity(0, sizeof(before), &before);
+
+	set_n_threads(2, true);
+	set_n_threads(2, false);
+
+	// the calling thread runs again on all the cores it had
+	sched_getaffinity(0, sizeof(after), &after);
+	REQUIRE(CPU_EQUAL(&before, &after));
+
+	set_n_threads(0);
+}
+#endif
+
+// the pool only exists with POLYFEM_THREADING=CPP, otherwise par_for is a serial loop
+#ifdef POLYFEM_WITH_CPP_THREADS
+
+TEST_CASE("par_for", "[par_for]")
+{
+	set_n_threads(4);
+	REQUIRE(get_n_threads() == 4);
+
+	for (const int grain_size : {0, 1, 7, 1000})
+	{
+		const int size = 10007;
+		std::vector<std::atomic<int>> visits(size);
+		for (auto &v : visits)
+			v = 0;
+		std::atomic<bool> valid_ids(true);
+
+		par_for(
+			size, [&](int start, int end, int t) {
+				if (t < 0 || t >= int(get_n_threads()))
+					valid_ids = false;
+				for (int i = start; i < end; ++i)
+					++visits[i];
+			},
+			grain_size);
+
+		REQUIRE(valid_ids);
+		REQUIRE(std::all_of(visits.begin(), visits.end(), [](const std::atomic<int> &v) { return v == 1; }));
+	}
+
+	set_n_threads(0);
+}
+
+TEST_CASE("par_for_nested", "[par_for]")
+{
+	set_n_threads(4);
+
+	const int size = 64;
+	std::atomic<int> sum(0);
+	std::atomic<bool> inline_calls(true);
+
+	par_for(
+		size, [&](int start, int end, int t) {
+			const std::thread::id outer_thread = std::this_thread::get_id();
+			for (int i = start; i < end; ++i)
+			{
+				// the inner region is a single call in the same thread, with the thread id of the outer chunk
+				int n_calls = 0;
+				par_for(size, [&](int inner_start, int inner_end, int inner_t) {
+					++n_calls;
+					if (inner_t != t || inner_start != 0 || inner_end != size || std::this_thread::get_id() != outer_thread)
+						inline_calls = false;
+					sum += inner_end - inner_start;
+				});
+				if (n_calls != 1)
+					inline_calls = false;
+			}
+		},
+		1);
+
+	REQUIRE(inline_calls);
+	REQUIRE(sum == size * size);
+
+	set_n_threads(0);
+}
+
+TEST_CASE("par_for_exception", "[par_for]")
+{
+	set_n_threads(4);
+
+	const int size = 1000;
+	REQUIRE_THROWS_AS(par_for(
+						  size, [&](int start, int end, int t) {
+							  for (int i = start; i < end; ++i)
+							  {
+								  if (i == 573)
+									  throw std::runtime_error("error in the body");
+							  }
+						  },
+						  10),
+					  std::runtime_error);
+
+	// the pool is still usable after the failed region
+	std::atomic<int> count(0);
+	par_for(size, [&](int start, int end, int t) { count += end - start; });
+	REQUIRE(count == size);
+
+	set_n_threads(0);
+}
+
+TEST_CASE("par_for_from_other_threads", "[par_for]")
+{
+	set_n_threads(4);
+
+	// regions started by threads outside of the pool run one after the other
+	const int n_callers = 4;
+	const int n_calls = 50;
+	const int size = 1000;
+	std::vector<long> sums(n_callers, 0);
+	std::vector<std::thread> callers;
+	for (int c = 0; c < n_callers; ++c)
+	{
+		callers.emplace_back([&, c]() {
+			for (int k = 0; k < n_calls; ++k)
+			{
+				std::atomic<long> sum(0);
+				par_for(size, [&](int start, int end, int t) {
+					for (int i = start; i < end; ++i)
+						sum += i;
+				});
+				sums[c] += sum;
+			}
+		});
+	}
+	for (auto &c : callers)
+		c.join();
+
+	for (const long s : sums)
+		REQUIRE(s == long(n_calls) * size * (size - 1) / 2);
+
+	set_n_threads(0);
+}
+
+TEST_CASE("par_for_set_n_threads", "[par_for]")
+{
+	for (const int n_threads : {3, 1, 5, 2})
+	{
+		set_n_threads(n_threads);
+		REQUIRE(get_n_threads() == size_t(n_threads));
+
+		std::vector<std::atomic<int>> chunks(n_threads);
+		for (auto &c : chunks)
+			c = 0;
+		std::atomic<bool> valid_ids(true);
+		std::atomic<int> count(0);
+
+		par_for(
+			10000, [&](int start, int end, int t) {
+				if (t < 0 || t >= n_threads)
+				{
+					valid_ids = false;
+					return;
+				}
+				++chunks[t];
+				count += end - start;
+			},
+			1);
+
+		REQUIRE(valid_ids);
+		REQUIRE(count == 10000);
+		if (n_threads == 1)
+			REQUIRE(chunks[0] == 1);
+	}
+
+	set_n_threads(0);
+}
+
+#endif
@@ -1,5 +1,8 @@
 ////////////////////////////////////////////////////////////////////////////////
 
+#include <polyfem/State.hpp>
+#include <polyfem/NLProblem.hpp>
+#include <polyfem/ExplicitCentralDifference.hpp>
 #include <polyfem/TriQuadrature.hpp>
 #include <polyfem/FEBasis2d.hpp>
 
@@ -36,3 +39,356 @@ TEST_CASE("solver", "[solver]") {
     REQUIRE(f(x) < 1e-10);
 }
 
+
+namespace {
+    // two stacked n x n grids of the unit square, the top one is pushed down into the bottom one
+    // extra_args is merged into the default arguments of the scene
+    void init_contact_scene(const std::string &nl_solver, State &state, const json &extra_args = json({}))
+    {
+        const int n = 8;
+        const double gap = 0.02;
+        Eigen::MatrixXd V(2 * (n + 1) * (n + 1), 2);
+        Eigen::MatrixXi F(2 * 2 * n * n, 3);
+        for (int b = 0; b < 2; ++b)
+        {
+            const int v0 = b * (n + 1) * (n + 1);
+            for (int j = 0; j <= n; ++j)
+                for (int i = 0; i <= n; ++i)
+                    V.row(v0 + j * (n + 1) + i) << double(i) / n, double(j) / n + b * (1 + gap);
+
+            for (int j = 0; j < n; ++j)
+                for (int i = 0; i < n; ++i)
+                {
+                    const int f = 2 * (b * n * n + j * n + i);
+                    const int v = v0 + j * (n + 1) + i;
+                    F.row(f) << v, v + 1, v + n + 2;
+                    F.row(f + 1) << v, v + n + 2, v + n + 1;
+                }
+        }
+
+        json in_args = json({});
+        in_args["normalize_mesh"] = false;
+        in_args["problem"] = "GenericTensor";
+        in_args["tensor_formulation"] = "NeoHookean";
+        in_args["has_collision"] = true;
+        in_args["nl_solver"] = nl_solver;
+        in_args["solver_params"] = {{"local_contact_max_fraction", 0.5}, {"local_contact_residual_ratio", 0.5}};
+        // bottom of the lower square fixed, top of the upper square moved down by more than the gap
+        in_args["problem_params"] = {{"dirichlet_boundary", {{{"id", 2}, {"value", {0, 0}}}, {{"id", 4}, {"value", {0, -0.05}}}}}};
+        in_args.merge_patch(extra_args);
+
+        state.init_logger("", 6, false);
+        state.init(in_args);
+        state.load_mesh(V, F);
+
+        state.compute_mesh_stats();
+        state.build_basis();
+
+        state.assemble_rhs();
+        state.assemble_stiffness_mat();
+    }
+
+    void solve_contact_scene(const std::string &nl_solver, Eigen::MatrixXd &sol, const json &extra_args = json({}))
+    {
+        State state;
+        init_contact_scene(nl_solver, state, extra_args);
+        state.solve_problem();
+
+        sol = state.sol;
+    }
+}
+
+TEST_CASE("local_contact_newton", "[solver]") {
+    Eigen::MatrixXd newton_sol, local_sol;
+    solve_contact_scene("newton", newton_sol);
+    solve_contact_scene("local_contact", local_sol);
+
+    REQUIRE(newton_sol.size() > 0);
+    REQUIRE(local_sol.size() == newton_sol.size());
+
+    // the default convergence test with contact is on the newton direction, which vanishes on the dofs held
+    // fixed by a local step, the solver must still converge to the solution of plain newton
+    REQUIRE((local_sol - newton_sol).norm() <= 1e-4 * newton_sol.norm());
+}
+
+TEST_CASE("adaptive_ccd", "[solver]") {
+    Eigen::MatrixXd exact_sol, adaptive_sol;
+    solve_contact_scene("newton", exact_sol);
+    solve_contact_scene("newton", adaptive_sol, {{"solver_params", {{"adaptive_ccd", true}}}});
+
+    REQUIRE(exact_sol.size() > 0);
+    REQUIRE(adaptive_sol.size() == exact_sol.size());
+
+    // the loose queries only shorten the steps, the solve converges to the same solution
+    REQUIRE((adaptive_sol - exact_sol).norm() <= 1e-4 * exact_sol.norm());
+}
+
+TEST_CASE("simulation_settings", "[solver]") {
+    State state;
+    init_contact_scene("newton", state, {{"mu", 0.2}, {"solver_params", {{"adaptive_ccd", true}, {"ccd_tolerance", 1e-5}}}});
+
+    // the typed settings mirror the arguments, including a dhat adjusted by build_basis
+    const SimulationSettings &settings = state.settings();
+    REQUIRE(settings.has_collision);
+    REQUIRE(settings.dhat == double(state.args["dhat"]));
+    REQUIRE(settings.epsv == double(state.args["epsv"]));
+    REQUIRE(settings.mu == 0.2);
+    REQUIRE(settings.adaptive_ccd);
+    REQUIRE(settings.ccd_tolerance == 1e-5);
+    REQUIRE(settings.ccd_method == "hash_grid");
+
+    // arguments edited after init (eg by the FEBio reader) are picked up by the next build_basis
+    state.args["has_collision"] = false;
+    state.build_basis();
+    REQUIRE(!state.settings().has_collision);
+}
+
+TEST_CASE("local_contact_hessian", "[solver]") {
+    State state;
+    init_contact_scene("newton", state);
+    state.solve_problem();
+
+    const int size = state.mesh->dimension();
+    RhsAssembler rhs_assembler(state.assembler, *state.mesh,
+                               state.n_bases, size,
+                               state.bases, state.bases, state.ass_vals_cache,
+                               state.formulation(), *state.problem,
+                               state.args["bc_method"],
+                               state.args["rhs_solver_type"], state.args["rhs_precond_type"], state.args["rhs_solver_params"]);
+    NLProblem nl_problem(state, rhs_assembler, 1, state.args["dhat"], false);
+
+    // at the solution the squares are in contact
+    NLProblem::TVector x;
+    nl_problem.full_to_reduced(state.sol, x);
+    nl_problem.init(state.sol);
+    nl_problem.update_lagging(x, /*start_of_timestep=*/true);
+    nl_problem.solution_changed(x);
+
+    StiffnessMatrix hessian, block;
+    std::vector<int> dofs;
+    nl_problem.hessian(x, hessian);
+    nl_problem.local_contact_dofs(x, 1, dofs);
+    REQUIRE(!dofs.empty());
+    REQUIRE(dofs.size() < size_t(x.size()));
+
+    const Eigen::MatrixXd full_hessian(hessian);
+    Eigen::MatrixXd expected(dofs.size(), dofs.size());
+    for (size_t i = 0; i < dofs.size(); ++i)
+        for (size_t j = 0; j < dofs.size(); ++j)
+            expected(i, j) = full_hessian(dofs[i], dofs[j]);
+
+    // the block matches the slice of the full hessian, also when its buffers are reused
+    for (int k = 0; k < 2; ++k)
+    {
+        nl_problem.local_hessian(x, dofs, block);
+        REQUIRE((Eigen::MatrixXd(block) - expected).norm() <= 1e-10 * expected.norm());
+    }
+}
+
+namespace {
+    // n x n grid of triangles of the unit square
+    void unit_square(const int n, Eigen::MatrixXd &V, Eigen::MatrixXi &F)
+    {
+        V.resize((n + 1) * (n + 1), 2);
+        F.resize(2 * n * n, 3);
+        for (int j = 0; j <= n; ++j)
+            for (int i = 0; i <= n; ++i)
+                V.row(j * (n + 1) + i) << double(i) / n, double(j) / n;
+
+        for (int j = 0; j < n; ++j)
+            for (int i = 0; i < n; ++i)
+            {
+                const int v = j * (n + 1) + i;
+                F.row(2 * (j * n + i)) << v, v + 1, v + n + 2;
+                F.row(2 * (j * n + i) + 1) << v, v + n + 2, v + n + 1;
+            }
+    }
+
+    // 8 x 8 grid of the unit square, the bottom is fixed and the top is pulled down smoothly from rest
+    void init_transient_square(const std::string &time_integrator, State &state, const int discr_order = 1)
+    {
+        Eigen::MatrixXd V;
+        Eigen::MatrixXi F;
+        unit_square(8, V, F);
+
+        json in_args = json({});
+        in_args["normalize_mesh"] = false;
+        in_args["problem"] = "GenericTensor";
+        in_args["tensor_formulation"] = "LinearElasticity";
+        in_args["params"] = {{"E", 100}, {"nu", 0.3}};
+        in_args["time_integrator"] = time_integrator;
+        in_args["discr_order"] = discr_order;
+        in_args["tend"] = 0.25;
+        in_args["time_steps"] = 50;
+        in_args["save_time_sequence"] = false;
+        in_args["problem_params"] = {{"is_time_dependent", true},
+                                     {"dirichlet_boundary", {{{"id", 2}, {"value", {0, 0}}}, {{"id", 4}, {"value", {0, "-0.1 * t * t"}}}}}};
+
+        state.init_logger("", 6, false);
+        state.init(in_args);
+        state.load_mesh(V, F);
+
+        state.compute_mesh_stats();
+        state.build_basis();
+    }
+}
+
+TEST_CASE("central_difference_stable_dt", "[solver]") {
+    State state;
+    init_transient_square("CentralDifference", state);
+
+    // the smallest node spacing of the grid is its edge length, the material is homogeneous
+    double lambda, mu;
+    state.assembler.lame_params().lambda_mu(0.5, 0.5, 0, 0, lambda, mu);
+    const double wave_speed = std::sqrt((lambda + 2 * mu) / state.density(0.5, 0.5, 0, 0));
+    const double cfl = 0.5;
+
+    REQUIRE(ExplicitCentralDifference::stable_dt(state.bases, state.assembler.lame_params(), state.density, cfl) == Approx(cfl / 8 / wave_speed));
+}
+
+TEST_CASE("central_difference", "[solver]") {
+    // the row sums of the p2 mass are zero at the vertices, the lumping must still be positive
+    for (const int discr_order : {1, 2})
+    {
+        Eigen::MatrixXd newmark_sol, explicit_sol;
+        {
+            State state;
+            init_transient_square("ImplicitNewmark", state, discr_order);
+            state.assemble_rhs();
+            state.assemble_stiffness_mat();
+            state.solve_problem();
+            newmark_sol = state.sol;
+        }
+        {
+            State state;
+            init_transient_square("CentralDifference", state, discr_order);
+            state.assemble_rhs();
+            state.assemble_stiffness_mat();
+            state.solve_problem();
+            explicit_sol = state.sol;
+        }
+
+        REQUIRE(newmark_sol.norm() > 0);
+        REQUIRE(explicit_sol.size() == newmark_sol.size());
+        REQUIRE(explicit_sol.allFinite());
+
+        // both schemes are second order, the smooth loading excites only the low modes
+        REQUIRE((explicit_sol - newmark_sol).norm() <= 5e-2 * newmark_sol.norm());
+    }
+}
+
+namespace {
+    // linear elasticity on a 4 x 4 grid of the unit square, the left side is fixed and the square is loaded by its weight
+    // extra_args is merged into the default arguments of the scene
+    void init_elastic_square(const int discr_order, const bool static_condensation, State &state, const json &extra_args = json({}))
+    {
+        Eigen::MatrixXd V;
+        Eigen::MatrixXi F;
+        unit_square(4, V, F);
+
+        json in_args = json({});
+        in_args["normalize_mesh"] = false;
+        in_args["problem"] = "GenericTensor";
+        in_args["tensor_formulation"] = "LinearElasticity";
+        in_args["discr_order"] = discr_order;
+        in_args["static_condensation"] = static_condensation;
+        in_args["problem_params"] = {{"rhs", {0, 0.1}}, {"dirichlet_boundary", {{{"id", 1}, {"value", {0, 0}}}}}};
+        in_args.merge_patch(extra_args);
+
+        state.init_logger("", 6, false);
+        state.init(in_args);
+        state.load_mesh(V, F);
+
+        state.compute_mesh_stats();
+        state.build_basis();
+
+        state.assemble_rhs();
+        state.assemble_stiffness_mat();
+    }
+
+    void solve_elastic_square(const int discr_order, const bool static_condensation, Eigen::MatrixXd &sol)
+    {
+        State state;
+        init_elastic_square(discr_order, static_condensation, state);
+        state.solve_problem();
+
+        sol = state.sol;
+    }
+}
+
+TEST_CASE("static_condensation", "[solver]") {
+    // the condensed nodes are the ones of a single element: free boundary edge nodes, and the bubbles from p3
+    for (const int discr_order : {2, 3, 4})
+    {
+        Eigen::MatrixXd direct_sol, condensed_sol;
+        solve_elastic_square(discr_order, false, direct_sol);
+        solve_elastic_square(discr_order, true, condensed_sol);
+
+        REQUIRE(direct_sol.norm() > 0);
+        REQUIRE(condensed_sol.size() == direct_sol.size());
+        REQUIRE((condensed_sol - direct_sol).norm() <= 1e-8 * direct_sol.norm());
+    }
+}
+
+TEST_CASE("load_cases", "[solver]") {
+    // the weight of the base problem, a sideways load, and a displaced left side
+    json cases = json::array();
+    cases.push_back({{"name", "weight"}});
+    cases.push_back({{"name", "side"}, {"problem_params", {{"rhs", {0.1, 0}}}}});
+    cases.push_back({{"name", "pulled"}, {"problem_params", {{"dirichlet_boundary", {{{"id", 1}, {"value", {0.01, 0}}}}}}}});
+    const json spectrum = {{"export", {{"spectrum", true}}}};
+
+    State batch;
+    json batch_args = spectrum;
+    batch_args["load_cases"] = cases;
+    init_elastic_square(1, false, batch, batch_args);
+    batch.solve_problem();
+
+    REQUIRE(batch.load_case_sols.cols() == int(cases.size()));
+
+    for (size_t c = 0; c < cases.size(); ++c)
+    {
+        json single_args = spectrum;
+        if (cases[c].contains("problem_params"))
+            single_args["problem_params"] = cases[c]["problem_params"];
+
+        State single;
+        init_elastic_square(1, false, single, single_args);
+        single.solve_problem();
+
+        REQUIRE(single.sol.norm() > 0);
+        REQUIRE((batch.load_case_sols.col(c) - single.sol).norm() <= 1e-8 * single.sol.norm());
+
+        // the batch leaves the state as solve_linear of the first case does
+        if (c == 0)
+        {
+            REQUIRE((batch.sol - single.sol).norm() <= 1e-8 * single.sol.norm());
+            REQUIRE((batch.rhs - single.rhs).norm() <= 1e-12 * single.rhs.norm());
+            REQUIRE((batch.spectrum - single.spectrum).norm() <= 1e-6 * (1 + single.spectrum.norm()));
+        }
+    }
+}
+
+TEST_CASE("predictor_friction", "[solver]") {
+    // the top square is pressed down and dragged sideways, so that the friction is active
+    json friction_args = {
+        {"mu", 0.3},
+        {"tend", 0.5},
+        {"time_steps", 5},
+        {"save_time_sequence", false},
+        {"solver_params", {{"gradNorm", 1e-8}}},
+        {"problem_params", {{"is_time_dependent", true},
+                            {"dirichlet_boundary", {{{"id", 2}, {"value", {0, 0}}}, {{"id", 4}, {"value", {"0.04 * t", "-0.1 * t"}}}}}}}};
+
+    Eigen::MatrixXd previous_sol, predicted_sol;
+    friction_args["predictor"] = "previous";
+    solve_contact_scene("newton", previous_sol, friction_args);
+    friction_args["predictor"] = "constant_velocity";
+    solve_contact_scene("newton", predicted_sol, friction_args);
+
+    REQUIRE(previous_sol.norm() > 0);
+    REQUIRE(predicted_sol.size() == previous_sol.size());
+
+    // the predictor only changes the initial guess, the lagged friction is taken at the previous solution in both cases
+    REQUIRE((predicted_sol - previous_sol).norm() <= 1e-4 * previous_sol.norm());
+}
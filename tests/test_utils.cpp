@@ -6,8 +6,30 @@
 #include <polyfem/MshReader.hpp>
 #include <polyfem/Mesh.hpp>
 #include <polyfem/VTUWriter.hpp>
+#include <polyfem/AsyncExporter.hpp>
+#include <polyfem/MeshUtils.hpp>
+
+#include <igl/edges.h>
+#include <igl/facet_adjacency_matrix.h>
+#include <igl/connected_components.h>
+#include <ipc/utils/faces_to_edges.hpp>
 
 #include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <numeric>
+#include <random>
+#include <set>
+
+#ifdef POLYFEM_WITH_ZLIB
+#include <zlib.h>
+#endif
 
 #include <catch.hpp>
 ////////////////////////////////////////////////////////////////////////////////
@@ -106,25 +128,267 @@ TEST_CASE("mshreader", "[utils]")
     REQUIRE(mesh);
 }
 
+namespace
+{
+    // minimal reader of the vtu files of VTUWriter, independent of its code: returns the decoded bytes of
+    // every DataArray (keyed by Name, "Points" for the points), base64 inline or raw appended, zlib compressed or not
+    std::map<std::string, std::string> read_vtu_arrays(const std::string &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        const std::string file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        const auto attribute = [](const std::string &tag, const std::string &name) {
+            const size_t start = tag.find(" " + name + "=\"");
+            if (start == std::string::npos)
+                return std::string();
+            const size_t value = start + name.size() + 3;
+            return tag.substr(value, tag.find('"', value) - value);
+        };
+
+        const bool compressed = attribute(file.substr(0, file.find('>')), "compressor") == "vtkZLibDataCompressor";
+        const size_t appended_start = file.find("<AppendedData encoding=\"raw\">");
+        const size_t appended = appended_start == std::string::npos ? appended_start : file.find('_', appended_start) + 1;
+
+        const auto read_u64 = [&](const size_t pos) {
+            uint64_t v;
+            std::memcpy(&v, &file[pos], sizeof(uint64_t));
+            return v;
+        };
+
+        const auto base64_decode = [](const std::string &text) {
+            const std::string chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            std::string out;
+            uint32_t buffer = 0;
+            int bits = 0;
+            for (const char c : text)
+            {
+                const size_t v = chars.find(c);
+                if (v == std::string::npos)
+                    continue;
+                buffer = (buffer << 6) | uint32_t(v);
+                bits += 6;
+                if (bits >= 8)
+                {
+                    bits -= 8;
+                    out.push_back(char((buffer >> bits) & 0xff));
+                }
+            }
+            return out;
+        };
+
+        std::map<std::string, std::string> arrays;
+        for (size_t pos = file.find("<DataArray"); pos < appended_start && pos != std::string::npos; pos = file.find("<DataArray", pos + 1))
+        {
+            const std::string tag = file.substr(pos, file.find('>', pos) - pos + 1);
+            std::string name = attribute(tag, "Name");
+            if (name.empty())
+                name = "Points";
+
+            const std::string format = attribute(tag, "format");
+            std::string data;
+            if (format == "binary")
+            {
+                const size_t start = pos + tag.size();
+                const std::string decoded = base64_decode(file.substr(start, file.find("</DataArray>", start) - start));
+                REQUIRE(decoded.size() >= sizeof(uint64_t));
+                uint64_t size;
+                std::memcpy(&size, decoded.data(), sizeof(uint64_t));
+                REQUIRE(decoded.size() >= sizeof(uint64_t) + size);
+                data = decoded.substr(sizeof(uint64_t), size);
+            }
+            else
+            {
+                REQUIRE(format == "appended");
+                REQUIRE(appended != std::string::npos);
+                const size_t start = appended + std::stoul(attribute(tag, "offset"));
+                if (!compressed)
+                    data = file.substr(start + sizeof(uint64_t), read_u64(start));
+                else
+                {
+#ifdef POLYFEM_WITH_ZLIB
+                    const uint64_t n_blocks = read_u64(start);
+                    const uint64_t block_size = read_u64(start + 8);
+                    const uint64_t last_size = read_u64(start + 16);
+                    size_t block = start + (3 + n_blocks) * sizeof(uint64_t);
+                    for (uint64_t b = 0; b < n_blocks; ++b)
+                    {
+                        const uint64_t compressed_size = read_u64(start + (3 + b) * sizeof(uint64_t));
+                        uLongf size = (b + 1 == n_blocks && last_size > 0) ? last_size : block_size;
+                        std::string inflated(size, 0);
+                        REQUIRE(uncompress(reinterpret_cast<Bytef *>(&inflated[0]), &size, reinterpret_cast<const Bytef *>(&file[block]), compressed_size) == Z_OK);
+                        REQUIRE(size == inflated.size());
+                        data += inflated;
+                        block += compressed_size;
+                    }
+#else
+                    FAIL("compressed vtu without zlib");
+#endif
+                }
+            }
+            arrays[name] = data;
+        }
+        return arrays;
+    }
+} // namespace
+
 TEST_CASE("vtu_writer", "[utils]")
 {
-    Eigen::MatrixXd pts(25, 3);
-    pts << 0, 0, 0, 0.25, 0, 0, 0, 0.25, 0, 0.25, 0.25, 0,
-        0.5, 0, 0, 0.5, 0.25, 0, 0.75, 0, 0, 0.75, 0.25, 0,
-        1, 0, 0, 1, 0.25, 0, 0, 0.5, 0, 0.25, 0.5, 0,
-        0.5, 0.5, 0, 0.75, 0.5, 0, 1, 0.5, 0, 0, 0.75, 0,
-        0.25, 0.75, 0, 0.5, 0.75, 0, 0.75, 0.75, 0, 1, 0.75, 0,
-        0, 1, 0, 0.25, 1, 0, 0.5, 1, 0, 0.75, 1, 0,
-        1, 1, 0;
-    pts = pts.leftCols(2).eval();
-
-    Eigen::MatrixXd v(25, 1);
+    // enough points for several compression blocks, the last one partial
+    const int n_points = 5000;
+    Eigen::MatrixXd pts(n_points, 2);
+    pts.setRandom();
+
+    Eigen::MatrixXd v(n_points, 1);
     v.setRandom();
+    Eigen::MatrixXd vec(n_points, 2);
+    vec.setRandom();
+
+    Eigen::MatrixXi tris(n_points - 2, 3);
+    for (int i = 0; i < tris.rows(); ++i)
+        tris.row(i) << i, i + 1, i + 2;
+
+    const auto write = [&](const std::string &path, const bool appended, const bool compress) {
+        VTUWriter writer;
+        writer.set_appended(appended, compress);
+        writer.add_field("test", v);
+        writer.add_field("vec", vec);
+        REQUIRE(writer.write_mesh(path, pts, tris));
+        return read_vtu_arrays(path);
+    };
+
+    const auto binary = write("test.vtu", false, false);
+    const auto appended = write("test_appended.vtu", true, false);
+    const auto compressed = write("test_compressed.vtu", true, true);
+
+    // the data is the same in every format
+    REQUIRE(binary.size() == 6);
+    REQUIRE(appended == binary);
+    REQUIRE(compressed == binary);
+
+    // and it is the input
+    const auto as_matrix = [](const std::string &data, const int rows, const int cols) {
+        REQUIRE(data.size() == rows * cols * sizeof(double));
+        Eigen::MatrixXd m(rows, cols);
+        std::memcpy(m.data(), data.data(), data.size());
+        return m;
+    };
 
-    Eigen::MatrixXi tris(1, 3);
-    tris << 0, 1, 2;
+    Eigen::MatrixXd pts3 = Eigen::MatrixXd::Zero(n_points, 3);
+    pts3.leftCols(2) = pts;
+    REQUIRE(as_matrix(binary.at("Points"), 3, n_points) == pts3.transpose());
+    REQUIRE(as_matrix(binary.at("test"), 1, n_points) == v.transpose());
+    REQUIRE(as_matrix(binary.at("vec"), 2, n_points) == vec.transpose());
 
-    VTUWriter writer;
-    writer.add_field("test", v);
-    writer.write_mesh("test.vtu", pts, tris);
-}
\ No newline at end of file
+    const std::string &connectivity = binary.at("connectivity");
+    REQUIRE(connectivity.size() == tris.size() * sizeof(int64_t));
+    Eigen::Matrix<int64_t, Eigen::Dynamic, Eigen::Dynamic> ids(3, tris.rows());
+    std::memcpy(ids.data(), connectivity.data(), connectivity.size());
+    REQUIRE(ids == tris.transpose().cast<int64_t>());
+    REQUIRE(binary.at("types") == std::string(tris.rows(), char(5)));
+}
+
+TEST_CASE("async_exporter", "[utils]")
+{
+    const int n_jobs = 20;
+    for (int queue_size : {0, 1, 3})
+    {
+        std::vector<int> order;
+        {
+            AsyncExporter exporter(queue_size);
+            for (int i = 0; i < n_jobs; ++i)
+                exporter.push([&order, i]() { order.push_back(i); });
+            exporter.flush();
+            REQUIRE(order.size() == n_jobs);
+
+            exporter.push([]() { throw std::runtime_error("export failed"); });
+            exporter.push([&order, n_jobs]() { order.push_back(n_jobs); });
+            REQUIRE_THROWS(exporter.flush());
+        }
+
+        REQUIRE(order.size() == n_jobs + 1);
+        for (int i = 0; i <= n_jobs; ++i)
+            REQUIRE(order[i] == i);
+    }
+}
+
+TEST_CASE("boundary_faces_and_edges", "[utils]")
+{
+    // closed surface of a tetrahedron (4 triangles), a 4x4 grid (32 triangles) and a lone triangle
+    std::vector<std::array<int, 3>> tris = {{{0, 1, 2}}, {{0, 3, 1}}, {{1, 3, 2}}, {{2, 3, 0}}};
+    const int n = 4;
+    const auto grid = [n](int i, int j) { return 4 + i * (n + 1) + j; };
+    for (int i = 0; i < n; ++i)
+    {
+        for (int j = 0; j < n; ++j)
+        {
+            tris.push_back({{grid(i, j), grid(i + 1, j), grid(i + 1, j + 1)}});
+            tris.push_back({{grid(i, j), grid(i + 1, j + 1), grid(i, j + 1)}});
+        }
+    }
+    const int lone = grid(n, n) + 1;
+    tris.push_back({{lone, lone + 1, lone + 2}});
+
+    // shuffled vertices and faces, so the components are interleaved
+    std::mt19937 gen(42);
+    std::vector<int> perm(lone + 3);
+    std::iota(perm.begin(), perm.end(), 0);
+    std::shuffle(perm.begin(), perm.end(), gen);
+    std::shuffle(tris.begin(), tris.end(), gen);
+
+    Eigen::MatrixXi F(tris.size(), 3);
+    for (int f = 0; f < F.rows(); ++f)
+    {
+        for (int j = 0; j < 3; ++j)
+            F(f, j) = perm[tris[f][j]];
+    }
+
+    const auto sorted_edge = [](const Eigen::MatrixXi &E, const int e) { return std::make_pair(E.row(e).minCoeff(), E.row(e).maxCoeff()); };
+
+    for (const int min_component : {0, 2, 5})
+    {
+        // reference, as extract_boundary_mesh computed it with igl and ipc
+        Eigen::MatrixXi F_ref = F;
+        if (min_component > 0)
+        {
+            Eigen::SparseMatrix<int> adj;
+            igl::facet_adjacency_matrix(F, adj);
+            Eigen::MatrixXi C, counts;
+            igl::connected_components(adj, C, counts);
+
+            std::vector<int> kept;
+            for (int f = 0; f < C.size(); ++f)
+            {
+                if (counts(C(f)) >= min_component)
+                    kept.push_back(f);
+            }
+            F_ref.resize(kept.size(), 3);
+            for (size_t f = 0; f < kept.size(); ++f)
+                F_ref.row(f) = F.row(kept[f]);
+        }
+        Eigen::MatrixXi E_ref;
+        igl::edges(F_ref, E_ref);
+        const Eigen::MatrixXi FE_ref = ipc::faces_to_edges(F_ref, E_ref);
+
+        Eigen::MatrixXi F_new = F, E, FE;
+        boundary_faces_and_edges(min_component, F_new, E, FE);
+
+        REQUIRE(F_new == F_ref);
+        REQUIRE(E.rows() == E_ref.rows());
+
+        // same edges, possibly in another order
+        std::set<std::pair<int, int>> edges, edges_ref;
+        for (int e = 0; e < E.rows(); ++e)
+        {
+            edges.insert(sorted_edge(E, e));
+            edges_ref.insert(sorted_edge(E_ref, e));
+        }
+        REQUIRE(edges == edges_ref);
+
+        REQUIRE(FE.rows() == FE_ref.rows());
+        for (int f = 0; f < FE.rows(); ++f)
+        {
+            for (int j = 0; j < 3; ++j)
+                REQUIRE(sorted_edge(E, FE(f, j)) == sorted_edge(E_ref, FE_ref(f, j)));
+        }
+    }
+}